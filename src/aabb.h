@@ -0,0 +1,68 @@
+#ifndef AABB_H
+#define AABB_H
+
+// Defines an axis-aligned bounding box, stored as one interval per axis
+class aabb {
+public:
+    interval x, y, z;
+
+    // Default constructor creates an empty box since the default intervals are empty
+    aabb() {}
+
+    // Constructor that builds a box from the interval on each axis
+    aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z) {}
+
+    // Constructor that builds the box spanned by two corner points, in any order
+    aabb(const point3& a, const point3& b) {
+        x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+        y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+        z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+    }
+
+    // Constructor that builds the tightest box enclosing two boxes
+    aabb(const aabb& box0, const aabb& box1) : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+    // Returns the interval of axis n (0 = x, 1 = y, 2 = z)
+    const interval& axisInterval(int n) const {
+        if (n == 1) return y;
+        if (n == 2) return z;
+        return x;
+    }
+
+    // Returns true if the box contains no points
+    bool isEmpty() const { return x.min > x.max || y.min > y.max || z.min > z.max; }
+
+    // Returns the length of the longest side of the box
+    double maxExtent() const { return std::fmax(x.size(), std::fmax(y.size(), z.size())); }
+
+    // Slab test: returns true if the ray overlaps the box somewhere inside rayT, and narrows rayT to the overlapping part
+    bool hit(const ray& r, interval& rayT) const {
+        const point3& rayOrig = r.origin();
+        const vec3& rayDir = r.direction();
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = axisInterval(axis);
+            // Inverse of the direction component; infinities for axis-parallel rays are handled by the comparisons below
+            const double adinv = 1.0 / rayDir[axis];
+
+            // Distances at which the ray crosses the two slab planes of this axis
+            auto t0 = (ax.min - rayOrig[axis]) * adinv;
+            auto t1 = (ax.max - rayOrig[axis]) * adinv;
+
+            // Shrinks the ray interval to the part between the planes
+            if (t0 < t1) {
+                if (t0 > rayT.min) rayT.min = t0;
+                if (t1 < rayT.max) rayT.max = t1;
+            } else {
+                if (t1 > rayT.min) rayT.min = t1;
+                if (t0 < rayT.max) rayT.max = t0;
+            }
+
+            if (rayT.max <= rayT.min)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,83 @@
+// Replacement global operator new/delete that feed allocationProfiler.h; only compiled with -DWEEKENDFUN_ALLOCATION_PROFILING=ON
+// The executable links this file itself: an object inside the static library would be dropped by the linker since nothing references it, so applications embedding the library add it to their own sources to profile
+// Every block carries a small header in front of it with the requested size, so delete can account for the bytes it releases
+
+#include "allocationProfiler.h"
+
+// Libraries for the underlying allocator and the allocation failure exception
+#include <cstdlib>
+#include <new>
+
+#if defined(WEEKENDFUN_ALLOCATION_PROFILING)
+
+// Header size; keeps the returned pointer aligned for any fundamental type
+static constexpr std::size_t headerBytes = alignof(std::max_align_t) > sizeof(std::size_t) ? alignof(std::max_align_t) : sizeof(std::size_t);
+
+// Allocates size bytes behind a header aligned to align (at least headerBytes) and records the allocation; nullptr on failure
+static void* profiledAllocate(std::size_t size, std::size_t align) {
+    // The header occupies one full alignment unit, so the block after it keeps the alignment
+    std::size_t offset = align < headerBytes ? headerBytes : align;
+    std::size_t total = offset + (size ? size : 1);
+    void* base = nullptr;
+    if (offset == headerBytes)
+        base = std::malloc(total);
+    else
+        base = std::aligned_alloc(offset, (total + offset - 1) / offset * offset);
+    if (!base)
+        return nullptr;
+    auto* block = static_cast<unsigned char*>(base) + offset;
+    // The size and the offset back to the base sit right in front of the block
+    reinterpret_cast<std::size_t*>(block)[-1] = size;
+    reinterpret_cast<std::size_t*>(block)[-2] = offset;
+    recordAllocation(size);
+    return block;
+}
+
+static void profiledRelease(void* pointer) {
+    if (!pointer)
+        return;
+    auto* block = static_cast<unsigned char*>(pointer);
+    std::size_t size = reinterpret_cast<std::size_t*>(block)[-1];
+    std::size_t offset = reinterpret_cast<std::size_t*>(block)[-2];
+    recordFree(size);
+    std::free(block - offset);
+}
+
+// Throwing allocation: retries through the new handler like the standard operator new does
+static void* profiledNew(std::size_t size, std::size_t align) {
+    while (true) {
+        if (void* block = profiledAllocate(size, align))
+            return block;
+        auto handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+static_assert(2 * sizeof(std::size_t) <= headerBytes, "the header must fit the size and the offset");
+
+void* operator new(std::size_t size) { return profiledNew(size, headerBytes); }
+void* operator new[](std::size_t size) { return profiledNew(size, headerBytes); }
+void* operator new(std::size_t size, std::align_val_t align) { return profiledNew(size, std::size_t(align)); }
+void* operator new[](std::size_t size, std::align_val_t align) { return profiledNew(size, std::size_t(align)); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return profiledAllocate(size, headerBytes); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return profiledAllocate(size, headerBytes); }
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return profiledAllocate(size, std::size_t(align)); }
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return profiledAllocate(size, std::size_t(align)); }
+
+void operator delete(void* pointer) noexcept { profiledRelease(pointer); }
+void operator delete[](void* pointer) noexcept { profiledRelease(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { profiledRelease(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { profiledRelease(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { profiledRelease(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { profiledRelease(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { profiledRelease(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { profiledRelease(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { profiledRelease(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { profiledRelease(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { profiledRelease(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { profiledRelease(pointer); }
+
+#endif
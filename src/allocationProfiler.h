@@ -0,0 +1,197 @@
+#ifndef ALLOCATIONPROFILER_H
+#define ALLOCATIONPROFILER_H
+
+// Opt-in heap allocation instrumentation: configure with -DWEEKENDFUN_ALLOCATION_PROFILING=ON to replace the global operator new/delete (src/allocationHooks.cc)
+// Allocations are attributed to the phase the program is in and to the thread that made them; the peak of live heap bytes is tracked per phase
+// Code that must not allocate (the per-pixel tracing loops) marks itself with allocationHotPath, and every allocation made inside such a scope is counted separately
+// Without the option every type here is an empty shell and the hooks are not linked, so the instrumentation costs nothing
+
+// Libraries for the lock-free counters and the report
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+// Stages of a run that allocations are attributed to
+enum class allocationPhase {
+    other,
+    sceneBuild,
+    accelerationBuild,
+    render,
+    output,
+    count
+};
+
+inline const char* phaseName(allocationPhase phase) {
+    switch (phase) {
+        case allocationPhase::sceneBuild:        return "scene build";
+        case allocationPhase::accelerationBuild: return "acceleration build";
+        case allocationPhase::render:            return "render";
+        case allocationPhase::output:            return "output";
+        default:                                 return "other";
+    }
+}
+
+#if defined(WEEKENDFUN_ALLOCATION_PROFILING)
+
+// Counters of one thread in one phase; written only by the owning thread, read by the report
+class allocationCounters {
+public:
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> frees{0};
+    std::atomic<std::uint64_t> bytes{0};
+};
+
+// Process-wide state of the instrumentation
+// Everything is constant-initialized and fixed-size, so the allocation hooks never allocate themselves and work before main and after static destruction
+class allocationProfilerState {
+public:
+    // Threads beyond this share the last slot
+    static constexpr int maxThreads = 64;
+    static constexpr int phaseCount = int(allocationPhase::count);
+
+    std::atomic<int> phase{0};
+    std::atomic<int> threadsSeen{0};
+    allocationCounters counters[maxThreads][phaseCount];
+    // Allocations made inside an allocationHotPath scope, over all threads
+    std::atomic<std::uint64_t> hotPathAllocations{0};
+    std::atomic<std::uint64_t> hotPathBytes{0};
+    // Live heap bytes now, their all-time peak and the peak within each phase
+    std::atomic<std::int64_t> liveBytes{0};
+    std::atomic<std::int64_t> peakBytes{0};
+    std::atomic<std::int64_t> phasePeakBytes[phaseCount] = {};
+};
+
+inline allocationProfilerState allocationProfile;
+
+// Per-thread slot in allocationProfile.counters (-1 until the thread first allocates) and depth of nested allocationHotPath scopes
+inline thread_local int allocationThreadSlot = -1;
+inline thread_local int allocationHotPathDepth = 0;
+
+inline void raiseToAtLeast(std::atomic<std::int64_t>& peak, std::int64_t value) {
+    auto current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+// Called by operator new for every allocation of size bytes
+inline void recordAllocation(std::size_t size) {
+    auto& state = allocationProfile;
+    if (allocationThreadSlot < 0)
+        allocationThreadSlot = std::min(state.threadsSeen.fetch_add(1, std::memory_order_relaxed), allocationProfilerState::maxThreads - 1);
+    int phase = state.phase.load(std::memory_order_relaxed);
+    auto& counters = state.counters[allocationThreadSlot][phase];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    if (allocationHotPathDepth > 0) {
+        state.hotPathAllocations.fetch_add(1, std::memory_order_relaxed);
+        state.hotPathBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    auto live = state.liveBytes.fetch_add(std::int64_t(size), std::memory_order_relaxed) + std::int64_t(size);
+    raiseToAtLeast(state.peakBytes, live);
+    raiseToAtLeast(state.phasePeakBytes[phase], live);
+}
+
+// Called by operator delete for every release of an allocation of size bytes
+inline void recordFree(std::size_t size) {
+    auto& state = allocationProfile;
+    if (allocationThreadSlot < 0)
+        allocationThreadSlot = std::min(state.threadsSeen.fetch_add(1, std::memory_order_relaxed), allocationProfilerState::maxThreads - 1);
+    state.counters[allocationThreadSlot][state.phase.load(std::memory_order_relaxed)].frees.fetch_add(1, std::memory_order_relaxed);
+    state.liveBytes.fetch_sub(std::int64_t(size), std::memory_order_relaxed);
+}
+
+// Switches the whole process to phase for the scope's lifetime; allocations of every thread are attributed to it
+class allocationPhaseScope {
+public:
+    explicit allocationPhaseScope(allocationPhase phase)
+        : previous(allocationProfile.phase.exchange(int(phase))) {
+        // The phase peak starts from what is live when the phase begins
+        raiseToAtLeast(allocationProfile.phasePeakBytes[int(phase)], allocationProfile.liveBytes.load());
+    }
+    ~allocationPhaseScope() { allocationProfile.phase.store(previous); }
+    allocationPhaseScope(const allocationPhaseScope&) = delete;
+    allocationPhaseScope& operator=(const allocationPhaseScope&) = delete;
+
+private:
+    int previous;
+};
+
+// Marks code on the calling thread that must not allocate
+class allocationHotPath {
+public:
+    allocationHotPath() { allocationHotPathDepth++; }
+    ~allocationHotPath() { allocationHotPathDepth--; }
+    allocationHotPath(const allocationHotPath&) = delete;
+    allocationHotPath& operator=(const allocationHotPath&) = delete;
+};
+
+inline constexpr bool allocationProfilingEnabled = true;
+
+// Allocations made inside allocationHotPath scopes so far
+inline std::uint64_t hotPathAllocations() {
+    return allocationProfile.hotPathAllocations.load();
+}
+
+// Prints allocations, bytes and peak live memory per phase, then each thread's allocations per phase
+inline void printAllocationReport(std::ostream& out) {
+    auto& state = allocationProfile;
+    const int threads = std::min(state.threadsSeen.load(), allocationProfilerState::maxThreads);
+    out << std::left << std::setw(20) << "phase" << std::right << std::setw(14) << "allocations" << std::setw(12) << "frees"
+        << std::setw(14) << "MiB" << std::setw(14) << "peak MiB" << '\n';
+    for (int phase = 0; phase < allocationProfilerState::phaseCount; phase++) {
+        std::uint64_t allocations = 0, frees = 0, bytes = 0;
+        for (int t = 0; t < threads; t++) {
+            allocations += state.counters[t][phase].allocations.load();
+            frees += state.counters[t][phase].frees.load();
+            bytes += state.counters[t][phase].bytes.load();
+        }
+        if (allocations == 0 && frees == 0)
+            continue;
+        out << std::left << std::setw(20) << phaseName(allocationPhase(phase)) << std::right << std::setw(14) << allocations
+            << std::setw(12) << frees << std::setw(14) << std::fixed << std::setprecision(3) << bytes / 1048576.0
+            << std::setw(14) << state.phasePeakBytes[phase].load() / 1048576.0 << '\n';
+    }
+    out << "peak live heap " << state.peakBytes.load() / 1048576.0 << " MiB, hot path allocations " << state.hotPathAllocations.load()
+        << " (" << state.hotPathBytes.load() << " bytes)\n";
+
+    out << "allocations per thread (numbered in order of their first heap use):\n";
+    for (int t = 0; t < threads; t++) {
+        std::uint64_t total = 0;
+        for (int phase = 0; phase < allocationProfilerState::phaseCount; phase++)
+            total += state.counters[t][phase].allocations.load();
+        // Threads that only released memory others allocated are left out
+        if (total == 0)
+            continue;
+        out << "  thread " << t << (t == allocationProfilerState::maxThreads - 1 ? "+" : "") << ':';
+        for (int phase = 0; phase < allocationProfilerState::phaseCount; phase++) {
+            auto allocations = state.counters[t][phase].allocations.load();
+            if (allocations > 0)
+                out << ' ' << phaseName(allocationPhase(phase)) << '=' << allocations;
+        }
+        out << '\n';
+    }
+}
+
+#else
+
+class allocationPhaseScope {
+public:
+    explicit allocationPhaseScope(allocationPhase) {}
+};
+
+class allocationHotPath {
+public:
+    allocationHotPath() {}
+};
+
+inline constexpr bool allocationProfilingEnabled = false;
+
+inline std::uint64_t hotPathAllocations() { return 0; }
+
+inline void printAllocationReport(std::ostream&) {}
+
+#endif
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "camera.h"
+#include "profiling.h"
+#include "threadPool.h"
+
+// Libraries for the cache file, host identification and the candidate lists
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+// Performance settings the autotuner chooses; every field maps to a camera or renderer setting of the same name
+class tuningConfig {
+public:
+    // Threads taking part in a render, the calling thread included
+    unsigned threads = 1;
+    // Tile edge of renderTiles (library renders)
+    int tileSize = 32;
+    // Samples per pixel added by each pass of renderProgressive
+    int samplesPerPass = 4;
+    // Paths in flight per batch in batched bounce mode
+    int rayBatchSize = 1 << 16;
+    // Camera samples per second of the winning calibration render, for reference
+    double samplesPerSecond = 0;
+
+    // Serializes as space separated key=value pairs, the format of a cache file entry
+    std::string toString() const {
+        std::ostringstream out;
+        out << "threads=" << threads << " tileSize=" << tileSize << " samplesPerPass=" << samplesPerPass
+            << " rayBatchSize=" << rayBatchSize << " samplesPerSecond=" << samplesPerSecond;
+        return out.str();
+    }
+
+    // Reads what toString wrote; unknown keys are ignored so older binaries can read newer caches
+    bool parse(const std::string& text) {
+        std::istringstream fields(text);
+        std::string field;
+        bool any = false;
+        while (fields >> field) {
+            auto equals = field.find('=');
+            if (equals == std::string::npos)
+                return false;
+            auto key = field.substr(0, equals);
+            auto value = field.substr(equals + 1);
+            // A corrupted or hand-edited value rejects the whole entry, so the scene runs untuned instead of half tuned
+            bool valid = true;
+            if (key == "threads")               valid = parseNumber(value, threads);
+            else if (key == "tileSize")         valid = parseNumber(value, tileSize);
+            else if (key == "samplesPerPass")   valid = parseNumber(value, samplesPerPass);
+            else if (key == "rayBatchSize")     valid = parseNumber(value, rayBatchSize);
+            else if (key == "samplesPerSecond") valid = parseNumber(value, samplesPerSecond);
+            if (!valid)
+                return false;
+            any = true;
+        }
+        return any && threads > 0 && tileSize > 0 && samplesPerPass > 0 && rayBatchSize > 0;
+    }
+
+private:
+    // Reads all of text as a number; false for anything else (empty, trailing characters, out of range), without throwing
+    template <typename Number>
+    static bool parseNumber(const std::string& text, Number& number) {
+        // Stream extraction would wrap a negative number into an unsigned one
+        if (text.empty() || (std::is_unsigned_v<Number> && text[0] == '-'))
+            return false;
+        std::istringstream in(text);
+        Number value{};
+        if (!(in >> value) || in.peek() != std::char_traits<char>::eof())
+            return false;
+        number = value;
+        return true;
+    }
+};
+
+// Identifies the machine a configuration was tuned on: host name, hardware threads and cache sizes where the platform reports them
+inline std::string hostKey() {
+    std::ostringstream key;
+    char name[256] = "unknown";
+#if defined(__unix__) || defined(__APPLE__)
+    if (gethostname(name, sizeof(name)) != 0)
+        std::strcpy(name, "unknown");
+    name[sizeof(name) - 1] = '\0';
+#endif
+    key << name << ",threads=" << std::thread::hardware_concurrency();
+#if defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    key << ",l2=" << sysconf(_SC_LEVEL2_CACHE_SIZE) << ",l3=" << sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    return key.str();
+}
+
+// Persistent store of tuned configurations, one line per host and scene: "<host> | <scene> | <config>"
+// Lines of other hosts are kept untouched, so one file can be shared by a fleet
+class tuningCache {
+public:
+    explicit tuningCache(std::string path) : path(std::move(path)) {
+        std::ifstream in(this->path);
+        std::string line;
+        while (std::getline(in, line)) {
+            auto second = line.rfind(" | ");
+            if (second == std::string::npos || second == 0)
+                continue;
+            entries[line.substr(0, second)] = line.substr(second + 3);
+        }
+    }
+
+    // Looks up the configuration of scene on this host
+    bool find(const std::string& scene, tuningConfig& config) const {
+        auto entry = entries.find(hostKey() + " | " + scene);
+        return entry != entries.end() && config.parse(entry->second);
+    }
+
+    // Records the configuration of scene on this host; save() writes it out
+    void store(const std::string& scene, const tuningConfig& config) {
+        entries[hostKey() + " | " + scene] = config.toString();
+    }
+
+    // Rewrites the cache file; returns false if it cannot be written
+    bool save() const {
+        std::ofstream out(path, std::ios::trunc);
+        for (const auto& entry : entries)
+            out << entry.first << " | " << entry.second << '\n';
+        return bool(out);
+    }
+
+private:
+    std::string path;
+    std::map<std::string, std::string> entries;
+};
+
+// Limits of an autotune run
+class autotuneOptions {
+public:
+    // Samples per pixel of the calibration renders
+    int calibrationSpp = 2;
+    // Rows of the horizontal band through the image center that the tile and thread calibrations render
+    int calibrationRows = 48;
+    // Largest thread count tried; 0 = one per hardware thread
+    unsigned maxThreads = 0;
+    // Smallest samplesPerPass whose throughput is within this fraction of the best is chosen, since smaller passes make progressive previews and deadlines more responsive
+    double passOverheadTolerance = 0.05;
+    // Repetitions per candidate; the fastest counts
+    int repetitions = 2;
+};
+
+// Runs the calibration renders of autotune and remembers their timings
+template <typename World>
+class autotuner {
+public:
+    autotuner(const World& world, const camera& base, const autotuneOptions& options, std::ostream* log)
+        : world(world), base(base), options(options), log(log) {}
+
+    tuningConfig run() {
+        tuningConfig best;
+
+        // Threads: powers of two up to the hardware thread count, plus the count itself
+        unsigned maxThreads = options.maxThreads ? options.maxThreads : std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> threadCandidates;
+        for (unsigned t = 1; t < maxThreads; t *= 2)
+            threadCandidates.push_back(t);
+        threadCandidates.push_back(maxThreads);
+        double bestSeconds = infinity;
+        for (unsigned threads : threadCandidates) {
+            double seconds = bandSeconds(threads, best.tileSize);
+            report("threads", threads, seconds);
+            if (seconds < bestSeconds) {
+                bestSeconds = seconds;
+                best.threads = threads;
+            }
+        }
+
+        // Tile size at the chosen thread count
+        bestSeconds = infinity;
+        for (int tileSize : {8, 16, 32, 64, 128}) {
+            double seconds = bandSeconds(best.threads, tileSize);
+            report("tileSize", tileSize, seconds);
+            if (seconds < bestSeconds) {
+                bestSeconds = seconds;
+                best.tileSize = tileSize;
+            }
+        }
+        best.samplesPerSecond = bandSamples() / bestSeconds;
+
+        // Ray batch size of the batched bounce mode
+        // The batched mode traces one scanline at a time, so batches of a row's paths or more all behave alike: the candidates stop below the row of the render being tuned, which is itself the last candidate, and are timed on rows of that same width and spp
+        const int rowPaths = base.imageWidth * std::max(1, base.samplesPerPixel);
+        std::vector<int> batchCandidates;
+        for (int batchSize : {1 << 10, 1 << 12, 1 << 14, 1 << 16})
+            if (batchSize < rowPaths)
+                batchCandidates.push_back(batchSize);
+        if (rowPaths <= 1 << 16)
+            batchCandidates.push_back(rowPaths);
+        best.rayBatchSize = batchCandidates.back();
+        bestSeconds = infinity;
+        for (int batchSize : batchCandidates) {
+            if (batchCandidates.size() == 1)
+                break;
+            double seconds = batchedSeconds(best.threads, batchSize);
+            report("rayBatchSize", batchSize, seconds);
+            if (seconds < bestSeconds) {
+                bestSeconds = seconds;
+                best.rayBatchSize = batchSize;
+            }
+        }
+
+        // Samples per pass: the smallest pass whose per-pass overhead stays within the tolerance
+        std::vector<std::pair<int, double>> passTimes;
+        bestSeconds = infinity;
+        for (int samplesPerPass : {1, 2, 4, 8, 16}) {
+            double seconds = progressiveSeconds(best.threads, samplesPerPass);
+            report("samplesPerPass", samplesPerPass, seconds);
+            passTimes.push_back({ samplesPerPass, seconds });
+            bestSeconds = std::min(bestSeconds, seconds);
+        }
+        for (const auto& [samplesPerPass, seconds] : passTimes) {
+            if (seconds <= bestSeconds * (1 + options.passOverheadTolerance)) {
+                best.samplesPerPass = samplesPerPass;
+                break;
+            }
+        }
+
+        if (log)
+            *log << "Autotune: " << best.toString() << '\n';
+        return best;
+    }
+
+private:
+    const World& world;
+    camera base;
+    autotuneOptions options;
+    std::ostream* log;
+
+    void report(const char* knob, long value, double seconds) {
+        if (log)
+            *log << "  " << knob << '=' << value << ": " << seconds * 1e3 << " ms\n";
+    }
+
+    // Camera of the calibration renders: the scene's view at calibration spp, silent, on a pool of threads
+    camera calibrationCamera(threadPool* pool) const {
+        camera cam = base;
+        cam.samplesPerPixel = std::max(1, options.calibrationSpp);
+        cam.pool = pool;
+        cam.output = nullptr;
+        cam.progressLog = nullptr;
+        cam.onPass = nullptr;
+        return cam;
+    }
+
+    // Camera samples in the calibration band
+    double bandSamples() const {
+        return double(base.imageWidth) * std::min(options.calibrationRows, base.outputHeight()) * std::max(1, options.calibrationSpp);
+    }
+
+    // Fastest of the repetitions of measure(pool), run on a pool giving threads participants
+    template <typename Measure>
+    double fastest(unsigned threads, Measure&& measure) {
+        std::unique_ptr<threadPool> pool;
+        if (threads > 1)
+            pool = std::make_unique<threadPool>(threads - 1);
+        double best = infinity;
+        for (int repetition = 0; repetition < std::max(1, options.repetitions); repetition++) {
+            stopwatch timer;
+            measure(pool.get());
+            best = std::min(best, timer.seconds());
+        }
+        return best;
+    }
+
+    // Renders the full-width band through the image center with renderTiles, the path of library renders
+    double bandSeconds(unsigned threads, int tileSize) {
+        return fastest(threads, [&](threadPool* pool) {
+            camera cam = calibrationCamera(pool);
+            int rows = std::min(options.calibrationRows, cam.outputHeight());
+            int firstRow = (cam.outputHeight() - rows) / 2;
+            cam.renderTiles(world, tileSize, nullptr, 0, [](const imageTile&) {}, firstRow, firstRow + rows);
+        });
+    }
+
+    // Quarter-width image for the calibrations that can only render whole images
+    camera reducedCamera(threadPool* pool) const {
+        camera cam = calibrationCamera(pool);
+        cam.imageWidth = std::max(32, base.imageWidth / 4);
+        return cam;
+    }
+
+    // Band of rows through the image center at the full width and spp of the render being tuned, rendered as a whole image: the aspect ratio and vertical field of view are narrowed so the band keeps the pixels and rays it has in the full view
+    // Holds about as many samples as the tile calibration band, but at least one row
+    camera bandCamera(threadPool* pool) const {
+        camera cam = calibrationCamera(pool);
+        cam.samplesPerPixel = std::max(1, base.samplesPerPixel);
+        const int height = base.outputHeight();
+        const int rows = std::clamp(int(bandSamples() / (double(base.imageWidth) * cam.samplesPerPixel)), 1, height);
+        cam.aspectRatio = base.imageWidth / (rows + 0.5);
+        cam.vfov = 2 * std::atan(std::tan(degreesToRadians(base.vfov) / 2) * rows / height) * 180 / pi;
+        return cam;
+    }
+
+    // Center band in batched bounce mode, written to a discarding stream
+    double batchedSeconds(unsigned threads, int batchSize) {
+        return fastest(threads, [&](threadPool* pool) {
+            nullBuffer sink;
+            std::ostream discard(&sink);
+            camera cam = bandCamera(pool);
+            cam.batchedBounces = true;
+            cam.rayBatchSize = batchSize;
+            cam.output = &discard;
+            cam.render(world);
+        });
+    }
+
+    // Progressive render of the reduced image to 16 samples per pixel in passes of samplesPerPass
+    double progressiveSeconds(unsigned threads, int samplesPerPass) {
+        return fastest(threads, [&](threadPool* pool) {
+            nullBuffer sink;
+            std::ostream discard(&sink);
+            camera cam = reducedCamera(pool);
+            cam.samplesPerPixel = 16;
+            cam.samplesPerPass = samplesPerPass;
+            cam.output = &discard;
+            cam.renderProgressive(world, infinity);
+        });
+    }
+};
+
+// Searches thread count, tile size, ray batch size and samples per pass for world seen through base
+// Each knob is tuned in turn with the earlier ones fixed, using short calibration renders of the actual scene at reduced spp; progress goes to log when given
+template <typename World>
+tuningConfig autotune(const World& world, const camera& base, const autotuneOptions& options = autotuneOptions(), std::ostream* log = nullptr) {
+    return autotuner<World>(world, base, options, log).run();
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef BATCHJOBS_H
+#define BATCHJOBS_H
+
+#include "camera.h"
+#include "threadPool.h"
+
+// Libraries for reading job lists, writing images and formatted reports
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// One entry of a batch: a camera setup and the file its image goes to
+class renderJob {
+public:
+    std::string name;
+    std::string outputPath;
+    camera cam;
+};
+
+// Parses "x,y,z" into v; returns false if the text is not three comma separated numbers
+inline bool parseVec3(const std::string& text, vec3& v) {
+    std::istringstream in(text);
+    char comma1 = 0, comma2 = 0;
+    double x, y, z;
+    if (!(in >> x >> comma1 >> y >> comma2 >> z) || comma1 != ',' || comma2 != ',')
+        return false;
+    v = vec3(x, y, z);
+    return true;
+}
+
+// Reads a job list: one job per line as whitespace separated key=value pairs, '#' starts a comment
+// Keys: name, output, width, spp, depth, aspect, vfov, from, at, up (vectors as x,y,z), defocus, focus
+// Unspecified settings come from defaults; returns false and sets error on the first malformed line or job with a width or spp below 1
+inline bool parseJobList(std::istream& in, const camera& defaults, std::vector<renderJob>& jobs, std::string& error) {
+    std::string line;
+    for (int lineNumber = 1; std::getline(in, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string field;
+
+        renderJob job;
+        job.cam = defaults;
+        bool empty = true;
+        while (fields >> field) {
+            empty = false;
+            auto equals = field.find('=');
+            if (equals == std::string::npos) {
+                error = "line " + std::to_string(lineNumber) + ": expected key=value, got '" + field + "'";
+                return false;
+            }
+            auto key = field.substr(0, equals);
+            auto value = field.substr(equals + 1);
+
+            bool ok = true;
+            if (key == "name")          job.name = value;
+            else if (key == "output")   job.outputPath = value;
+            else if (key == "width")    job.cam.imageWidth = std::atoi(value.c_str());
+            else if (key == "spp")      job.cam.samplesPerPixel = std::atoi(value.c_str());
+            else if (key == "depth")    job.cam.maxDepth = std::atoi(value.c_str());
+            else if (key == "aspect")   job.cam.aspectRatio = std::atof(value.c_str());
+            else if (key == "vfov")     job.cam.vfov = std::atof(value.c_str());
+            else if (key == "defocus")  job.cam.defocusAngle = std::atof(value.c_str());
+            else if (key == "focus")    job.cam.focusDist = std::atof(value.c_str());
+            else if (key == "from")     ok = parseVec3(value, job.cam.lookFrom);
+            else if (key == "at")       ok = parseVec3(value, job.cam.lookAt);
+            else if (key == "up")       ok = parseVec3(value, job.cam.vup);
+            else {
+                error = "line " + std::to_string(lineNumber) + ": unknown key '" + key + "'";
+                return false;
+            }
+            if (!ok) {
+                error = "line " + std::to_string(lineNumber) + ": bad vector '" + value + "'";
+                return false;
+            }
+        }
+        if (empty)
+            continue;
+
+        if (job.outputPath.empty()) {
+            error = "line " + std::to_string(lineNumber) + ": missing output=";
+            return false;
+        }
+        // A zero or negative width or sample count (also what atoi makes of a value that is not a number) would render nothing or divide by zero
+        if (job.cam.imageWidth <= 0 || job.cam.samplesPerPixel <= 0) {
+            error = "line " + std::to_string(lineNumber) + ": width and spp must be positive";
+            return false;
+        }
+        if (job.name.empty())
+            job.name = job.outputPath;
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+// Timing of one finished job
+class jobTiming {
+public:
+    std::string name;
+    int width = 0;
+    int samplesPerPixel = 0;
+    renderStats stats;
+    bool written = false;
+};
+
+// Result of a batch: the one-time setup cost and the per-job timings
+class batchReport {
+public:
+    // Scene and acceleration structure build time, paid once for the whole batch
+    double setupSeconds = 0;
+    // Wall-clock time of running all jobs
+    double jobsSeconds = 0;
+    std::vector<jobTiming> jobs;
+
+    // Prints per-job timings and how the setup cost is amortized compared to one process per job
+    void print(std::ostream& out) const {
+        out << std::left << std::setw(24) << "job" << std::right << std::setw(8) << "width" << std::setw(8) << "spp"
+            << std::setw(12) << "seconds" << std::setw(14) << "rays/s" << '\n';
+        double jobSum = 0;
+        for (const auto& job : jobs) {
+            jobSum += job.stats.seconds;
+            out << std::left << std::setw(24) << job.name << std::right << std::setw(8) << job.width << std::setw(8) << job.samplesPerPixel
+                << std::setw(12) << std::fixed << std::setprecision(3) << job.stats.seconds
+                << std::setw(14) << std::setprecision(0) << job.stats.raysPerSecond()
+                << (job.written ? "" : "  (output failed)") << '\n';
+        }
+
+        auto count = double(jobs.empty() ? 1 : jobs.size());
+        double separate = count * setupSeconds + jobSum;
+        out << std::setprecision(3)
+            << "setup (scene + acceleration), once:   " << setupSeconds << " s\n"
+            << "jobs wall-clock:                      " << jobsSeconds << " s\n"
+            << "batch total:                          " << setupSeconds + jobsSeconds << " s\n"
+            << "amortized setup per job:              " << setupSeconds / count << " s\n"
+            << "one process per job would take about: " << separate << " s (" << count * setupSeconds << " s of it rebuilding the scene)\n";
+    }
+};
+
+// Renders every job against the already built world, writing each image to its output file
+// Back-to-back mode runs one job at a time with its scanlines spread over the pool; concurrent mode submits every job to the pool at once and their scanlines share the same workers
+template <typename World>
+batchReport runBatch(const World& world, std::vector<renderJob>& jobs, threadPool& pool, bool concurrent, double setupSeconds) {
+    batchReport report;
+    report.setupSeconds = setupSeconds;
+    report.jobs.resize(jobs.size());
+
+    auto runJob = [&](std::size_t index) {
+        auto& job = jobs[index];
+        std::ofstream file(job.outputPath, std::ios::binary);
+        job.cam.pool = &pool;
+        job.cam.output = &file;
+        job.cam.progressLog = nullptr;
+        job.cam.render(world);
+
+        auto& timing = report.jobs[index];
+        timing.name = job.name;
+        timing.width = job.cam.imageWidth;
+        timing.samplesPerPixel = job.cam.samplesPerPixel;
+        timing.stats = job.cam.stats;
+        timing.written = bool(file.flush());
+    };
+
+    stopwatch timer;
+    if (concurrent) {
+        std::vector<std::future<void>> pending;
+        for (std::size_t index = 0; index < jobs.size(); index++)
+            pending.push_back(pool.submit([&runJob, index] { runJob(index); }));
+        for (auto& job : pending)
+            job.get();
+    } else {
+        for (std::size_t index = 0; index < jobs.size(); index++)
+            runJob(index);
+    }
+    report.jobsSeconds = timer.seconds();
+    return report;
+}
+
+#endif
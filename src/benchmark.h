@@ -0,0 +1,1015 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "camera.h"
+#include "convergence.h"
+#include "environmentMap.h"
+#include "hittableList.h"
+#include "numa.h"
+#include "renderer.h"
+#include "sceneGenerator.h"
+#include "scenes.h"
+#include "texture.h"
+#include "uniformGrid.h"
+#include "vec3Reference.h"
+#include "wideBvh.h"
+
+// Libraries for stream redirection and formatted output
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stream buffer that discards data but simulates a slow destination (e.g. a network filesystem) by sleeping per write call and per byte
+class slowBuffer : public std::streambuf {
+public:
+    slowBuffer(std::chrono::microseconds latency, double bytesPerSecond) : latency(latency), bytesPerSecond(bytesPerSecond) {
+        setp(buffer, buffer + sizeof(buffer));
+    }
+    ~slowBuffer() override { sync(); }
+
+protected:
+    int overflow(int c) override {
+        sync();
+        if (c != traits_type::eof()) {
+            *pptr() = char(c);
+            pbump(1);
+        }
+        return c;
+    }
+    int sync() override {
+        auto bytes = pptr() - pbase();
+        if (bytes > 0) {
+            std::this_thread::sleep_for(latency + std::chrono::microseconds(long(1e6 * bytes / bytesPerSecond)));
+            setp(buffer, buffer + sizeof(buffer));
+        }
+        return 0;
+    }
+
+private:
+    char buffer[8192];
+    std::chrono::microseconds latency;
+    double bytesPerSecond;
+};
+
+// Redirects std::cout and std::clog to a null buffer for its lifetime so benchmark renders do not print the image
+class discardOutput {
+public:
+    discardOutput() : oldOut(std::cout.rdbuf(&sink)), oldLog(std::clog.rdbuf(&sink)) {}
+    ~discardOutput() {
+        std::cout.rdbuf(oldOut);
+        std::clog.rdbuf(oldLog);
+    }
+
+private:
+    nullBuffer sink;
+    std::streambuf* oldOut;
+    std::streambuf* oldLog;
+};
+
+// Small, low sample count version of the final render camera used by the benchmarks
+inline camera benchmarkCamera() {
+    camera cam = finalRenderCamera();
+    cam.imageWidth = 160;
+    cam.samplesPerPixel = 4;
+    cam.maxDepth = 16;
+    return cam;
+}
+
+// Prints one row of a throughput table
+inline void printRenderStats(const std::string& label, const renderStats& stats) {
+    std::cout << std::left << std::setw(28) << label << std::right
+              << std::setw(12) << stats.rays()
+              << std::setw(10) << std::fixed << std::setprecision(3) << stats.seconds
+              << std::setw(14) << std::setprecision(0) << stats.raysPerSecond();
+    if (stats.cacheMissesAvailable)
+        std::cout << std::setw(16) << stats.cacheMisses;
+    else
+        std::cout << std::setw(16) << "n/a";
+    std::cout << '\n';
+}
+
+// Compares recursive per-sample tracing against coherence-sorted batched bounces on scaled versions of the final scene
+inline void benchmarkRayReordering() {
+    std::cout << std::left << std::setw(28) << "scene / mode" << std::right
+              << std::setw(12) << "rays" << std::setw(10) << "seconds"
+              << std::setw(14) << "rays/s" << std::setw(16) << "cache misses" << '\n';
+
+    for (int halfExtent : {11, 22, 44}) {
+        seedRandom(1);
+        auto world = randomSphereField(halfExtent);
+        auto label = std::to_string(world.objects.size()) + " spheres";
+
+        for (bool batched : {false, true}) {
+            camera cam = benchmarkCamera();
+            cam.batchedBounces = batched;
+            {
+                discardOutput quiet;
+                cam.render(world);
+            }
+            printRenderStats(label + (batched ? " batched" : " recursive"), cam.stats);
+        }
+    }
+}
+
+// Compares the dynamic hittableList path (virtual hit and scatter through shared_ptr) with the compile-time staticScene path on the same scenes
+inline void benchmarkStaticScene() {
+    std::cout << std::left << std::setw(28) << "scene / path" << std::right
+              << std::setw(12) << "rays" << std::setw(10) << "seconds"
+              << std::setw(14) << "rays/s" << std::setw(16) << "cache misses" << '\n';
+
+    for (int halfExtent : {11, 22}) {
+        seedRandom(1);
+        auto dynamicWorld = randomSphereField(halfExtent);
+        seedRandom(1);
+        auto staticWorld = randomSphereFieldStatic(halfExtent);
+        auto label = std::to_string(staticWorld.size()) + " spheres";
+
+        // Both renders start from the same seed so they trace the same paths
+        camera cam = benchmarkCamera();
+        seedRandom(2);
+        {
+            discardOutput quiet;
+            cam.render(dynamicWorld);
+        }
+        printRenderStats(label + " dynamic", cam.stats);
+
+        seedRandom(2);
+        {
+            discardOutput quiet;
+            cam.render(staticWorld);
+        }
+        printRenderStats(label + " static", cam.stats);
+    }
+}
+
+// Shows how much of the output cost the background writer hides: tracing alone, writing alone (synchronous writeColor) and the pipelined render, all into a simulated slow stream
+inline void benchmarkOutputPipeline() {
+    seedRandom(1);
+    auto world = randomSphereFieldStatic(11);
+    camera cam = benchmarkCamera();
+    cam.imageWidth = 480;
+    cam.samplesPerPixel = 1;
+    cam.maxDepth = 8;
+
+    // Tracing cost with a free output stream
+    {
+        discardOutput quiet;
+        cam.render(world);
+    }
+    double traceSeconds = cam.stats.seconds;
+    int height = int(cam.imageWidth / cam.aspectRatio);
+
+    // Synchronous output cost of the same image through writeColor into a 1 ms latency, 2 MB/s stream
+    stopwatch timer;
+    {
+        slowBuffer slow(std::chrono::microseconds(1000), 2e6);
+        std::ostream slowOut(&slow);
+        slowOut << "P3\n" << cam.imageWidth << ' ' << height << "\n255\n";
+        for (int p = 0; p < cam.imageWidth * height; p++)
+            writeColor(slowOut, color(0.5, 0.5, 0.5));
+    }
+    double writeSeconds = timer.seconds();
+
+    // Pipelined render into the same slow stream
+    {
+        discardOutput quiet;
+        slowBuffer slow(std::chrono::microseconds(1000), 2e6);
+        auto old = std::cout.rdbuf(&slow);
+        cam.render(world);
+        std::cout.rdbuf(old);
+    }
+    double pipelinedSeconds = cam.stats.seconds;
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "trace only              " << traceSeconds << " s\n"
+              << "write only (sync)       " << writeSeconds << " s\n"
+              << "trace + write (serial)  " << traceSeconds + writeSeconds << " s\n"
+              << "pipelined render        " << pipelinedSeconds << " s\n";
+}
+
+// Benchmarks the uniform grid against the plain hittableList on scaled versions of the final scene: grid build time, memory and traversal throughput
+// The list is only timed up to a few thousand spheres since its cost grows linearly with the scene
+inline void benchmarkUniformGrid() {
+    std::cout << std::left << std::setw(10) << "spheres" << std::right
+              << std::setw(16) << "grid cells" << std::setw(10) << "outside" << std::setw(12) << "grid KiB"
+              << std::setw(12) << "build ms" << std::setw(14) << "list rays/s" << std::setw(14) << "grid rays/s" << '\n';
+
+    for (int halfExtent : {11, 22, 44, 88, 176}) {
+        seedRandom(1);
+        auto world = randomSphereField(halfExtent);
+
+        stopwatch buildTimer;
+        uniformGrid grid(world);
+        double buildSeconds = buildTimer.seconds();
+
+        camera cam = benchmarkCamera();
+        std::string listRate = "skipped";
+        if (halfExtent <= 44) {
+            seedRandom(2);
+            discardOutput quiet;
+            cam.render(world);
+            listRate = std::to_string(long(cam.stats.raysPerSecond()));
+        }
+        seedRandom(2);
+        {
+            discardOutput quiet;
+            cam.render(grid);
+        }
+
+        std::cout << std::left << std::setw(10) << world.objects.size() << std::right
+                  << std::setw(16) << (std::to_string(grid.resolution(0)) + "x" + std::to_string(grid.resolution(1)) + "x" + std::to_string(grid.resolution(2)))
+                  << std::setw(10) << grid.outOfGridCount()
+                  << std::setw(12) << grid.memoryBytes() / 1024
+                  << std::setw(12) << std::fixed << std::setprecision(2) << buildSeconds * 1000
+                  << std::setw(14) << listRate
+                  << std::setw(14) << long(cam.stats.raysPerSecond()) << '\n';
+    }
+}
+
+// Benchmarks the compressed 4-wide BVH on scaled versions of the final scene: build time, node memory per primitive and traversal throughput
+inline void benchmarkWideBvh() {
+    std::cout << std::left << std::setw(10) << "spheres" << std::right
+              << std::setw(10) << "nodes" << std::setw(14) << "node B/prim" << std::setw(14) << "total B/prim"
+              << std::setw(12) << "build s" << std::setw(14) << "rays/s" << '\n';
+
+    double nodeBytesPerPrimitive = 0, totalBytesPerPrimitive = 0;
+    for (int halfExtent : {11, 44, 176, 700}) {
+        seedRandom(1);
+        auto world = randomSphereField(halfExtent);
+
+        stopwatch buildTimer;
+        wideBvh bvh(world);
+        double buildSeconds = buildTimer.seconds();
+
+        camera cam = benchmarkCamera();
+        seedRandom(2);
+        {
+            discardOutput quiet;
+            cam.render(bvh);
+        }
+
+        nodeBytesPerPrimitive = double(bvh.nodeBytes()) / bvh.primitiveCount();
+        totalBytesPerPrimitive = double(bvh.memoryBytes()) / bvh.primitiveCount();
+        std::cout << std::left << std::setw(10) << bvh.primitiveCount() << std::right
+                  << std::setw(10) << bvh.nodeCount()
+                  << std::setw(14) << std::fixed << std::setprecision(2) << nodeBytesPerPrimitive
+                  << std::setw(14) << totalBytesPerPrimitive
+                  << std::setw(12) << std::setprecision(3) << buildSeconds
+                  << std::setw(14) << long(cam.stats.raysPerSecond()) << '\n';
+    }
+
+    // Linear projection of the hierarchy's own memory (nodes plus primitive references, not the spheres themselves)
+    std::cout << "projected hierarchy memory for 10^7 spheres: " << std::setprecision(0)
+              << totalBytesPerPrimitive * 1e7 / (1024 * 1024) << " MiB (nodes " << nodeBytesPerPrimitive * 1e7 / (1024 * 1024) << " MiB)\n";
+}
+
+// Scaling curves for plotting: generated scenes from 10^2 to 10^maxExponent spheres in every distribution, traced through the uniform grid and the wide BVH (and the plain list up to 10^4)
+// Prints CSV: distribution, spheres, structure, build seconds, scene MiB (heap growth while generating), structure MiB, rays per second
+inline void benchmarkScaling(int maxExponent) {
+    std::cout << "distribution,spheres,structure,build_s,scene_mib,structure_mib,rays_per_s\n";
+    const char* names[] = { "uniform", "clustered", "nested" };
+    for (int d = 0; d < 3; d++) {
+        for (int exponent = 2; exponent <= maxExponent; exponent++) {
+            sceneGeneratorConfig config;
+            config.sphereCount = std::size_t(std::pow(10.0, exponent));
+            parseDistribution(names[d], config.distribution);
+            // Large scenes share a material palette so the sphere data dominates memory
+            config.materialPalette = exponent >= 6 ? 256 : 0;
+
+            auto before = heapBytesInUse();
+            auto world = generateSphereFieldList(config);
+            double sceneMiB = double(heapBytesInUse() - before) / (1024 * 1024);
+
+            auto row = [&](const char* structure, double buildSeconds, std::size_t bytes, const renderStats& stats) {
+                std::cout << names[d] << ',' << config.sphereCount << ',' << structure << ','
+                          << std::fixed << std::setprecision(4) << buildSeconds << ',' << std::setprecision(2) << sceneMiB << ','
+                          << double(bytes) / (1024 * 1024) << ',' << std::setprecision(0) << stats.raysPerSecond() << '\n';
+            };
+            auto trace = [&](const auto& accel) {
+                camera cam = benchmarkCamera();
+                cam.samplesPerPixel = 2;
+                seedRandom(2);
+                discardOutput quiet;
+                cam.render(accel);
+                return cam.stats;
+            };
+
+            if (exponent <= 4)
+                row("list", 0, world.objects.size() * sizeof(shared_ptr<hittable>), trace(world));
+
+            stopwatch timer;
+            uniformGrid grid(world);
+            double gridBuild = timer.seconds();
+            row("grid", gridBuild, grid.memoryBytes(), trace(grid));
+
+            timer.reset();
+            wideBvh bvh(world);
+            double bvhBuild = timer.seconds();
+            row("widebvh", bvhBuild, bvh.memoryBytes(), trace(bvh));
+        }
+    }
+}
+
+// Measures how quickly asynchronous renders stop when they are cancelled at various points, and what a partial snapshot costs
+// Latency is the time from renderTask::cancel until every render thread has returned
+inline void benchmarkCancellation() {
+    renderScene scene;
+    scene.addRandomSphereField(11);
+    renderSettings settings;
+    settings.imageWidth = 400;
+    settings.samplesPerPixel = 64;
+    renderer tracer;
+    std::vector<float> preview(std::size_t(settings.imageWidth) * settings.imageHeight() * 4);
+
+    std::cout << "threads: " << tracer.threadCount() << ", " << settings.imageWidth << 'x' << settings.imageHeight()
+              << ", " << settings.samplesPerPixel << " spp\n";
+    std::cout << std::setw(10) << "cancel ms" << std::setw(10) << "progress" << std::setw(14) << "snapshot ms"
+              << std::setw(16) << "mean latency ms" << std::setw(15) << "max latency ms" << '\n';
+    for (int delayMs : {5, 20, 100, 500}) {
+        const int repeats = 5;
+        double latencySum = 0, latencyMax = 0, progressSum = 0, snapshotSum = 0;
+        for (int repeat = 0; repeat < repeats; repeat++) {
+            settings.seed = repeat + 1;
+            auto task = tracer.renderAsync(scene, settings);
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+
+            stopwatch snapshotTimer;
+            task.snapshot(preview.data());
+            snapshotSum += snapshotTimer.seconds();
+            progressSum += task.progress();
+
+            task.cancel();
+            auto summary = task.wait();
+            latencySum += summary.cancelLatency;
+            latencyMax = std::max(latencyMax, summary.cancelLatency);
+        }
+        std::cout << std::fixed << std::setw(10) << delayMs << std::setw(10) << std::setprecision(3) << progressSum / repeats
+                  << std::setw(14) << 1e3 * snapshotSum / repeats << std::setw(16) << 1e3 * latencySum / repeats
+                  << std::setw(15) << 1e3 * latencyMax << '\n';
+    }
+}
+
+// Closest hit through a list the way traversal worked before hit attributes were deferred: every closer candidate gets its point, normal and material computed and the whole record copied
+inline bool eagerClosestHit(const hittableList& list, const ray& r, interval rayT, hitRecord& rec, std::uint64_t& candidates) {
+    hitRecord tempRec;
+    bool hitAnything = false;
+    auto closestSoFar = rayT.max;
+    for (const auto& object : list.objects) {
+        if (object->intersect(r, interval(rayT.min, closestSoFar), tempRec)) {
+            object->finalizeHit(r, tempRec);
+            candidates++;
+            hitAnything = true;
+            closestSoFar = tempRec.t;
+            rec = tempRec;
+        }
+    }
+    return hitAnything;
+}
+
+// Deep field of overlapping spheres along -z: layers unit spheres one behind the other, each sphere overlapping its neighbours, every ray crossing all of them
+// backToFront lists the farthest sphere first, so every sphere a ray meets is closer than the last (the worst case of eager attribute computation); otherwise the order is random
+inline hittableList overlappingSphereColumn(int layers, bool backToFront) {
+    auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    std::vector<shared_ptr<hittable>> spheres;
+    for (int layer = 0; layer < layers; layer++)
+        spheres.push_back(make_shared<sphere>(point3(0.2 * (randomDouble() - 0.5), 0.2 * (randomDouble() - 0.5), -2.0 - 0.5 * layer), 1.0, mat));
+    if (backToFront)
+        std::reverse(spheres.begin(), spheres.end());
+    else
+        for (std::size_t i = spheres.size(); i > 1; i--)
+            std::swap(spheres[i - 1], spheres[std::size_t(randomDouble() * i)]);
+    hittableList list;
+    for (auto& object : spheres)
+        list.add(object);
+    return list;
+}
+
+// Compares eager hit attributes (computed and copied for every closer candidate) with deferred ones (traversal tracks t and the primitive, finalizeHit runs once per ray)
+// Rays go down the columns of overlapping spheres from overlappingSphereColumn; both paths must find the same closest hits
+inline bool benchmarkDeferredHits() {
+    std::cout << std::left << std::setw(8) << "layers" << std::setw(14) << "order" << std::right << std::setw(16) << "candidates/ray"
+              << std::setw(14) << "eager ns" << std::setw(14) << "deferred ns" << std::setw(10) << "speedup" << '\n';
+    bool identical = true;
+    for (int layers : {4, 16, 64, 256}) {
+        for (bool backToFront : {false, true}) {
+            seedRandom(layers);
+            auto list = overlappingSphereColumn(layers, backToFront);
+
+            // Rays from in front of the column, aimed at it with a small spread
+            const int rayCount = std::max(2000, 400000 / layers);
+            std::vector<ray> rays;
+            for (int k = 0; k < rayCount; k++)
+                rays.push_back(ray(point3(0, 0, 0), vec3(0.3 * (randomDouble() - 0.5), 0.3 * (randomDouble() - 0.5), -1)));
+
+            std::uint64_t candidates = 0;
+            double checksumEager = 0, checksumDeferred = 0;
+            double eagerSeconds = infinity, deferredSeconds = infinity;
+            for (int repetition = 0; repetition < 5; repetition++) {
+                std::uint64_t counted = 0;
+                double sum = 0;
+                stopwatch eagerTimer;
+                for (const auto& r : rays) {
+                    hitRecord rec;
+                    if (eagerClosestHit(list, r, interval(0.001, infinity), rec, counted))
+                        sum += rec.t + rec.normal.x();
+                }
+                eagerSeconds = std::min(eagerSeconds, eagerTimer.seconds());
+                candidates = counted;
+                checksumEager = sum;
+
+                sum = 0;
+                stopwatch deferredTimer;
+                for (const auto& r : rays) {
+                    hitRecord rec;
+                    if (list.hit(r, interval(0.001, infinity), rec))
+                        sum += rec.t + rec.normal.x();
+                }
+                deferredSeconds = std::min(deferredSeconds, deferredTimer.seconds());
+                checksumDeferred = sum;
+            }
+            identical = identical && checksumEager == checksumDeferred;
+
+            std::cout << std::left << std::setw(8) << layers << std::setw(14) << (backToFront ? "back-to-front" : "random")
+                      << std::right << std::fixed << std::setprecision(2) << std::setw(16) << double(candidates) / rayCount
+                      << std::setprecision(1) << std::setw(14) << 1e9 * eagerSeconds / rayCount << std::setw(14) << 1e9 * deferredSeconds / rayCount
+                      << std::setprecision(2) << std::setw(9) << eagerSeconds / deferredSeconds << "x\n";
+        }
+    }
+
+    // End to end: the same scene rendered through the BVH, which now defers attributes as well
+    seedRandom(1);
+    auto deep = overlappingSphereColumn(256, false);
+    wideBvh bvh(deep);
+    camera cam = benchmarkCamera();
+    cam.lookFrom = point3(0, 0, 0);
+    cam.lookAt = point3(0, 0, -1);
+    cam.vfov = 40;
+    cam.defocusAngle = 0;
+    cam.focusDist = 1;
+    {
+        discardOutput quiet;
+        cam.render(bvh);
+    }
+    std::cout << "256 layers through the wide BVH: " << std::setprecision(0) << cam.stats.raysPerSecond() << " rays/s\n"
+              << (identical ? "eager and deferred hits identical" : "EAGER AND DEFERRED HITS DIFFER") << '\n';
+    return identical;
+}
+
+// Equirectangular sky for benchmarkEnvironmentMap: a dim gradient and a small sun that carries most of the light
+// BSDF sampling rarely hits the sun, which is the case environment importance sampling is meant for; larger suns are dimmer so the light they cast stays the same
+inline floatImage syntheticSky(int width, int height, double sunRadiusDegrees = 0.6) {
+    floatImage sky(width, height);
+    for (int j = 0; j < height; j++) {
+        double elevation = 1.0 - 2.0 * (j + 0.5) / height;
+        color base = elevation > 0 ? (1 - elevation) * color(0.25, 0.25, 0.3) + elevation * color(0.1, 0.15, 0.35) : color(0.05, 0.04, 0.03);
+        for (int i = 0; i < width; i++)
+            sky.set(i, j, base);
+    }
+    // 40 degrees above the horizon and to the right of the default view direction
+    const vec3 sunDirection = unitVector(vec3(0.6, 0.64, -0.4));
+    const double sunScale = (0.6 * 0.6) / (sunRadiusDegrees * sunRadiusDegrees);
+    for (int j = 0; j < height; j++)
+        for (int i = 0; i < width; i++) {
+            double theta = pi * (j + 0.5) / height, phi = 2 * pi * (i + 0.5) / width;
+            vec3 direction(std::sin(theta) * std::sin(phi), std::cos(theta), std::sin(theta) * std::cos(phi));
+            if (dot(direction, sunDirection) > std::cos(degreesToRadians(sunRadiusDegrees)))
+                sky.set(i, j, sunScale * color(20000, 18000, 15000));
+        }
+    return sky;
+}
+
+// Importance-sampled environment lighting against BSDF sampling alone at equal samples per pixel, on the material spheres under syntheticSky
+// Also times reading the sky back from an .hdr file and building the sampling tables on one thread and on all of them
+inline void benchmarkEnvironmentMap() {
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    threadPool pool(hardwareThreads - 1);
+
+    auto path = (std::filesystem::temp_directory_path() / "weekendfun-benchmark-sky.hdr").string();
+    if (!writeRadianceHdr(path, syntheticSky(4096, 2048))) {
+        std::cout << "cannot write " << path << '\n';
+        return;
+    }
+    environmentMap sky;
+    std::string error;
+    for (threadPool* loadPool : { (threadPool*)nullptr, &pool }) {
+        if (!sky.load(path, error, loadPool)) {
+            std::cout << error << '\n';
+            return;
+        }
+        std::cout << "4096x2048 .hdr on " << (loadPool ? hardwareThreads : 1u) << " thread(s): load " << std::fixed << std::setprecision(1)
+                  << 1e3 * sky.loadSeconds << " ms, sampling tables " << 1e3 * sky.buildSeconds << " ms\n";
+    }
+    std::remove(path.c_str());
+
+    // The material spheres with every surface diffuse: light sampling only connects at diffuse hits, and paths over the fuzzy metal or glass would find the sun by BSDF sampling either way
+    hittableList spheres;
+    spheres.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, make_shared<lambertian>(color(0.8, 0.8, 0.0))));
+    spheres.add(make_shared<sphere>(point3(0.0, 0.0, -1.2), 0.5, make_shared<lambertian>(color(0.1, 0.2, 0.5))));
+    spheres.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, make_shared<lambertian>(color(0.7, 0.7, 0.7))));
+    spheres.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, make_shared<lambertian>(color(0.8, 0.6, 0.2))));
+    wideBvh world(spheres);
+    camera base = materialSpheresCamera();
+    base.imageWidth = 160;
+    base.environment = &sky;
+
+    double seconds = 0;
+    floatImage reference = renderLinear(world, base, 512, referenceSeed, &pool, seconds);
+    std::cout << "reference: 512 spp with environment sampling, " << std::setprecision(1) << seconds << " s\n";
+
+    std::cout << std::left << std::setw(6) << "spp" << std::right << std::setw(16) << "bsdf relMSE" << std::setw(16) << "mis relMSE"
+              << std::setw(12) << "bsdf s" << std::setw(12) << "mis s" << std::setw(12) << "mse ratio" << '\n';
+    for (int spp : {1, 4, 16, 64}) {
+        camera bsdfOnly = base;
+        bsdfOnly.environmentSampling = false;
+        double bsdfSeconds = 0, misSeconds = 0;
+        auto bsdfError = compareImages(renderLinear(world, bsdfOnly, spp, 1, &pool, bsdfSeconds), reference);
+        auto misError = compareImages(renderLinear(world, base, spp, 1, &pool, misSeconds), reference);
+        std::cout << std::left << std::setw(6) << spp << std::right << std::setprecision(5) << std::setw(16) << bsdfError.relMse
+                  << std::setw(16) << misError.relMse << std::setprecision(3) << std::setw(12) << bsdfSeconds << std::setw(12) << misSeconds
+                  << std::setprecision(1) << std::setw(11) << bsdfError.relMse / std::max(1e-300, misError.relMse) << "x\n";
+    }
+}
+
+// Current image of a progressive render as a linear float image
+inline floatImage progressiveImage(const camera& cam) {
+    const auto& accumulation = cam.currentImage();
+    floatImage image(accumulation.imageWidth(), accumulation.imageHeight());
+    for (int j = 0; j < image.height; j++)
+        for (int i = 0; i < image.width; i++)
+            image.set(i, j, accumulation.average(i, j));
+    return image;
+}
+
+// Equal-time error of guided against plain sampling: both render progressively for the same wall-clock budgets and are compared with a high sample count reference
+// "final" is the main render's scene under the sky gradient; "caustics" is the material spheres with a diffuse sphere in place of the metal one, under a syntheticSky with a 3 degree sun
+// There the ground receives sunlight focused through the glass sphere, which environment sampling cannot find; the metal sphere is left out because its reflections of the sun are not guided and would dominate the error
+inline void benchmarkPathGuiding() {
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    threadPool pool(hardwareThreads - 1);
+    environmentMap sun;
+    sun.setImage(syntheticSky(1024, 512, 3.0), &pool);
+
+    for (const std::string sceneName : { "final", "caustics" }) {
+        const bool caustics = sceneName == "caustics";
+        hittableList spheres;
+        if (caustics) {
+            spheres.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, make_shared<lambertian>(color(0.8, 0.8, 0.0))));
+            spheres.add(make_shared<sphere>(point3(0.0, 0.0, -1.2), 0.5, make_shared<lambertian>(color(0.1, 0.2, 0.5))));
+            spheres.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, make_shared<dielectric>(1.5)));
+            spheres.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, make_shared<lambertian>(color(0.8, 0.6, 0.2))));
+        } else {
+            spheres = randomSphereField(11);
+        }
+        wideBvh world(spheres);
+        camera base = caustics ? materialSpheresCamera() : finalRenderCamera();
+        base.imageWidth = 96;
+        base.maxDepth = 16;
+        if (caustics)
+            base.environment = &sun;
+
+        // The reference takes several times the samples of the longest budget, so its own noise stays small next to the candidates'
+        double seconds = 0;
+        floatImage reference = renderLinear(world, base, 4096, referenceSeed, &pool, seconds);
+        std::cout << sceneName << ": reference 4096 spp in " << std::fixed << std::setprecision(1) << seconds << " s\n";
+        std::cout << std::left << std::setw(10) << "budget s" << std::right << std::setw(8) << "spp" << std::setw(12) << "relMSE" << std::setw(10) << "FLIP"
+                  << std::setw(14) << "guided spp" << std::setw(12) << "relMSE" << std::setw(10) << "FLIP" << std::setw(10) << "regions"
+                  << std::setw(8) << "MiB" << '\n';
+        for (double budget : { 1.0, 4.0, 16.0 }) {
+            camera plain = base;
+            plain.pool = &pool;
+            plain.samplesPerPixel = 1 << 20;
+            // Both sample the environment directly; the guided render also learns where the rest of the light comes from
+            camera guided = plain;
+            pathGuide guide(guideBounds(spheres));
+            guided.guide = &guide;
+
+            imageError plainError, guidedError;
+            int plainSpp = 0, guidedSpp = 0;
+            {
+                discardOutput quiet;
+                plainSpp = plain.renderProgressive(world, budget).samplesPerPixel;
+                plainError = compareImages(progressiveImage(plain), reference);
+                guidedSpp = guided.renderProgressive(world, budget).samplesPerPixel;
+                guidedError = compareImages(progressiveImage(guided), reference);
+            }
+            std::cout << std::left << std::setw(10) << std::setprecision(1) << budget << std::right << std::setw(8) << plainSpp
+                      << std::setprecision(5) << std::setw(12) << plainError.relMse << std::setprecision(4) << std::setw(10) << plainError.flip
+                      << std::setw(14) << guidedSpp << std::setprecision(5) << std::setw(12) << guidedError.relMse << std::setprecision(4)
+                      << std::setw(10) << guidedError.flip << std::setw(10) << guide.regionCount() << std::setprecision(2) << std::setw(8)
+                      << guide.memoryBytes() / 1048576.0 << '\n';
+        }
+    }
+}
+
+// Orbits the camera around the final scene half a degree per frame and renders every frame as a reprojected preview
+// The orbit runs well past the frame where the reused pixels' history reaches historyLimit, so the table shows where the preview's error settles
+// Every few frames it also renders the pose from scratch and reports relMSE against a 256 spp reference for the preview, a render with the preview's average samples per pixel and one with the full sample count
+inline void benchmarkPreview() {
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    threadPool pool(hardwareThreads - 1);
+    wideBvh world(randomSphereField(11));
+    camera base = benchmarkCamera();
+    base.samplesPerPixel = 16;
+    // The reprojection treats the lens as a pinhole
+    base.defocusAngle = 0;
+    base.pool = &pool;
+
+    previewHistory history;
+    std::cout << std::left << std::setw(7) << "frame" << std::right << std::setw(9) << "reused" << std::setw(10) << "new spp" << std::setw(12) << "preview s"
+              << std::setw(14) << "preview err" << std::setw(12) << "equal s" << std::setw(12) << "equal err" << std::setw(11) << "full s" << std::setw(12) << "full err" << '\n';
+    // 16 samples for the first frame and one per reused pixel after that fill a history in about historyLimit - 16 frames
+    const int frames = 2 * history.historyLimit;
+    for (int frame = 0; frame < frames; frame++) {
+        camera cam = base;
+        const double angle = degreesToRadians(0.5 * frame);
+        cam.lookFrom = point3(13 * std::cos(angle) - 3 * std::sin(angle), 2, 13 * std::sin(angle) + 3 * std::cos(angle));
+
+        previewReport report = cam.renderPreview(world, history);
+        if (!(frame < 4 || frame % 16 == 0 || frame == frames - 1))
+            continue;
+        floatImage preview = history.image();
+        double seconds = 0;
+        floatImage reference = renderLinear(world, cam, 256, referenceSeed, &pool, seconds);
+        const int equalSpp = std::max(1, int(std::lround(double(report.newSamples) / report.pixels())));
+        double equalSeconds = 0, fullSeconds = 0;
+        floatImage equal = renderLinear(world, cam, equalSpp, 1, &pool, equalSeconds);
+        floatImage full = renderLinear(world, cam, base.samplesPerPixel, 1, &pool, fullSeconds);
+        std::cout << std::left << std::setw(7) << frame << std::right << std::fixed << std::setprecision(1) << std::setw(8)
+                  << 100.0 * report.reusedPixels / report.pixels() << '%' << std::setprecision(2) << std::setw(10) << double(report.newSamples) / report.pixels()
+                  << std::setprecision(3) << std::setw(12) << report.seconds << std::setprecision(5) << std::setw(14) << compareImages(preview, reference).relMse
+                  << std::setprecision(3) << std::setw(12) << equalSeconds << std::setprecision(5) << std::setw(12) << compareImages(equal, reference).relMse
+                  << std::setprecision(3) << std::setw(11) << fullSeconds << std::setprecision(5) << std::setw(12) << compareImages(full, reference).relMse << '\n';
+    }
+}
+
+// Share of the reference's edge contrast that image keeps: the luminance gradients of image projected onto those of reference, sum(g . gRef) / sum(gRef . gRef)
+// Noise in image is uncorrelated with the reference's edges and averages out, so this measures blur rather than noise; 1 is as sharp as the reference, below 1 blurrier
+inline double edgeContrast(const floatImage& image, const floatImage& reference) {
+    auto luminance = [](const floatImage& im, int i, int j) {
+        color c = im.at(i, j);
+        return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+    };
+    double projected = 0, energy = 0;
+    for (int j = 0; j + 1 < reference.height; j++) {
+        for (int i = 0; i + 1 < reference.width; i++) {
+            double rx = luminance(reference, i + 1, j) - luminance(reference, i, j), ry = luminance(reference, i, j + 1) - luminance(reference, i, j);
+            double gx = luminance(image, i + 1, j) - luminance(image, i, j), gy = luminance(image, i, j + 1) - luminance(image, i, j);
+            projected += gx * rx + gy * ry;
+            energy += rx * rx + ry * ry;
+        }
+    }
+    return energy > 0 ? projected / energy : 1.0;
+}
+
+// Renders the final scene with every reconstruction filter at a few sample counts and compares each with one common reference, a 1024 spp box render (the exact pixel averages)
+// relMSE is the whole error, the noise a filter removes plus the blur it adds; edge contrast shows the blur alone, so it tells which filters trade sharpness for their lower noise
+inline void benchmarkFilters() {
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    threadPool pool(hardwareThreads - 1);
+    wideBvh world(randomSphereField(11));
+    camera base = benchmarkCamera();
+
+    double seconds = 0;
+    floatImage reference = renderLinear(world, base, 1024, referenceSeed, &pool, seconds);
+    std::cout << "reference: box filter, 1024 spp, " << std::fixed << std::setprecision(1) << seconds << " s\n";
+    std::cout << std::left << std::setw(18) << "filter" << std::right << std::setw(8) << "radius" << std::setw(6) << "spp" << std::setw(12) << "seconds"
+              << std::setw(12) << "vs box" << std::setw(14) << "relMSE" << std::setw(16) << "edge contrast" << '\n';
+    std::vector<double> boxSeconds;
+    for (const char* name : { "box", "gaussian", "mitchell", "blackman-harris" }) {
+        filterType type = filterType::box;
+        parseFilterType(name, type);
+        camera cam = base;
+        cam.filter = reconstructionFilter(type);
+        int row = 0;
+        for (int spp : {4, 16, 64}) {
+            floatImage image = renderLinear(world, cam, spp, 1, &pool, seconds);
+            if (type == filterType::box)
+                boxSeconds.push_back(seconds);
+            std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(1) << std::setw(8) << cam.filter.extent()
+                      << std::setw(6) << spp << std::setprecision(3) << std::setw(12) << seconds << std::setprecision(2) << std::setw(11)
+                      << seconds / boxSeconds[row++] << 'x' << std::setprecision(5) << std::setw(14) << compareImages(image, reference).relMse
+                      << std::setprecision(3) << std::setw(16) << edgeContrast(image, reference) << '\n';
+        }
+    }
+}
+
+// Renders spheres that each carry their own 1024x1024 texture (about 70 MB of tiles in total) through texture caches of decreasing budget, with and without footprint filtering
+// Reports throughput, cache hit rate, tiles read from disk, resident memory and lookup latency; the smallest budget holds only a few percent of the textures
+inline void benchmarkTextureCache() {
+    const int textureCount = 16, size = 1024;
+    std::vector<std::string> paths;
+    stopwatch writeTimer;
+    for (int t = 0; t < textureCount; t++) {
+        // Checkers of a texture's own two colors with fine stripes, so the finest level differs visibly from the coarse ones
+        floatImage image(size, size);
+        color a(0.2 + 0.6 * ((t * 37) % 11) / 10.0, 0.2 + 0.6 * ((t * 53) % 7) / 6.0, 0.2 + 0.6 * ((t * 71) % 5) / 4.0);
+        color b = color(1, 1, 1) - a;
+        for (int j = 0; j < size; j++)
+            for (int i = 0; i < size; i++)
+                image.set(i, j, (((i / 64) + (j / 64)) % 2 ? a : b) * (0.75 + 0.25 * std::sin(i * 0.9)));
+        paths.push_back((std::filesystem::temp_directory_path() / ("weekendfun-benchmark-texture" + std::to_string(t) + ".wtex")).string());
+        std::string error;
+        if (!writeTiledTexture(paths.back(), image, 64, error)) {
+            std::cout << error << '\n';
+            return;
+        }
+    }
+    std::uintmax_t fileBytes = 0;
+    for (const auto& path : paths)
+        fileBytes += std::filesystem::file_size(path);
+    std::cout << textureCount << " textures " << size << 'x' << size << ", " << std::fixed << std::setprecision(1) << fileBytes / 1048576.0
+              << " MiB of tiles written in " << writeTimer.seconds() << " s\n";
+
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    threadPool pool(hardwareThreads - 1);
+    std::cout << std::left << std::setw(10) << "budget" << std::setw(8) << "mips" << std::right << std::setw(14) << "rays/s" << std::setw(12) << "lookups"
+              << std::setw(10) << "hit %" << std::setw(12) << "tiles read" << std::setw(12) << "evicted" << std::setw(14) << "peak MiB" << std::setw(12) << "ns/lookup" << '\n';
+    for (auto [budgetMiB, filtering] : { std::pair(2.0, true), std::pair(8.0, true), std::pair(128.0, true), std::pair(8.0, false), std::pair(128.0, false) }) {
+        textureCache cache(std::size_t(budgetMiB * 1048576.0));
+        cache.mipFiltering = filtering;
+        hittableList spheres;
+        std::string error;
+        auto textured = [&](int t, double repeat) { return make_shared<imageTexture>(cache, cache.open(paths[t], error), repeat); };
+        spheres.add(make_shared<sphere>(point3(0,-1000,0), 1000, make_shared<lambertian>(textured(0, 400))));
+        for (int t = 1; t < textureCount; t++) {
+            point3 center(-7.5 + (t % 5) * 3.5, 1, -3 + (t / 5) * 3);
+            if (t % 4 == 0)
+                spheres.add(make_shared<sphere>(center, 1, make_shared<metal>(textured(t, 2), 0.2)));
+            else
+                spheres.add(make_shared<sphere>(center, 1, make_shared<lambertian>(textured(t, 2))));
+        }
+        wideBvh world(spheres);
+        camera cam = benchmarkCamera();
+        cam.imageWidth = 320;
+        cam.pool = &pool;
+
+        cam.renderTiles(world, 32, nullptr, 0, [](const imageTile&) {});
+        // The pool's workers add their counters every few thousand lookups; the rest are added here
+        pool.onEachWorker([&] { cache.flushThreadStats(); });
+        cache.flushThreadStats();
+        textureCacheStats stats = cache.stats();
+        std::cout << std::left << std::setw(10) << (std::to_string(int(budgetMiB)) + " MiB") << std::setw(8) << (filtering ? "on" : "off") << std::right
+                  << std::setprecision(0) << std::setw(14) << cam.stats.raysPerSecond() << std::setw(12) << stats.lookups << std::setprecision(2)
+                  << std::setw(10) << 100 * stats.hitRate() << std::setw(12) << stats.misses << std::setw(12) << stats.evictions << std::setw(14)
+                  << stats.peakResidentBytes / 1048576.0 << std::setprecision(0) << std::setw(12) << stats.meanLookupNanoseconds << '\n';
+    }
+    for (const auto& path : paths)
+        std::remove(path.c_str());
+
+    // A budget of 16 tiles of 8x8 texels, one per shard, so nearly every lookup near a tile corner evicts tiles that an earlier fetch of the same lookup still reads
+    // Every lookup must match one through a cache that holds the whole texture
+    const int smallSize = 512, smallTile = 8;
+    floatImage small(smallSize, smallSize);
+    for (int j = 0; j < smallSize; j++)
+        for (int i = 0; i < smallSize; i++)
+            small.set(i, j, color((i % 7) / 6.0, (j % 5) / 4.0, ((i + j) % 3) / 2.0));
+    const std::string smallPath = (std::filesystem::temp_directory_path() / "weekendfun-benchmark-texture-small.wtex").string();
+    std::string error;
+    if (!writeTiledTexture(smallPath, small, smallTile, error)) {
+        std::cout << error << '\n';
+        return;
+    }
+    textureCache tiny(16 * smallTile * smallTile * 3), whole(std::size_t(64) << 20);
+    const int tinyId = tiny.open(smallPath, error), wholeId = whole.open(smallPath, error);
+    // Tile corners in a fixed random order, so a lookup's first tap is often a tile in the thread's oldest slot that the shard has already evicted, and its later misses replace that slot
+    // The whole-texture cache is read in a pass of its own, since a thread's local tiles belong to the last cache it used
+    const int cornerCount = 20000;
+    std::vector<double> us, vs, footprints;
+    std::uint64_t state = 1;
+    for (int k = 0; k < cornerCount; k++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        const int tx = 1 + int((state >> 33) % (smallSize / smallTile - 1)), ty = 1 + int((state >> 45) % (smallSize / smallTile - 1));
+        // Just inside a tile corner, so the bilinear taps span four tiles, at a footprint between the two finest levels or at the finest
+        us.push_back((tx * smallTile + 0.01) / smallSize);
+        vs.push_back((ty * smallTile + 0.01) / smallSize);
+        footprints.push_back((state >> 60) & 1 ? 1.5 / smallSize : 0.0);
+    }
+    std::vector<color> expected;
+    for (int k = 0; k < cornerCount; k++)
+        expected.push_back(whole.lookup(wholeId, us[k], vs[k], footprints[k]));
+    int mismatches = 0;
+    for (int k = 0; k < cornerCount; k++)
+        if ((tiny.lookup(tinyId, us[k], vs[k], footprints[k]) - expected[k]).squaredLength() > 1e-12)
+            mismatches++;
+    tiny.flushThreadStats();
+    std::cout << "16 tile budget, " << cornerCount << " lookups across tile corners: " << tiny.stats().evictions << " evictions, " << mismatches << " mismatches\n";
+    std::remove(smallPath.c_str());
+}
+
+// Throughput of a scene too large for the caches, rendered on every CPU with one shared scene (unpinned, then pinned) and with one replica per NUMA node
+// On a multi-socket host the shared scene lives on node 0, so the other nodes' threads pay remote latency on every traversal step; on a single node the three runs should match
+inline void benchmarkNuma() {
+    const numaTopology topology = numaTopology::detect();
+    std::cout << topology.nodeCount() << " NUMA node(s):";
+    for (int node = 0; node < topology.nodeCount(); node++)
+        std::cout << ' ' << topology.nodeCpus[node].size() << " CPUs";
+    std::cout << '\n';
+    if (topology.nodeCount() == 1)
+        std::cout << "single node: pinning and replication do nothing here, the runs only show that they cost nothing\n";
+
+    sceneGeneratorConfig config;
+    config.sphereCount = 400000;
+    config.materialPalette = 64;
+    hittableList list = generateSphereFieldList(config);
+    camera cam = benchmarkCamera();
+    cam.imageWidth = 240;
+    cam.samplesPerPixel = 2;
+
+    // Restores the calling thread's CPUs after the pinned runs; pinning only happens on Linux, where there is more than one node
+#if defined(__linux__)
+    cpu_set_t originalCpus;
+    bool haveOriginal = sched_getaffinity(0, sizeof(originalCpus), &originalCpus) == 0;
+#endif
+    unsigned cpus = 0;
+    for (const auto& node : topology.nodeCpus)
+        cpus += unsigned(node.size());
+    const unsigned workers = std::max(1u, cpus) - 1;
+
+    double baseline = 0;
+    std::cout << std::left << std::setw(22) << "scene" << std::right << std::setw(14) << "build s" << std::setw(12) << "MiB"
+              << std::setw(16) << "rays/s" << std::setw(10) << "speedup" << '\n';
+    for (int mode = 0; mode < 3; mode++) {
+        const bool pinned = mode > 0 && topology.nodeCount() > 1;
+        if (pinned)
+            pinThreadToNode(topology, 0);
+        threadPool pool(workers, pinned ? numaWorkerPlacement(topology) : nullptr);
+        cam.pool = workers > 0 ? &pool : nullptr;
+
+        stopwatch buildTimer;
+        std::unique_ptr<hittable> world;
+        std::size_t bytes = 0;
+        if (mode < 2) {
+            auto shared = std::make_unique<wideBvh>(list);
+            bytes = shared->memoryBytes();
+            world = std::move(shared);
+        } else {
+            auto replicated = std::make_unique<numaReplicatedWorld<wideBvh>>(list, topology, [](const hittableList& source) { return wideBvh(source); });
+            for (int node = 0; node < replicated->replicaCount(); node++)
+                bytes += replicated->replica(node).memoryBytes();
+            world = std::move(replicated);
+        }
+        double buildSeconds = buildTimer.seconds();
+
+        // Tiles go to per-thread buffers, which renderTiles keeps on the rendering thread's node
+        cam.renderTiles(*world, 32, nullptr, 0, [](const imageTile&) {});
+        double raysPerSecond = cam.stats.raysPerSecond();
+        if (mode == 0)
+            baseline = raysPerSecond;
+        const char* names[] = { "shared, unpinned", "shared, pinned", "replicated, pinned" };
+        std::cout << std::left << std::setw(22) << names[mode] << std::right << std::fixed << std::setprecision(2) << std::setw(14) << buildSeconds
+                  << std::setw(12) << bytes / 1048576.0 << std::setprecision(0) << std::setw(16) << raysPerSecond << std::setprecision(2)
+                  << std::setw(9) << raysPerSecond / std::max(1.0, baseline) << "x\n";
+
+        if (pinned) {
+            numaThreadNode = 0;
+#if defined(__linux__)
+            if (haveOriginal)
+                pthread_setaffinity_np(pthread_self(), sizeof(originalCpus), &originalCpus);
+#endif
+        }
+    }
+}
+
+// Times every vec3 kernel on the SIMD backend and on the scalar reference; tests/vec3Test.cc checks that both agree
+inline void benchmarkVectorMath() {
+    const int count = 4096;
+    std::vector<vec3> a(count), b(count), out(count);
+    std::vector<referenceVector> ra(count), rb(count), rout(count);
+    std::vector<double> scalars(count), dots(count), rdots(count);
+    seedRandom(1);
+    for (int i = 0; i < count; i++) {
+        a[i] = vec3::random(-10, 10);
+        b[i] = unitVector(vec3::random(-1, 1));
+        scalars[i] = randomDouble(0.5, 2);
+        ra[i] = { a[i].x(), a[i].y(), a[i].z() };
+        rb[i] = { b[i].x(), b[i].y(), b[i].z() };
+    }
+
+    std::cout << "vec3 backend: " << vec3Backend << "\n\n";
+
+    // Times rounds passes of a kernel over all inputs and returns nanoseconds per call, the fastest of several repetitions to filter out scheduling noise
+    const int rounds = 400, repetitions = 7;
+    auto timeKernel = [&](auto&& kernel) {
+        double best = infinity;
+        for (int repetition = 0; repetition < repetitions; repetition++) {
+            stopwatch timer;
+            for (int round = 0; round < rounds; round++)
+                kernel();
+            best = std::min(best, timer.seconds());
+        }
+        return 1e9 * best / (double(rounds) * count);
+    };
+
+    // A result derived from every output keeps the compiler from dropping the timed loops
+    double sink = 0;
+    auto consume = [&]() {
+        for (int i = 0; i < count; i++)
+            sink += out[i].x() + rout[i].x + dots[i] + rdots[i];
+    };
+
+    std::cout << '\n' << std::left << std::setw(12) << "kernel" << std::right << std::setw(12) << "scalar ns" << std::setw(12) << "simd ns"
+              << std::setw(10) << "speedup" << '\n' << std::fixed;
+    auto report = [&](const char* name, double scalarNs, double simdNs) {
+        consume();
+        std::cout << std::left << std::setw(12) << name << std::right << std::setprecision(3) << std::setw(12) << scalarNs
+                  << std::setw(12) << simdNs << std::setprecision(2) << std::setw(9) << scalarNs / simdNs << "x\n";
+    };
+
+    report("add",
+           timeKernel([&] { for (int i = 0; i < count; i++) rout[i] = referenceAdd(ra[i], rb[i]); }),
+           timeKernel([&] { for (int i = 0; i < count; i++) out[i] = a[i] + b[i]; }));
+    report("scale",
+           timeKernel([&] { for (int i = 0; i < count; i++) rout[i] = referenceScale(scalars[i], ra[i]); }),
+           timeKernel([&] { for (int i = 0; i < count; i++) out[i] = scalars[i] * a[i]; }));
+    report("dot",
+           timeKernel([&] { for (int i = 0; i < count; i++) rdots[i] = referenceDot(ra[i], rb[i]); }),
+           timeKernel([&] { for (int i = 0; i < count; i++) dots[i] = dot(a[i], b[i]); }));
+    report("cross",
+           timeKernel([&] { for (int i = 0; i < count; i++) rout[i] = referenceCross(ra[i], rb[i]); }),
+           timeKernel([&] { for (int i = 0; i < count; i++) out[i] = cross(a[i], b[i]); }));
+    report("unitVector",
+           timeKernel([&] { for (int i = 0; i < count; i++) rout[i] = referenceUnit(ra[i]); }),
+           timeKernel([&] { for (int i = 0; i < count; i++) out[i] = unitVector(a[i]); }));
+    report("reflect",
+           timeKernel([&] { for (int i = 0; i < count; i++) rout[i] = referenceReflect(ra[i], rb[i]); }),
+           timeKernel([&] { for (int i = 0; i < count; i++) out[i] = reflect(a[i], b[i]); }));
+    report("refract",
+           timeKernel([&] { for (int i = 0; i < count; i++) rout[i] = referenceRefract(rb[i], ra[i], 1 / 1.5); }),
+           timeKernel([&] { for (int i = 0; i < count; i++) out[i] = refract(b[i], a[i], 1 / 1.5); }));
+
+    std::cout << "checksum " << std::setprecision(0) << sink << '\n';
+}
+
+// Runs the benchmark with the given name, returns false if there is no such benchmark; args are the remaining command line arguments
+inline bool runBenchmark(const std::string& name, const std::vector<std::string>& args = {}) {
+    if (name == "scaling") {
+        benchmarkScaling(args.empty() ? 5 : std::atoi(args[0].c_str()));
+        return true;
+    }
+    if (name == "reorder") {
+        benchmarkRayReordering();
+        return true;
+    }
+    if (name == "grid") {
+        benchmarkUniformGrid();
+        return true;
+    }
+    if (name == "widebvh") {
+        benchmarkWideBvh();
+        return true;
+    }
+    if (name == "output") {
+        benchmarkOutputPipeline();
+        return true;
+    }
+    if (name == "vec3") {
+        benchmarkVectorMath();
+        return true;
+    }
+    if (name == "deferred") {
+        if (!benchmarkDeferredHits())
+            std::exit(1);
+        return true;
+    }
+    if (name == "envmap") {
+        benchmarkEnvironmentMap();
+        return true;
+    }
+    if (name == "guiding") {
+        benchmarkPathGuiding();
+        return true;
+    }
+    if (name == "preview") {
+        benchmarkPreview();
+        return true;
+    }
+    if (name == "filters") {
+        benchmarkFilters();
+        return true;
+    }
+    if (name == "textures") {
+        benchmarkTextureCache();
+        return true;
+    }
+    if (name == "numa") {
+        benchmarkNuma();
+        return true;
+    }
+    if (name == "cancel") {
+        benchmarkCancellation();
+        return true;
+    }
+    if (name == "static") {
+        benchmarkStaticScene();
+        return true;
+    }
+    return false;
+}
+
+#endif
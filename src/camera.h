@@ -1,8 +1,58 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "allocationProfiler.h"
+#include "environmentMap.h"
+#include "filter.h"
+#include "framebuffer.h"
 #include "hittable.h"
+#include "imageWriter.h"
 #include "material.h"
+#include "numa.h"
+#include "pathGuiding.h"
+#include "previewHistory.h"
+#include "profiling.h"
+#include "rayBatch.h"
+#include "staticScene.h"
+#include "threadPool.h"
+
+// Libraries for std::min/std::max, the cancellation flag, the per-pass callback and the row counts of filtered renders
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Summary of a progressive render: how far it got and why it stopped
+class progressiveReport {
+public:
+    // Number of completed passes
+    int passes = 0;
+    // Samples per pixel reached
+    int samplesPerPixel = 0;
+    // Wall-clock time since the render started
+    double seconds = 0;
+    // Noise estimate of the image after the last pass (see accumulationBuffer::noise)
+    double noise = infinity;
+    // Why the render stopped
+    bool deadlineReached = false;
+    bool noiseTargetReached = false;
+    bool sampleLimitReached = false;
+};
+
+// Rectangle of finished pixels handed out by camera::renderTiles
+// pixels points at the tile's top left pixel as linear float RGBA (alpha is 1); rowStride is the distance in floats between the starts of two pixel rows
+class imageTile {
+public:
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+    float* pixels = nullptr;
+    std::size_t rowStride = 0;
+
+    // Address of the RGBA pixel at (i,j) relative to the tile's corner
+    float* pixel(int i, int j) const { return pixels + j * rowStride + std::size_t(i) * 4; }
+};
 
 // Defines a camera class that handles rendering an image by shooting rays into the scene
 class camera {
@@ -37,48 +87,435 @@ public:
     // Distance from camera lookfrom point to plane of perfect focus
     double focusDist = 0;
 
+    // Reconstruction filter that turns samples into pixels; the box filter averages the samples of each pixel
+    // Other filters splat every sample onto the neighbouring pixels within their radius (see renderFilteredTiles); render and renderTiles use them, the batched and progressive modes always use the box
+    reconstructionFilter filter;
+
+    // Traces the samples of each scanline as batches that advance one bounce at a time, sorting the scattered rays by origin and direction before every bounce
+    bool batchedBounces = false;
+
+    // Maximum number of paths kept in flight per batch when batchedBounces is enabled
+    int rayBatchSize = 1 << 16;
+
+    // Number of finished scanlines that may wait for the background writer before rendering pauses
+    int outputQueueRows = 64;
+
+    // HDR light surrounding the scene; null keeps the built-in white-to-blue sky gradient
+    const environmentMap* environment = nullptr;
+
+    // With an environment, diffuse hits also sample the environment directly and combine that with the scattered ray through multiple importance sampling
+    // Turning it off leaves only the scattered rays (BSDF sampling) to find the environment's light; the batched mode always works that way
+    bool environmentSampling = true;
+
+    // Learned distribution of incident light; diffuse hits mix sampling it with lambertian scattering and record what their paths find
+    // renderProgressive trains it between passes; other render modes sample and record without refining it
+    // With an environment, light sampling still handles direct light and the guide's mixture takes the place of lambertian scattering in the weighting
+    pathGuide* guide = nullptr;
+
+    // Worker threads the scanlines are spread over; null renders everything on the calling thread
+    threadPool* pool = nullptr;
+
+    // Stream the PPM image is written to and stream for progress messages (null disables progress output)
+    std::ostream* output = &std::cout;
+    std::ostream* progressLog = &std::clog;
+
+    // Samples per pixel added by every pass of renderProgressive (the first pass always uses a single sample so an image exists as early as possible)
+    int samplesPerPass = 4;
+
+    // Called after every pass of renderProgressive; currentImage() holds a complete image at that point
+    std::function<void(const progressiveReport&)> onPass;
+
+    // Cooperative cancellation of renderTiles: once the flag is set, no new tile or sample is started and the call returns early
+    const std::atomic<bool>* cancel = nullptr;
+
+    // Seed of the render's random numbers; every pixel draws its samples from a sequence derived from the seed and its position, so the image does not depend on the thread count or tile layout
+    std::uint64_t seed = 1;
+
+    // Ray counts, timing and cache misses of the last call to render()
+    renderStats stats;
+
+    // Height of the image in pixels, derived from imageWidth and aspectRatio
+    int outputHeight() const {
+        int height = int(imageWidth / aspectRatio);
+        return (height < 1) ? 1 : height;
+    }
+
     // Main rendering function that generates the image by shooting rays into the world, takes a reference to the hittable world(contains all objects in the scene)
-    void render(const hittable& world) {
+    // World is either a dynamic hittable (such as hittableList) or a compile-time staticScene; the trace loop is instantiated per world type
+    template <typename World>
+    void render(const World& world) {
         // Calls a helpher function to set up the camera parameters before rendering begins
         initialize();
 
-        // Outputs the header for the PPM image format(plain text format for storing images)
-        std::cout << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
+        // Resets the counters of the previous render and starts measuring this one
+        stats = renderStats();
+        cacheMissCounter cacheMisses;
+        stopwatch timer;
+        cacheMisses.start();
+
+        // Starts the output stage; it writes the PPM header(plain text format for storing images), then encodes and writes finished scanlines on its own thread and reports progress
+        nullBuffer noLog;
+        std::ostream log(progressLog ? progressLog->rdbuf() : &noLog);
+        imageWriter writer(*output, log, imageWidth, imageHeight, outputQueueRows);
+
+        // Splatting filters need a pixel's neighbours before it is final, so the image is rendered tile by tile into a frame; each row goes to the writer once every tile covering it is finished
+        if (filter.splats() && !batchedBounces) {
+            std::vector<float> frame(std::size_t(imageWidth) * imageHeight * 4);
+            std::vector<int> pixelsLeft(imageHeight, imageWidth);
+            std::mutex rowsMutex;
+            renderTiles(world, 32, frame.data(), std::size_t(imageWidth) * 4, [&](const imageTile& tile) {
+                for (int j = tile.y; j < tile.y + tile.height; j++) {
+                    {
+                        std::lock_guard<std::mutex> lock(rowsMutex);
+                        pixelsLeft[j] -= tile.width;
+                        if (pixelsLeft[j] > 0)
+                            continue;
+                    }
+                    auto row = writer.acquireRow();
+                    for (int i = 0; i < imageWidth; i++) {
+                        const float* p = &frame[(std::size_t(j) * imageWidth + i) * 4];
+                        row[i] = color(p[0], p[1], p[2]);
+                    }
+                    writer.submit(j, std::move(row));
+                }
+            });
+            writer.finish();
+            cacheMisses.stop();
+            stats.seconds = timer.seconds();
+            stats.cacheMisses = cacheMisses.value();
+            stats.cacheMissesAvailable = cacheMisses.available();
+            return;
+        }
 
         // Nested loop for rendering
-        // Outer loop that iterates over each row (scanline) of the image from top to bottom; logs the number of remaining scanlines to the standard error using std::clog
-        for (int j = 0; j < imageHeight; j++) {
-            std::clog << "\rScanlines remaining: " << (imageHeight - j) << ' ' << std::flush;
-            // Inner loop that iterates over each picel in the current row from left to right
-            for (int i = 0; i < imageWidth; i++) {
-                /* Old way to color objects in the rend 
-                // Calculates the center of the current pixel in 3D space
-                auto pixelCenter = pixel00Location + (i * pixelDeltaU) + (j * pixelDeltaV);
-                // Computes the direction of the ray for this pixel (from the camera center to the pixel)
-                auto rayDirection = pixelCenter - center;
-                // Creates a ray r originating from the camera's center and pointing towards the pixel
-                ray r(center, rayDirection);
-
-                // Computes the color for the ray by determining whether it hits any objects in the world
-                color pixelColor = rayColor(r, world);
-                // Writes the pixel's color to the std output in the PPM format
-                writeColor(std::cout, pixelColor); */
-                // Initializes a color object pixelColor with all components set to 0 (black)
-                color pixelColor(0,0,0);
-                // Loop that iterates samplesPerPixel times to gather multiple samples for anti-aliasing; samplesPerPixel determines how many rays are shot through each pixel for more accurate color representation and smoothing
-                for (int sample = 0; sample < samplesPerPixel; sample++) {
-                    // Generates a new ray r for the current pixel (i,j)
-                    ray r = getRay(i, j);
-                    // Calls the rayColor() which returns the color for the ray after checking for intersections in the world
-                    // The returned color is added to pixelColor, accumulating the color contributions from each sample
-                    pixelColor += rayColor(r, maxDepth, world);
+        // Outer loop that iterates over each row (scanline) of the image, spread over the pool's workers when there is a pool; each finished row is handed to the writer
+        forEachRow([&](int j, traceContext& context) {
+            // Final averaged colors of the scanline being rendered
+            auto rowColors = writer.acquireRow();
+            // In batched mode the whole scanline is traced bounce by bounce
+            if (batchedBounces) {
+                context.batch.reserve(std::size_t(std::min(rayBatchSize, imageWidth * samplesPerPixel)));
+                {
+                    allocationHotPath noAllocation;
+                    renderRowBatched(j, world, rowColors, context);
+                }
+                for (int i = 0; i < imageWidth; i++)
+                    rowColors[i] = pixelSampleScale * rowColors[i];
+                writer.submit(j, std::move(rowColors));
+                return;
+            }
+            {
+                // Tracing must not touch the heap; the allocation profiler counts anything the pixel loop allocates
+                allocationHotPath noAllocation;
+                // Inner loop that iterates over each picel in the current row from left to right
+                for (int i = 0; i < imageWidth; i++) {
+                    /* Old way to color objects in the rend 
+                    // Calculates the center of the current pixel in 3D space
+                    auto pixelCenter = pixel00Location + (i * pixelDeltaU) + (j * pixelDeltaV);
+                    // Computes the direction of the ray for this pixel (from the camera center to the pixel)
+                    auto rayDirection = pixelCenter - center;
+                    // Creates a ray r originating from the camera's center and pointing towards the pixel
+                    ray r(center, rayDirection);
+
+                    // Computes the color for the ray by determining whether it hits any objects in the world
+                    color pixelColor = rayColor(r, world);
+                    // Writes the pixel's color to the std output in the PPM format
+                    writeColor(std::cout, pixelColor); */
+                    // Initializes a color object pixelColor with all components set to 0 (black)
+                    color pixelColor(0,0,0);
+                    seedPixel(i, j, 0);
+                    // Loop that iterates samplesPerPixel times to gather multiple samples for anti-aliasing; samplesPerPixel determines how many rays are shot through each pixel for more accurate color representation and smoothing
+                    for (int sample = 0; sample < samplesPerPixel; sample++) {
+                        // Generates a new ray for the current pixel (i,j) and calls rayColor() which returns the color for the ray after checking for intersections in the world
+                        // The returned color is added to pixelColor, accumulating the color contributions from each sample
+                        pixelColor += samplePixel(i, j, world, context);
+                    }
+                    // Scales the accumulated pixelColor by pixelSampleScale. The result is the final color for the pixel after multiple samples have been processed
+                    rowColors[i] = pixelSampleScale * pixelColor;
                 }
-                // Scales the accumulated pixelColor by pixelSampleScale and writes the final averaged color to the output stream in PPM format using writeColor(). The result is the final color for the pixel after multiple samples have been processed
-                writeColor(std::cout, pixelSampleScale * pixelColor);
+            }
+            writer.submit(j, std::move(rowColors));
+        });
+        // Waits for the writer to drain its queue; it logs "Done." once the last row is written
+        writer.finish();
+
+        // Latches the counters of this render; cache misses cover the calling thread only
+        cacheMisses.stop();
+        stats.seconds = timer.seconds();
+        stats.cacheMisses = cacheMisses.value();
+        stats.cacheMissesAvailable = cacheMisses.available();
+    }
+
+    // Time-budgeted progressive render
+    // Renders passes of samplesPerPass samples over the whole image into a running average and stops before the wall-clock budget would be exceeded, once the noise estimate drops to targetNoise (0 disables), or at samplesPerPixel samples, whichever comes first
+    // A pass is only started if the slowest pass so far would still finish within the budget, so the deadline holds unless the first single-sample pass alone exceeds it
+    // The final image is written like render() does and the report is logged to std::clog
+    template <typename World>
+    progressiveReport renderProgressive(const World& world, double timeBudgetSeconds, double targetNoise = 0) {
+        initialize();
+        stats = renderStats();
+        stopwatch timer;
+        accumulation.reset(imageWidth, imageHeight);
+
+        progressiveReport report;
+        double slowestPassPerSample = 0;
+        // At least the first pass runs, so a samplesPerPixel below 1 gives a one-sample image instead of an empty pass
+        const int sampleLimit = std::max(1, samplesPerPixel);
+        while (true) {
+            // The first pass takes one sample; later passes take samplesPerPass but never overshoot the sample limit
+            int passSamples = report.passes == 0 ? 1 : std::max(1, samplesPerPass);
+            passSamples = std::min(passSamples, sampleLimit - accumulation.samplesPerPixel());
+
+            // Predicts the next pass from the slowest per-sample pass time seen so far and stops if it would miss the deadline
+            double elapsed = timer.seconds();
+            if (report.passes > 0 && elapsed + slowestPassPerSample * passSamples > timeBudgetSeconds) {
+                report.deadlineReached = true;
+                break;
+            }
+
+            stopwatch passTimer;
+            forEachRow([&](int j, traceContext& context) {
+                allocationHotPath noAllocation;
+                for (int i = 0; i < imageWidth; i++) {
+                    // Continues each pixel's sequence where the previous pass stopped, so passes never repeat samples
+                    seedPixel(i, j, accumulation.samplesPerPixel());
+                    for (int sample = 0; sample < passSamples; sample++)
+                        accumulation.add(i, j, samplePixel(i, j, world, context));
+                }
+            });
+            accumulation.finishPass(passSamples);
+            if (guide)
+                guide->endPass();
+            slowestPassPerSample = std::max(slowestPassPerSample, passTimer.seconds() / passSamples);
+
+            report.passes++;
+            report.samplesPerPixel = accumulation.samplesPerPixel();
+            report.seconds = timer.seconds();
+            report.noise = accumulation.noise();
+            if (onPass)
+                onPass(report);
+
+            if (targetNoise > 0 && report.noise <= targetNoise) {
+                report.noiseTargetReached = true;
+                break;
+            }
+            if (accumulation.samplesPerPixel() >= sampleLimit) {
+                report.sampleLimitReached = true;
+                break;
             }
         }
-        // Logs a message indicating that rendering is complete
-        std::clog << "\rDone.                       \n";
+        stats.seconds = timer.seconds();
+
+        // Writes the converged (or deadline-limited) image
+        nullBuffer noLog;
+        std::ostream log(progressLog ? progressLog->rdbuf() : &noLog);
+        {
+            imageWriter writer(*output, log, imageWidth, imageHeight, outputQueueRows);
+            for (int j = 0; j < imageHeight; j++) {
+                auto row = writer.acquireRow();
+                accumulation.averageRow(j, row);
+                writer.submit(j, std::move(row));
+            }
+        }
+
+        log << "Progressive: " << report.passes << " passes, " << report.samplesPerPixel << " spp, noise "
+                  << report.noise << ", " << report.seconds << " s, stopped by "
+                  << (report.noiseTargetReached ? "noise target" : report.deadlineReached ? "deadline" : "sample limit") << '\n';
+        if (guide)
+            log << "Path guide: " << guide->iterations() << " training iterations, " << guide->regionCount() << " regions, "
+                << guide->memoryBytes() / 1048576.0 << " MiB\n";
+        return report;
+    }
+
+    // Renders the image in square tiles of tileSize pixels without the PPM output stage, for embedding the renderer
+    // With an image (imageWidth x outputHeight() RGBA floats, rows rowStride floats apart) every pixel is written straight into it; without one each thread renders into its own tile buffer
+    // tileDone(const imageTile&) is called once per finished tile, from whichever thread rendered it; a tile buffer is only valid during the call
+    // The cancel flag is checked before every sample, so a cancelled render stops within one path of every thread; unfinished tiles are not reported
+    // firstRow/lastRow restrict the render to a strip of rows [firstRow, lastRow) (lastRow < 0 = to the bottom); image then holds only the strip, its first row being firstRow
+    // Pixels are seeded by their position in the full image, so rendering strip by strip gives exactly the pixels of a render in one go
+    template <typename World, typename TileDone>
+    void renderTiles(const World& world, int tileSize, float* image, std::size_t rowStride, TileDone&& tileDone, int firstRow = 0, int lastRow = -1) {
+        initialize();
+        stats = renderStats();
+        stopwatch timer;
+
+        firstRow = std::max(0, firstRow);
+        lastRow = (lastRow < 0) ? imageHeight : std::min(lastRow, imageHeight);
+        tileSize = std::max(1, tileSize);
+        const int tilesX = (imageWidth + tileSize - 1) / tileSize;
+        const int tilesY = (lastRow - firstRow + tileSize - 1) / tileSize;
+        if (filter.splats()) {
+            renderFilteredTiles(world, tileSize, tilesX, std::max(0, tilesY), image, rowStride, tileDone, firstRow, lastRow);
+            stats.seconds = timer.seconds();
+            return;
+        }
+        forEachItem(tilesX * std::max(0, tilesY), [&](int t, traceContext& context) {
+            if (cancelled())
+                return;
+            imageTile tile;
+            tile.x = (t % tilesX) * tileSize;
+            tile.y = firstRow + (t / tilesX) * tileSize;
+            tile.width = std::min(tileSize, imageWidth - tile.x);
+            tile.height = std::min(tileSize, lastRow - tile.y);
+            if (image) {
+                tile.pixels = image + std::size_t(tile.y - firstRow) * rowStride + std::size_t(tile.x) * 4;
+                tile.rowStride = rowStride;
+            } else {
+                // Contexts are handed to whichever thread takes a slot, so a buffer first touched on another NUMA node is given up and allocated again locally
+                if (context.tileNode != numaThreadNode) {
+                    context.tilePixels = std::vector<float>();
+                    context.tileNode = numaThreadNode;
+                }
+                context.tilePixels.resize(std::size_t(tile.width) * tile.height * 4);
+                tile.pixels = context.tilePixels.data();
+                tile.rowStride = std::size_t(tile.width) * 4;
+            }
+
+            {
+                allocationHotPath noAllocation;
+                for (int j = 0; j < tile.height; j++) {
+                    for (int i = 0; i < tile.width; i++) {
+                        color pixelColor(0,0,0);
+                        seedPixel(tile.x + i, tile.y + j, 0);
+                        for (int sample = 0; sample < samplesPerPixel; sample++) {
+                            if (cancelled())
+                                return;
+                            pixelColor += samplePixel(tile.x + i, tile.y + j, world, context);
+                        }
+                        pixelColor = pixelSampleScale * pixelColor;
+
+                        float* out = tile.pixel(i, j);
+                        out[0] = float(pixelColor.x());
+                        out[1] = float(pixelColor.y());
+                        out[2] = float(pixelColor.z());
+                        out[3] = 1.0f;
+                    }
+                }
+            }
+            tileDone(static_cast<const imageTile&>(tile));
+        });
+
+        stats.seconds = timer.seconds();
+    }
+
+    // Image of the current progressive render, averaged over all completed passes
+    const accumulationBuffer& currentImage() const { return accumulation; }
+
+    // Interactive preview frame that reuses the samples of the previous frame rendered into history, for a camera that moved a little since
+    // Every pixel first traces its center ray to find the surface it sees and projects that hit into the previous frame; that pixel's samples are taken over if the distance and normal match (so the surface was not hidden before) and the surface is diffuse
+    // Pixels with accepted history add history.refreshSamples new samples, all others start over with samplesPerPixel, so the work goes where the image has to be rebuilt
+    // The result stays in history (average, image); the lens is treated as a pinhole for the reprojection, and reused light is slightly biased where it depends on the view, which the history limit keeps in bounds
+    template <typename World>
+    previewReport renderPreview(const World& world, previewHistory& history) {
+        initialize();
+        stats = renderStats();
+        stopwatch timer;
+
+        previewView view;
+        view.center = center;
+        view.pixel00 = pixel00Location;
+        view.pixelDeltaU = pixelDeltaU;
+        view.pixelDeltaV = pixelDeltaV;
+        view.forward = -w;
+        view.focusDist = focusDist;
+        view.width = imageWidth;
+        view.height = imageHeight;
+        history.beginFrame(view);
+        const previewView& before = history.previousView;
+        const bool hasPrevious = !history.previous.empty();
+
+        // Reason counters in the order of previewReport, added up per row
+        std::atomic<std::size_t> outcomes[4] = {};
+        std::atomic<std::uint64_t> newSamples{0};
+        forEachRow([&](int j, traceContext& context) {
+            allocationHotPath noAllocation;
+            std::size_t rowOutcomes[4] = {};
+            std::uint64_t rowSamples = 0;
+            for (int i = 0; i < imageWidth; i++) {
+                auto& pixel = history.current[std::size_t(j) * imageWidth + i];
+                ray r(center, pixel00Location + (i * pixelDeltaU) + (j * pixelDeltaV) - center);
+                context.primaryRays++;
+                typename sceneRecord<World>::type rec;
+                color albedo;
+                bool diffuse = false;
+                if (world.hit(r, interval(0.001, infinity), rec)) {
+                    pixel.hit = rec.p;
+                    pixel.normal = rec.normal;
+                    diffuse = diffuseAlbedoAt(world, rec, albedo);
+                } else {
+                    pixel.missed = true;
+                    pixel.hit = unitVector(r.direction());
+                }
+
+                // 0 reused, 1 outside the previous view, 2 disoccluded, 3 specular
+                // The history is resampled bilinearly from the four previous pixels around the projected point, each of which has to show the same surface; taking the nearest pixel instead shifts the image by up to half a pixel every frame
+                int outcome = 1;
+                double x, y;
+                if (hasPrevious && before.project(pixel.hit, pixel.missed, x, y)) {
+                    const int x0 = int(std::floor(x)), y0 = int(std::floor(y));
+                    const double fx = x - x0, fy = y - y0;
+                    color sum(0,0,0);
+                    double samples = 0, weight = 0;
+                    const double expected = pixel.missed ? 0.0 : (pixel.hit - before.center).length();
+                    for (int tap = 0; tap < 4; tap++) {
+                        const int oi = x0 + (tap & 1), oj = y0 + (tap >> 1);
+                        const double tapWeight = ((tap & 1) ? fx : 1 - fx) * ((tap >> 1) ? fy : 1 - fy);
+                        if (oi < 0 || oj < 0 || oi >= before.width || oj >= before.height || tapWeight <= 0)
+                            continue;
+                        const auto& old = history.previous[std::size_t(oj) * before.width + oi];
+                        if (old.samples <= 0 || old.missed != pixel.missed)
+                            continue;
+                        if (!pixel.missed) {
+                            double stored = (old.hit - before.center).length();
+                            if (std::fabs(expected - stored) > history.depthTolerance * stored || dot(pixel.normal, old.normal) < history.minNormalCosine)
+                                continue;
+                        }
+                        sum += tapWeight * old.colorSum;
+                        samples += tapWeight * old.samples;
+                        weight += tapWeight;
+                    }
+                    // Taps that fail cover for each other only while the accepted ones carry most of the weight
+                    if (weight < 0.5)
+                        outcome = 2;
+                    else if (!pixel.missed && !diffuse)
+                        outcome = 3;
+                    else
+                        outcome = 0;
+                    if (outcome == 0) {
+                        pixel.colorSum = sum / weight;
+                        pixel.samples = samples / weight;
+                        // Next to a silhouette the accepted pixels' samples also cover the other surface, and renormalizing over them would carry that mix along for the whole life of the history
+                        const double limit = weight < 1 - 1e-9 ? std::min(history.historyLimit, history.partialHistoryLimit) : history.historyLimit;
+                        if (pixel.samples > limit) {
+                            pixel.colorSum = pixel.colorSum * (limit / pixel.samples);
+                            pixel.samples = limit;
+                        }
+                    }
+                }
+                rowOutcomes[outcome]++;
+
+                // Every frame draws a fresh sequence for the pixel
+                const int samples = outcome == 0 ? history.refreshSamples : samplesPerPixel;
+                seedPixelFrame(i, j, history.frame);
+                for (int sample = 0; sample < samples; sample++)
+                    pixel.colorSum += samplePixel(i, j, world, context);
+                pixel.samples += samples;
+                rowSamples += std::uint64_t(samples);
+            }
+            for (int k = 0; k < 4; k++)
+                outcomes[k].fetch_add(rowOutcomes[k], std::memory_order_relaxed);
+            newSamples.fetch_add(rowSamples, std::memory_order_relaxed);
+        });
+        history.frame++;
+
+        previewReport report;
+        report.reusedPixels = outcomes[0].load();
+        report.outsidePixels = outcomes[1].load();
+        report.disoccludedPixels = outcomes[2].load();
+        report.specularPixels = outcomes[3].load();
+        report.newSamples = newSamples.load();
+        report.seconds = stats.seconds = timer.seconds();
+        return report;
     }
 
 private: 
@@ -92,18 +529,37 @@ private:
     vec3 pixelDeltaU;
     // Vertical offset between adjacent pixels in the image
     vec3 pixelDeltaV;
+    // Angle a pixel covers, which is how fast the ray cones around the camera rays widen with distance
+    double pixelSpread;
     // Camera frame basis vector
     vec3 u, v, w;
     // Defocus disk horizontal radius
     vec3 defocusDiskU;
     // Defocus disk vertical radius
     vec3 defocusDiskV;
+    // Per-thread state of a render: ray counters and the path storage reused by every scanline of the batched bounce mode
+    class traceContext {
+    public:
+        std::uint64_t primaryRays = 0;
+        std::uint64_t secondaryRays = 0;
+        rayBatch batch;
+        // Tile buffer of renderTiles when it renders without a caller image, and the NUMA node of the thread that allocated it
+        std::vector<float> tilePixels;
+        int tileNode = 0;
+        // Width of the current path's ray cone at the origin of the ray being traced, see traceFootprint
+        double coneWidth = 0;
+    };
+    // One context per thread that can take part in a render (the pool's workers plus the calling thread)
+    std::vector<traceContext> contexts;
+    // Running average of renderProgressive
+    accumulationBuffer accumulation;
+    // Image of renderTiles with a splatting filter when the caller gives none
+    std::vector<float> filterFrame;
 
     // Initialize function sets up the camera parameters, including the image size, pixel locations, and fov
     void initialize() {
         // Calculates the height of the image based on the width and aspect ratio
-        imageHeight = int(imageWidth / aspectRatio);
-        imageHeight = (imageHeight < 1) ? 1 : imageHeight;
+        imageHeight = outputHeight();
 
         // Calculates the scale factor used to average the color values across multiple samples per pixel
         // samplesPerPixel is the number of rays(samples) shot through each pixel and dividing 1 by this number gives the factor to scale the accumulated color values to get the average
@@ -121,6 +577,9 @@ private:
         // Sets the height of the camera's viewport (the visible area); computes the full height of the viewport by multiplying 2 * h by the focal length, which adjusts the height based on the camera's focal length.
         auto viewportHeight = 2 * h * focusDist;
     
+        // Every pixel covers the same share of the vertical field of view (exactly at the image center, closely enough elsewhere)
+        pixelSpread = 2 * h / imageHeight;
+
         // Calculates the width of the viewport based on the aspect ratio
         auto viewportWidth = viewportHeight * (double(imageWidth)/imageHeight);
 
@@ -155,7 +614,11 @@ private:
     ray getRay(int i, int j) const {
         // Calls sampleSquare() to get a random offset within the pixel for anti-aliasing
         // The offset ensures that rays are slightly jittered inside the pixel to smooth out edges and create a more smooth image
-        auto offset = sampleSquare();
+        return getRay(i, j, sampleSquare());
+    }
+
+    // Generates the ray through the point offset pixels from the center of pixel (i,j)
+    ray getRay(int i, int j, const vec3& offset) const {
         // Calculates the location of the current pixel sample in a 3D space
         // Takes the top left corner of the image and moves horziontally based on pixel index i and random x offset and moves vertically based on index j and random y offset
         auto pixelSample = pixel00Location
@@ -187,17 +650,224 @@ private:
         return center + (p[0] * defocusDiskU) + (p[1] * defocusDiskV);
     }
 
+    // True once the render has been asked to stop
+    bool cancelled() const {
+        return cancel && cancel->load(std::memory_order_relaxed);
+    }
+
+    // Restarts the calling thread's random sequence for the samples of pixel (i,j) from sample firstSample on
+    void seedPixel(int i, int j, int firstSample) const {
+        seedRandom(hashSeed(hashSeed(seed, std::uint64_t(j) * imageWidth + i), firstSample));
+    }
+
+    // Restarts the calling thread's random sequence for the samples of pixel (i,j) in preview frame `frame`; the frame is hashed in on its own, so no frame count runs into another frame's sequence
+    void seedPixelFrame(int i, int j, std::uint64_t frame) const {
+        seedRandom(hashSeed(hashSeed(hashSeed(seed, std::uint64_t(j) * imageWidth + i), 0), ~frame));
+    }
+
+    // Calls body(j, context) for every scanline j
+    template <typename Body>
+    void forEachRow(Body&& body) {
+        forEachItem(imageHeight, body);
+    }
+
+    // Calls body(index, context) for every index in [0, count), on the pool's workers when there is a pool, then adds the threads' ray counters to stats
+    template <typename Body>
+    void forEachItem(int count, Body&& body) {
+        contexts.resize(pool ? pool->size() + 1 : 1);
+        for (auto& context : contexts)
+            context.primaryRays = context.secondaryRays = 0;
+
+        if (pool) {
+            pool->parallelFor(count, [&](int index, int slot) { body(index, contexts[slot]); });
+        } else {
+            for (int index = 0; index < count; index++)
+                body(index, contexts[0]);
+        }
+
+        for (const auto& context : contexts) {
+            stats.primaryRays += context.primaryRays;
+            stats.secondaryRays += context.secondaryRays;
+        }
+    }
+
+    // Traces one jittered sample through pixel (i,j)
+    template <typename World>
+    color samplePixel(int i, int j, const World& world, traceContext& context) const {
+        return samplePixel(i, j, sampleSquare(), world, context);
+    }
+
+    // Traces the sample at offset (in [-0.5,0.5) pixels from the center, z = 0) of pixel (i,j)
+    template <typename World>
+    color samplePixel(int i, int j, const vec3& offset, const World& world, traceContext& context) const {
+        context.primaryRays++;
+        context.coneWidth = 0;
+        if (guide)
+            return guidedRayColor(getRay(i, j, offset), maxDepth, world, context, 0.0);
+        if (environment)
+            return environmentRayColor(getRay(i, j, offset), maxDepth, world, context, 0.0);
+        return rayColor(getRay(i, j, offset), maxDepth, world, context);
+    }
+
+    // Geometry of a tile's splat buffer in renderFilteredTiles: the image rectangle it covers, which is the traced pixels widened by the filter margin
+    class splatRegion {
+    public:
+        int x = 0, y = 0, width = 0, height = 0;
+        // Splat sums of the tile, RGB and filter weight per pixel; released once every tile that reads it is final
+        std::vector<float> sums;
+    };
+
+    // renderTiles with a splatting reconstruction filter
+    // Every tile traces its pixels into its own splat buffer that reaches filter.margin() pixels beyond the tile, so tracing never writes memory another thread writes
+    // A tile's pixels are final once every tile whose buffer overlaps it has finished; the thread that finishes the last of them adds the overlapping buffers in tile order, divides by the summed weights and reports the tile
+    // Fixed summation order keeps the image independent of the thread count; tiles next to a strip's first and last row also trace the rows just outside the strip, so strips fit together into the image a render in one go gives (up to rounding)
+    template <typename World, typename TileDone>
+    void renderFilteredTiles(const World& world, int tileSize, int tilesX, int tilesY, float* image, std::size_t rowStride, TileDone&& tileDone,
+                             int firstRow, int lastRow) {
+        const int margin = filter.margin();
+        // Tiles whose buffers can overlap are at most reach tiles apart
+        const int reach = (margin + tileSize - 1) / tileSize;
+        const int tileCount = tilesX * tilesY;
+        if (!image) {
+            filterFrame.resize(std::size_t(lastRow - firstRow) * imageWidth * 4);
+            image = filterFrame.data();
+            rowStride = std::size_t(imageWidth) * 4;
+        }
+
+        std::vector<splatRegion> regions(tileCount);
+        // Tiles whose buffers each tile still waits for, and tiles that still have to read each buffer; both are the number of tiles within reach
+        std::unique_ptr<std::atomic<int>[]> waiting(new std::atomic<int>[tileCount]);
+        std::unique_ptr<std::atomic<int>[]> readers(new std::atomic<int>[tileCount]);
+        auto forEachNeighbour = [&](int t, auto&& body) {
+            const int tx = t % tilesX, ty = t / tilesX;
+            for (int ny = std::max(0, ty - reach); ny <= std::min(tilesY - 1, ty + reach); ny++)
+                for (int nx = std::max(0, tx - reach); nx <= std::min(tilesX - 1, tx + reach); nx++)
+                    body(ny * tilesX + nx);
+        };
+        for (int t = 0; t < tileCount; t++) {
+            int neighbours = 0;
+            forEachNeighbour(t, [&](int) { neighbours++; });
+            waiting[t].store(neighbours, std::memory_order_relaxed);
+            readers[t].store(neighbours, std::memory_order_relaxed);
+        }
+        auto tileRect = [&](int t) {
+            imageTile tile;
+            tile.x = (t % tilesX) * tileSize;
+            tile.y = firstRow + (t / tilesX) * tileSize;
+            tile.width = std::min(tileSize, imageWidth - tile.x);
+            tile.height = std::min(tileSize, lastRow - tile.y);
+            return tile;
+        };
+
+        // Sums the buffers overlapping tile t into its pixels, normalizes them and reports the tile
+        auto finish = [&](int t) {
+            imageTile tile = tileRect(t);
+            tile.pixels = image + std::size_t(tile.y - firstRow) * rowStride + std::size_t(tile.x) * 4;
+            tile.rowStride = rowStride;
+            for (int j = 0; j < tile.height; j++)
+                std::fill(tile.pixel(0, j), tile.pixel(0, j) + std::size_t(tile.width) * 4, 0.0f);
+            forEachNeighbour(t, [&](int n) {
+                const splatRegion& region = regions[n];
+                const int x0 = std::max(tile.x, region.x), x1 = std::min(tile.x + tile.width, region.x + region.width);
+                const int y0 = std::max(tile.y, region.y), y1 = std::min(tile.y + tile.height, region.y + region.height);
+                for (int y = y0; y < y1; y++) {
+                    const float* in = &region.sums[(std::size_t(y - region.y) * region.width + (x0 - region.x)) * 4];
+                    float* out = tile.pixel(x0 - tile.x, y - tile.y);
+                    for (int k = 0; k < (x1 - x0) * 4; k++)
+                        out[k] += in[k];
+                }
+            });
+            for (int j = 0; j < tile.height; j++) {
+                for (int i = 0; i < tile.width; i++) {
+                    float* p = tile.pixel(i, j);
+                    const float scale = p[3] > 0 ? 1.0f / p[3] : 0.0f;
+                    p[0] *= scale;
+                    p[1] *= scale;
+                    p[2] *= scale;
+                    p[3] = 1.0f;
+                }
+            }
+            forEachNeighbour(t, [&](int n) {
+                if (readers[n].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    std::vector<float>().swap(regions[n].sums);
+            });
+            tileDone(static_cast<const imageTile&>(tile));
+        };
+
+        forEachItem(tileCount, [&](int t, traceContext& context) {
+            if (cancelled())
+                return;
+            const imageTile tile = tileRect(t);
+            // The traced rows; tiles at the strip's edges add the rows outside it whose samples reach into it
+            const int traceY0 = t / tilesX == 0 ? std::max(0, tile.y - margin) : tile.y;
+            const int traceY1 = t / tilesX == tilesY - 1 ? std::min(imageHeight, tile.y + tile.height + margin) : tile.y + tile.height;
+            splatRegion& region = regions[t];
+            region.x = tile.x - margin;
+            region.y = traceY0 - margin;
+            region.width = tile.width + 2 * margin;
+            region.height = traceY1 - traceY0 + 2 * margin;
+            region.sums.assign(std::size_t(region.width) * region.height * 4, 0.0f);
+
+            {
+                allocationHotPath noAllocation;
+                // Filter weights of the current sample along each axis, for offsets -margin..margin
+                float weightX[15], weightY[15];
+                const int span = 2 * margin + 1;
+                for (int y = traceY0; y < traceY1; y++) {
+                    for (int x = tile.x; x < tile.x + tile.width; x++) {
+                        seedPixel(x, y, 0);
+                        for (int sample = 0; sample < samplesPerPixel; sample++) {
+                            if (cancelled())
+                                return;
+                            const vec3 offset = sampleSquare();
+                            const color c = samplePixel(x, y, offset, world, context);
+                            for (int k = 0; k < span; k++) {
+                                weightX[k] = filter.weight1D(offset.x() - (k - margin));
+                                weightY[k] = filter.weight1D(offset.y() - (k - margin));
+                            }
+                            for (int dy = 0; dy < span; dy++) {
+                                if (weightY[dy] == 0.0f)
+                                    continue;
+                                float* row = &region.sums[(std::size_t(y - region.y - margin + dy) * region.width + (x - region.x - margin)) * 4];
+                                for (int dx = 0; dx < span; dx++) {
+                                    const float w = weightX[dx] * weightY[dy];
+                                    row[dx * 4 + 0] += w * float(c.x());
+                                    row[dx * 4 + 1] += w * float(c.y());
+                                    row[dx * 4 + 2] += w * float(c.z());
+                                    row[dx * 4 + 3] += w;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            forEachNeighbour(t, [&](int n) {
+                if (waiting[n].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    finish(n);
+            });
+        });
+    }
+
+    // Sets the footprint of the hit rec of ray r from the path's ray cone, which starts at the camera with the pixel's spread angle and widens with the distance travelled
+    // Bounces keep the spread, so textures seen through mirrors and glass stay as sharp as seen directly; the cone's width at the hit becomes the width at the next ray's origin
+    void traceFootprint(const ray& r, hitRecord& rec, double& coneWidth) const {
+        rec.footprint = coneWidth + pixelSpread * rec.t * r.direction().length();
+        coneWidth = rec.footprint;
+    }
+
     // Computes the color for a given ray r by checking for intersections with objects in the world
-    color rayColor(const ray& r, int depth, const hittable& world) const {
+    template <typename World>
+    color rayColor(const ray& r, int depth, const World& world, traceContext& context) const {
         // Check if we exceeded the ray bounce limit, no more light is gathered, return black if it does
         if (depth <= 0)
             return color(0,0,0);
 
         // Creates a hitRecord object rec to store details of a possible hit (intersection) between the ray and any object in the world
-        hitRecord rec;
+        typename sceneRecord<World>::type rec;
 
         // If the ray hits an object, the function returns a color based on the object's surface normal
         if (world.hit(r, interval(0.001, infinity), rec)) {
+            traceFootprint(r, rec, context.coneWidth);
             /* Generates a random direction vector that lies within the hemisphere oriented around the surface normal rec.normal
             // rec.normal is the normal vector at the point of intersection (rec.p), randomUnitVector function randomly generating a vector according to Lambertian distribution, and the function randomOnHemisphere() ensures that the random direction is within the hemisphere pointing away from the surface
             vec3 direction = rec.normal + randomUnitVector();
@@ -210,14 +880,156 @@ private:
             // Declares a color variable which stores how much light is absorbed or reflected by the material
             color attenuation;
             // If scatter returns true it updates the above variables
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
+            if (scatterAt(world, r, rec, attenuation, scattered)) {
+                // Counts the scattered ray if it is still within the bounce limit and will therefore be traced
+                if (depth > 1)
+                    context.secondaryRays++;
                 // Recrusively calls rayColor for the scattered ray reducing the depth(the remaining ray bounce count)
                 // Multiplies the resulting color by attenuation to apply the material's reflectivity or absorption
-                return attenuation * rayColor(scattered, depth - 1, world);
+                return attenuation * rayColor(scattered, depth - 1, world, context);
+            }
             // Return black if the ray isn't scattered indicating no light is reflected
             return color(0,0,0);
         }
 
+        return backgroundColor(r);
+    }
+
+    // rayColor for scenes lit by an environment map
+    // bsdfPdf is the solid angle density with which the previous diffuse hit scattered r, or 0 if r is a camera ray or came off a specular surface
+    // Light reaching a diffuse hit is estimated twice, by an environment sample and by the scattered ray; the power heuristic weights the two so their sum stays unbiased
+    template <typename World>
+    color environmentRayColor(const ray& r, int depth, const World& world, traceContext& context, double bsdfPdf) const {
+        if (depth <= 0)
+            return color(0,0,0);
+
+        typename sceneRecord<World>::type rec;
+        if (!world.hit(r, interval(0.001, infinity), rec)) {
+            color light = environment->radiance(r.direction());
+            // Camera rays and specular bounces have no environment sample to share the light with
+            if (bsdfPdf <= 0)
+                return light;
+            return powerHeuristic(bsdfPdf, environment->pdf(r.direction())) * light;
+        }
+        traceFootprint(r, rec, context.coneWidth);
+
+        ray scattered;
+        color attenuation;
+        if (!scatterAt(world, r, rec, attenuation, scattered))
+            return color(0,0,0);
+
+        color albedo;
+        const bool diffuse = environmentSampling && diffuseAlbedoAt(world, rec, albedo);
+        color direct(0,0,0);
+        // Only where the scattered ray could still reach the environment within the bounce limit, so both estimators cover the same paths
+        if (diffuse && depth > 1)
+            direct = sampleEnvironmentLight(world, rec, albedo, context, [](const vec3&, double cosine) { return cosine / pi; });
+
+        if (depth > 1)
+            context.secondaryRays++;
+        double nextPdf = diffuse ? std::max(0.0, dot(unitVector(scattered.direction()), rec.normal)) / pi : 0.0;
+        return direct + attenuation * environmentRayColor(scattered, depth - 1, world, context, nextPdf);
+    }
+
+    // Light of one environment sample arriving at the diffuse hit rec, weighted against the scattering strategy whose solid angle density scatterPdf(direction, cosine) returns
+    template <typename World, typename ScatterPdf>
+    color sampleEnvironmentLight(const World& world, const typename sceneRecord<World>::type& rec, const color& albedo, traceContext& context,
+                                 ScatterPdf&& scatterPdf) const {
+        vec3 direction;
+        double lightPdf;
+        color light;
+        if (!environment->sample(randomDouble(), randomDouble(), direction, lightPdf, light))
+            return color(0,0,0);
+        double cosine = dot(direction, rec.normal);
+        if (cosine <= 0)
+            return color(0,0,0);
+        context.secondaryRays++;
+        if (occluded(world, ray(rec.p, direction)))
+            return color(0,0,0);
+        // Lambertian reflectance is albedo / pi
+        double otherPdf = scatterPdf(direction, cosine);
+        return albedo * light * (cosine / pi * powerHeuristic(lightPdf, otherPdf) / lightPdf);
+    }
+
+    // rayColor with path guiding: at diffuse hits the direction comes from the guide's learned distribution with probability 1 - bsdfSamplingFraction, from lambertian scattering otherwise
+    // The estimate is divided by the density of the mixture, so it stays unbiased however poor the learned distribution is; the radiance found is recorded for the next training iteration
+    // With an environment, light sampling works as in environmentRayColor with the mixture as the scattering strategy; bsdfPdf is the mixture density r was drawn with (0 for camera rays and specular bounces)
+    // Direct light then mostly comes from the light samples, so the guide learns the indirect light, such as the sky focused through glass, that light sampling cannot find
+    template <typename World>
+    color guidedRayColor(const ray& r, int depth, const World& world, traceContext& context, double bsdfPdf) const {
+        if (depth <= 0)
+            return color(0,0,0);
+
+        const bool lightSampling = environment && environmentSampling;
+        typename sceneRecord<World>::type rec;
+        if (!world.hit(r, interval(0.001, infinity), rec)) {
+            if (!lightSampling || bsdfPdf <= 0)
+                return escapedColor(r);
+            return powerHeuristic(bsdfPdf, environment->pdf(r.direction())) * escapedColor(r);
+        }
+        traceFootprint(r, rec, context.coneWidth);
+
+        ray scattered;
+        color attenuation;
+        if (!scatterAt(world, r, rec, attenuation, scattered))
+            return color(0,0,0);
+        if (depth > 1)
+            context.secondaryRays++;
+
+        color albedo;
+        if (!diffuseAlbedoAt(world, rec, albedo))
+            return attenuation * guidedRayColor(scattered, depth - 1, world, context, 0.0);
+
+        guideRegion& region = guide->regionAt(rec.p);
+        const double guideFraction = region.canSample() ? 1 - guide->settings.bsdfSamplingFraction : 0.0;
+        // Density of the mixture for a direction above the surface
+        auto mixturePdf = [&](const vec3& d, double cosine) {
+            return (1 - guideFraction) * cosine / pi + (guideFraction > 0 ? guideFraction * region.pdf(d) : 0.0);
+        };
+        color direct(0,0,0);
+        if (lightSampling && depth > 1)
+            direct = sampleEnvironmentLight(world, rec, albedo, context, mixturePdf);
+
+        vec3 direction = unitVector(scattered.direction());
+        if (guideFraction > 0 && randomDouble() < guideFraction)
+            direction = region.sample(randomDouble(), randomDouble());
+        double cosine = dot(direction, rec.normal);
+        // Learned directions below the surface carry no light
+        if (cosine <= 0)
+            return direct;
+        double pdf = mixturePdf(direction, cosine);
+
+        color incoming = guidedRayColor(ray(rec.p, direction), depth - 1, world, context, pdf);
+        // At the last bounce nothing can arrive, which says nothing about where light comes from
+        if (depth > 1)
+            region.record(direction, luminance(incoming) / pdf);
+        // Lambertian reflectance albedo / pi times the cosine, over the density the direction was drawn with
+        return direct + albedo * incoming * (cosine / (pi * pdf));
+    }
+
+    // Weight of a sample drawn with density pdf when another strategy could have produced it with density otherPdf (power heuristic with exponent 2)
+    static double powerHeuristic(double pdf, double otherPdf) {
+        double a = pdf * pdf, b = otherPdf * otherPdf;
+        return a + b > 0 ? a / (a + b) : 0.0;
+    }
+
+    // Whether anything blocks the ray before it leaves the scene; dynamic worlds skip computing the attributes of the blocking hit
+    template <typename World>
+    static bool occluded(const World& world, const ray& r) {
+        typename sceneRecord<World>::type rec;
+        if constexpr (std::is_base_of_v<hittable, World>)
+            return world.intersect(r, interval(0.001, infinity), rec);
+        else
+            return world.hit(r, interval(0.001, infinity), rec);
+    }
+
+    // Color of a ray that escapes the scene: the environment map if one is set, the sky gradient otherwise
+    color escapedColor(const ray& r) const {
+        return environment ? environment->radiance(r.direction()) : backgroundColor(r);
+    }
+
+    // Built-in sky gradient
+    static color backgroundColor(const ray& r) {
         // Computes the unit vector of the ray direction
         vec3 unitDirection = unitVector(r.direction());
         // Computes a blending factor based on the y-component of the ray's direction
@@ -225,6 +1037,58 @@ private:
         // Blends between white and sky blue based on the ray's direction to create a sky gradient
         return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
     }
+
+    // Batched equivalent of the per-sample rayColor loop for one scanline
+    // All samples of the row are generated up front (at most rayBatchSize at a time); each bounce first sorts the surviving paths for coherence, then intersects and scatters all of them
+    template <typename World>
+    void renderRowBatched(int j, const World& world, std::vector<color>& rowColors, traceContext& context) const {
+        rayBatch& batch = context.batch;
+        // Paths of a row are reordered between bounces, so the batched mode draws one sequence per row instead of one per pixel
+        seedRandom(hashSeed(seed, ~std::uint64_t(j)));
+        std::fill(rowColors.begin(), rowColors.end(), color(0,0,0));
+
+        const int totalSamples = imageWidth * samplesPerPixel;
+        for (int first = 0; first < totalSamples; first += rayBatchSize) {
+            const int last = std::min(totalSamples, first + rayBatchSize);
+
+            // Generates the camera rays of this chunk, each path starts with full throughput
+            batch.paths.clear();
+            for (int s = first; s < last; s++) {
+                int i = s / samplesPerPixel;
+                batch.paths.push_back({ getRay(i, j), color(1,1,1), i });
+            }
+            context.primaryRays += batch.paths.size();
+
+            for (int depth = maxDepth; depth > 0 && !batch.paths.empty(); depth--) {
+                // Camera rays of a scanline are already coherent; only the scattered rays get reordered
+                if (depth < maxDepth) {
+                    context.secondaryRays += batch.paths.size();
+                    batch.sortByCoherence();
+                }
+
+                // Compacts the surviving paths to the front of the batch while advancing them
+                std::size_t alive = 0;
+                for (auto& path : batch.paths) {
+                    typename sceneRecord<World>::type rec;
+                    if (world.hit(path.r, interval(0.001, infinity), rec)) {
+                        traceFootprint(path.r, rec, path.coneWidth);
+                        ray scattered;
+                        color attenuation;
+                        if (scatterAt(world, path.r, rec, attenuation, scattered)) {
+                            path.throughput = path.throughput * attenuation;
+                            path.r = scattered;
+                            batch.paths[alive++] = path;
+                        }
+                        // Absorbed paths contribute black and are dropped
+                    } else {
+                        rowColors[path.pixel] += path.throughput * escapedColor(path.r);
+                    }
+                }
+                batch.paths.resize(alive);
+            }
+            // Paths still alive after maxDepth bounces gather no more light, matching rayColor returning black
+        }
+    }
 };
 
 #endif
\ No newline at end of file
@@ -17,10 +17,8 @@ inline double linearToGamma(double linearComponent) {
     return 0;
 }
 
-// Defines the writeColor function that writes a color (which is a vec3) to an output stream
-// std::ostream& out is parameter for the output stream where the color will be written (e.g., std::cout)
-// const color& pixelColor is a constant reference to the color to avoid copying
-void writeColor(std::ostream& out, const color& pixelColor) {
+// Converts a linear color to gamma-corrected 8-bit components, shared by writeColor and the asynchronous image writer
+inline void colorToBytes(const color& pixelColor, int& rbyte, int& gbyte, int& bbyte) {
     // Retrieves the red, green, and blue components from pixelColor
     auto r = pixelColor.x();
     auto g = pixelColor.y();
@@ -35,9 +33,17 @@ void writeColor(std::ostream& out, const color& pixelColor) {
     // The range is used to clamp color intensity values; ensuring they stay within a valid range for color representation
     static const interval intensity(0.000, 0.999);
     // Multiply the clamped value by 255.999 to scale it to an integer in the range [0, 255], which is the standard range for color in 8-bit RGB format
-    int rbyte = int(255.999 * intensity.clamp(r));
-    int gbyte = int(255.999 * intensity.clamp(g));
-    int bbyte = int(255.999 * intensity.clamp(b));
+    rbyte = int(255.999 * intensity.clamp(r));
+    gbyte = int(255.999 * intensity.clamp(g));
+    bbyte = int(255.999 * intensity.clamp(b));
+}
+
+// Defines the writeColor function that writes a color (which is a vec3) to an output stream
+// std::ostream& out is parameter for the output stream where the color will be written (e.g., std::cout)
+// const color& pixelColor is a constant reference to the color to avoid copying
+inline void writeColor(std::ostream& out, const color& pixelColor) {
+    int rbyte, gbyte, bbyte;
+    colorToBytes(pixelColor, rbyte, gbyte, bbyte);
 
     // Write out the pixel color components
     out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
@@ -0,0 +1,622 @@
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include "camera.h"
+#include "floatImage.h"
+#include "profiling.h"
+#include "scenes.h"
+#include "threadPool.h"
+#include "wideBvh.h"
+
+// Libraries for candidate hooks, baseline files, formatted curves and command line parsing
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Convergence-quality harness: measures how fast the image error falls with time and samples, rather than how many rays per second are traced
+// Every scene gets a high-spp reference render (cached as a PFM file); candidate configurations are then rendered at 1, 2, 4, ... spp and compared against it
+// References are rendered with a different seed than the candidates, so a candidate's noise is never correlated with the reference's own residual noise
+
+// Error of an image against its reference
+class imageError {
+public:
+    // Root mean squared error of the linear RGB values
+    double rmse = 0;
+    // Mean of (test - reference)^2 / (reference^2 + 0.01) over pixels and channels; unlike rmse it weighs dark and bright regions alike
+    double relMse = 0;
+    // Mean perceptual difference in [0,1] of the displayed images, after the structure of NVIDIA's FLIP (see flipError)
+    double flip = 0;
+};
+
+// One channel of an image as a plain array, for the separable filters of the perceptual metric
+class channelImage {
+public:
+    int width = 0, height = 0;
+    std::vector<double> values;
+
+    channelImage(int width, int height) : width(width), height(height), values(std::size_t(width) * height, 0.0) {}
+    double& at(int i, int j) { return values[std::size_t(j) * width + i]; }
+    double at(int i, int j) const { return values[std::size_t(j) * width + i]; }
+};
+
+// Convolves image with the separable kernel horizontal x vertical (both of odd length, centered), clamping at the borders
+inline channelImage convolveSeparable(const channelImage& image, const std::vector<double>& horizontal, const std::vector<double>& vertical) {
+    channelImage rows(image.width, image.height), result(image.width, image.height);
+    const int rx = int(horizontal.size() / 2), ry = int(vertical.size() / 2);
+    for (int j = 0; j < image.height; j++)
+        for (int i = 0; i < image.width; i++) {
+            double sum = 0;
+            for (int k = -rx; k <= rx; k++)
+                sum += horizontal[k + rx] * image.at(std::clamp(i + k, 0, image.width - 1), j);
+            rows.at(i, j) = sum;
+        }
+    for (int j = 0; j < image.height; j++)
+        for (int i = 0; i < image.width; i++) {
+            double sum = 0;
+            for (int k = -ry; k <= ry; k++)
+                sum += vertical[k + ry] * rows.at(i, std::clamp(j + k, 0, image.height - 1));
+            result.at(i, j) = sum;
+        }
+    return result;
+}
+
+// Perceptual error after the structure of FLIP (Andersson et al. 2020, "FLIP: A Difference Evaluator for Alternating Images")
+// Both images are displayed the way the renderer writes them (gamma 2, clamped), filtered with FLIP's contrast sensitivity functions in the linearized YyCxCz opponent space,
+// compared as Hunt-adjusted HyAB color distances and amplified where edges or points differ; the result is the mean per-pixel error in [0,1]
+// It follows the published pipeline closely but is not bit-exact with the reference implementation, so use it for comparing configurations, not against published FLIP numbers
+class flipMetric {
+public:
+    // Observer setup: pixels per degree of visual angle (67 is FLIP's default, a 0.7 m viewing distance from a 4K 32" monitor)
+    explicit flipMetric(double pixelsPerDegree = 67.0) {
+        // Contrast sensitivity functions of the achromatic, red-green and blue-yellow channels as sums of Gaussians in visual degrees
+        csf[0] = spatialFilter(pixelsPerDegree, 1.0, 0.0047, 0.0, 1e-5);
+        csf[1] = spatialFilter(pixelsPerDegree, 1.0, 0.0053, 0.0, 1e-5);
+        csf[2] = spatialFilter(pixelsPerDegree, 34.1, 0.04, 13.5, 0.025);
+
+        // Feature detectors: first and second derivatives of a Gaussian spanning 0.082 degrees
+        const double sigma = 0.5 * 0.082 * pixelsPerDegree;
+        const int radius = int(std::ceil(3 * sigma));
+        for (int x = -radius; x <= radius; x++) {
+            double g = std::exp(-(x * x) / (2 * sigma * sigma));
+            gaussian.push_back(g);
+            edge.push_back(-x * g);
+            point.push_back((x * x / (sigma * sigma) - 1) * g);
+        }
+        normalize(gaussian);
+        normalizeSigned(edge);
+        normalizeSigned(point);
+
+        // Largest color distance, between pure green and pure blue, which the color error is normalized by
+        maxColorDistance = std::pow(huntHyab(labOf(color(0,1,0)), labOf(color(0,0,1))), 0.7);
+    }
+
+    double meanError(const floatImage& test, const floatImage& reference) const {
+        const int w = reference.width, h = reference.height;
+        channelImage testYcc[3] = { channelImage(w, h), channelImage(w, h), channelImage(w, h) };
+        channelImage referenceYcc[3] = { channelImage(w, h), channelImage(w, h), channelImage(w, h) };
+        for (int j = 0; j < h; j++)
+            for (int i = 0; i < w; i++) {
+                auto t = ycxczOf(display(test.at(i, j)));
+                auto r = ycxczOf(display(reference.at(i, j)));
+                for (int c = 0; c < 3; c++) {
+                    testYcc[c].at(i, j) = t[c];
+                    referenceYcc[c].at(i, j) = r[c];
+                }
+            }
+
+        // Color pipeline: spatial filtering, then the perceptual distance of the filtered colors
+        channelImage testFiltered[3] = { filter(testYcc[0], 0), filter(testYcc[1], 1), filter(testYcc[2], 2) };
+        channelImage referenceFiltered[3] = { filter(referenceYcc[0], 0), filter(referenceYcc[1], 1), filter(referenceYcc[2], 2) };
+
+        // Feature pipeline on the normalized achromatic channel of the unfiltered images
+        auto testEdges = featureMagnitude(testYcc[0], edge);
+        auto testPoints = featureMagnitude(testYcc[0], point);
+        auto referenceEdges = featureMagnitude(referenceYcc[0], edge);
+        auto referencePoints = featureMagnitude(referenceYcc[0], point);
+
+        double total = 0;
+        for (int j = 0; j < h; j++)
+            for (int i = 0; i < w; i++) {
+                auto t = labOf(linearOfYcxcz(vec3(testFiltered[0].at(i, j), testFiltered[1].at(i, j), testFiltered[2].at(i, j))));
+                auto r = labOf(linearOfYcxcz(vec3(referenceFiltered[0].at(i, j), referenceFiltered[1].at(i, j), referenceFiltered[2].at(i, j))));
+                double colorError = remapColorError(std::pow(huntHyab(t, r), 0.7));
+
+                double featureDifference = std::max(std::fabs(testEdges.at(i, j) - referenceEdges.at(i, j)),
+                                                    std::fabs(testPoints.at(i, j) - referencePoints.at(i, j)));
+                double featureError = std::pow(featureDifference / std::sqrt(2.0), 0.5);
+                total += std::pow(colorError, 1 - std::min(1.0, featureError));
+            }
+        return total / (double(w) * h);
+    }
+
+private:
+    std::vector<double> csf[3];
+    std::vector<double> gaussian, edge, point;
+    double maxColorDistance = 1;
+
+    // Reference white of the D65 XYZ conversions
+    static vec3 whitePoint() { return xyzOf(color(1,1,1)); }
+
+    static std::vector<double> spatialFilter(double pixelsPerDegree, double a1, double b1, double a2, double b2) {
+        const double widest = std::max(b1, b2);
+        const int radius = int(std::ceil(3 * std::sqrt(widest / (2 * pi * pi)) * pixelsPerDegree));
+        std::vector<double> kernel;
+        for (int x = -radius; x <= radius; x++) {
+            double degrees = x / pixelsPerDegree;
+            kernel.push_back(a1 * std::sqrt(pi / b1) * std::exp(-pi * pi * degrees * degrees / b1)
+                           + a2 * std::sqrt(pi / b2) * std::exp(-pi * pi * degrees * degrees / b2));
+        }
+        normalize(kernel);
+        return kernel;
+    }
+
+    static void normalize(std::vector<double>& kernel) {
+        double sum = 0;
+        for (double k : kernel)
+            sum += k;
+        for (double& k : kernel)
+            k /= sum;
+    }
+
+    // Scales the positive weights to sum to 1 and the negative ones to -1, as FLIP does for its feature kernels
+    static void normalizeSigned(std::vector<double>& kernel) {
+        double positive = 0, negative = 0;
+        for (double k : kernel)
+            (k > 0 ? positive : negative) += k;
+        for (double& k : kernel)
+            k = k > 0 ? k / positive : (k < 0 ? k / -negative : 0);
+    }
+
+    channelImage filter(const channelImage& channel, int index) const {
+        return convolveSeparable(channel, csf[index], csf[index]);
+    }
+
+    // Length of the feature response (gradient for edges, second derivatives for points) of the achromatic channel normalized to [0,1]
+    channelImage featureMagnitude(const channelImage& achromatic, const std::vector<double>& kernel) const {
+        channelImage normalized(achromatic.width, achromatic.height);
+        for (std::size_t p = 0; p < normalized.values.size(); p++)
+            normalized.values[p] = (achromatic.values[p] + 16) / 116;
+        auto dx = convolveSeparable(normalized, kernel, gaussian);
+        auto dy = convolveSeparable(normalized, gaussian, kernel);
+        for (std::size_t p = 0; p < dx.values.size(); p++)
+            dx.values[p] = std::sqrt(dx.values[p] * dx.values[p] + dy.values[p] * dy.values[p]);
+        return dx;
+    }
+
+    // Displayed color of a linear pixel: gamma 2 like the PPM output, clamped to the displayable range
+    static color display(const color& c) {
+        return color(std::clamp(linearToGamma(c.x()), 0.0, 1.0), std::clamp(linearToGamma(c.y()), 0.0, 1.0), std::clamp(linearToGamma(c.z()), 0.0, 1.0));
+    }
+
+    static double srgbToLinear(double v) {
+        return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+    }
+
+    static vec3 xyzOf(const color& linear) {
+        return vec3(0.4124564 * linear.x() + 0.3575761 * linear.y() + 0.1804375 * linear.z(),
+                    0.2126729 * linear.x() + 0.7151522 * linear.y() + 0.0721750 * linear.z(),
+                    0.0193339 * linear.x() + 0.1191920 * linear.y() + 0.9503041 * linear.z());
+    }
+
+    static color linearOfXyz(const vec3& xyz) {
+        return color( 3.2404542 * xyz.x() - 1.5371385 * xyz.y() - 0.4985314 * xyz.z(),
+                     -0.9692660 * xyz.x() + 1.8760108 * xyz.y() + 0.0415560 * xyz.z(),
+                      0.0556434 * xyz.x() - 0.2040259 * xyz.y() + 1.0572252 * xyz.z());
+    }
+
+    // Linearized CIELab of a displayed (sRGB encoded) color
+    static vec3 ycxczOf(const color& displayed) {
+        auto xyz = xyzOf(color(srgbToLinear(displayed.x()), srgbToLinear(displayed.y()), srgbToLinear(displayed.z())));
+        auto white = whitePoint();
+        double x = xyz.x() / white.x(), y = xyz.y() / white.y(), z = xyz.z() / white.z();
+        return vec3(116 * y - 16, 500 * (x - y), 200 * (y - z));
+    }
+
+    // Linear RGB of a filtered YyCxCz color, clamped to the gamut the way FLIP does before measuring distances
+    static color linearOfYcxcz(const vec3& ycc) {
+        auto white = whitePoint();
+        double y = (ycc.x() + 16) / 116;
+        double x = ycc.y() / 500 + y;
+        double z = y - ycc.z() / 200;
+        auto rgb = linearOfXyz(vec3(x * white.x(), y * white.y(), z * white.z()));
+        return color(std::clamp(rgb.x(), 0.0, 1.0), std::clamp(rgb.y(), 0.0, 1.0), std::clamp(rgb.z(), 0.0, 1.0));
+    }
+
+    static vec3 labOf(const color& linear) {
+        auto xyz = xyzOf(linear);
+        auto white = whitePoint();
+        auto f = [](double t) { return t > 216.0 / 24389.0 ? std::cbrt(t) : (24389.0 / 27.0 * t + 16) / 116; };
+        double fx = f(xyz.x() / white.x()), fy = f(xyz.y() / white.y()), fz = f(xyz.z() / white.z());
+        return vec3(116 * fy - 16, 500 * (fx - fy), 200 * (fy - fz));
+    }
+
+    // HyAB distance of two Lab colors after the Hunt effect adjustment, which damps chroma differences of dark colors
+    static double huntHyab(const vec3& a, const vec3& b) {
+        double da = 0.01 * a.x() * a.y() - 0.01 * b.x() * b.y();
+        double db = 0.01 * a.x() * a.z() - 0.01 * b.x() * b.z();
+        return std::fabs(a.x() - b.x()) + std::sqrt(da * da + db * db);
+    }
+
+    // FLIP's compression of color distances into [0,1]: small distances are stretched, large ones compressed
+    double remapColorError(double distance) const {
+        const double pc = 0.4, pt = 0.95;
+        if (distance < pc * maxColorDistance)
+            return pt / (pc * maxColorDistance) * distance;
+        return std::min(1.0, pt + (distance - pc * maxColorDistance) / (maxColorDistance - pc * maxColorDistance) * (1 - pt));
+    }
+};
+
+// Computes every error metric of test against reference; both images must have the same size
+inline imageError compareImages(const floatImage& test, const floatImage& reference, const flipMetric& flip = flipMetric()) {
+    imageError error;
+    double squared = 0, relative = 0;
+    for (std::size_t p = 0; p < reference.pixels.size(); p++) {
+        double difference = double(test.pixels[p]) - reference.pixels[p];
+        squared += difference * difference;
+        relative += difference * difference / (double(reference.pixels[p]) * reference.pixels[p] + 0.01);
+    }
+    const double count = double(std::max<std::size_t>(1, reference.pixels.size()));
+    error.rmse = std::sqrt(squared / count);
+    error.relMse = relative / count;
+    error.flip = flip.meanError(test, reference);
+    return error;
+}
+
+// Fixed scene of the harness: the objects and the camera looking at them
+class convergenceScene {
+public:
+    std::string name;
+    hittableList world;
+    camera cam;
+};
+
+// Names of the built-in scenes: the final render and the two test scenes of the playground in main()
+inline std::vector<std::string> convergenceSceneNames() {
+    return { "final", "materials", "touching" };
+}
+
+// Builds the scene called name; returns false for an unknown name
+inline bool makeConvergenceScene(const std::string& name, convergenceScene& scene) {
+    scene.name = name;
+    if (name == "final") {
+        // The scene's random numbers come from a fixed seed so every run measures the same spheres
+        seedRandom(1);
+        scene.world = randomSphereField(11);
+        scene.cam = finalRenderCamera();
+    } else if (name == "materials") {
+        scene.world = materialSpheres();
+        scene.cam = materialSpheresCamera();
+    } else if (name == "touching") {
+        scene.world = touchingSpheres();
+        scene.cam = touchingSpheresCamera();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Configuration under test: a name and how it changes the camera of every scene
+// New samplers, integrators or precision modes are compared by adding a candidate that switches them on
+class convergenceCandidate {
+public:
+    std::string name;
+    std::function<void(camera&)> configure;
+};
+
+// The built-in candidates: the final render's settings and two shorter path lengths, which trade bias for speed
+inline std::vector<convergenceCandidate> defaultConvergenceCandidates() {
+    return {
+        { "depth50", [](camera& cam) { cam.maxDepth = 50; } },
+        { "depth16", [](camera& cam) { cam.maxDepth = 16; } },
+        { "depth4",  [](camera& cam) { cam.maxDepth = 4; } },
+    };
+}
+
+// Settings of a harness run
+class convergenceOptions {
+public:
+    std::vector<std::string> scenes = convergenceSceneNames();
+    // Image width of every render; the height follows each scene's aspect ratio
+    int width = 160;
+    int referenceSpp = 1024;
+    // Candidates are rendered at every power of two up to maxSpp
+    int maxSpp = 64;
+    // Threads per render including the calling one; 0 = one per hardware thread
+    unsigned threads = 0;
+    // Directory the reference PFM files are cached in
+    std::string referenceDir = ".";
+    // Relative amount an error may exceed its baseline before the check fails
+    double tolerance = 0.02;
+};
+
+// One point of a convergence curve
+class convergencePoint {
+public:
+    std::string scene;
+    std::string candidate;
+    int samplesPerPixel = 0;
+    double seconds = 0;
+    imageError error;
+
+    // Monte Carlo efficiency, 1 / (relMse * seconds): higher means more quality per second, and it stays comparable across sample counts
+    double efficiency() const { return 1.0 / std::max(1e-300, error.relMse * seconds); }
+};
+
+// Renders world through cam at spp samples per pixel into a linear image, timing only the render itself
+template <typename World>
+floatImage renderLinear(const World& world, camera cam, int spp, std::uint64_t seed, threadPool* pool, double& seconds) {
+    cam.samplesPerPixel = spp;
+    cam.seed = seed;
+    cam.pool = pool;
+    cam.output = nullptr;
+    cam.progressLog = nullptr;
+    const int height = cam.outputHeight();
+    std::vector<float> rgba(std::size_t(cam.imageWidth) * height * 4);
+    stopwatch timer;
+    cam.renderTiles(world, 32, rgba.data(), std::size_t(cam.imageWidth) * 4, [](const imageTile&) {});
+    seconds = timer.seconds();
+
+    floatImage image(cam.imageWidth, height);
+    for (std::size_t p = 0; p < std::size_t(cam.imageWidth) * height; p++)
+        for (int c = 0; c < 3; c++)
+            image.pixels[3 * p + c] = rgba[4 * p + c];
+    return image;
+}
+
+// Seed of the reference renders, unrelated to the candidates' seed 1
+const std::uint64_t referenceSeed = 0x9e3779b97f4a7c15ull;
+
+// Runs the harness: loads or renders each scene's reference, then renders every candidate at 1, 2, 4, ... maxSpp spp; progress goes to log
+// Returns false and sets error if a scene is unknown or a reference cannot be cached
+inline bool runConvergence(const convergenceOptions& options, const std::vector<convergenceCandidate>& candidates, std::vector<convergencePoint>& points,
+                           std::string& error, std::ostream& log) {
+    std::unique_ptr<threadPool> pool;
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    if (threads > 1)
+        pool = std::make_unique<threadPool>(threads - 1);
+    const flipMetric flip;
+
+    for (const auto& sceneName : options.scenes) {
+        convergenceScene scene;
+        if (!makeConvergenceScene(sceneName, scene)) {
+            error = "unknown scene " + sceneName;
+            return false;
+        }
+        scene.cam.imageWidth = options.width;
+        wideBvh world(scene.world);
+
+        // The reference is cached per scene, width and sample count, so repeated runs only pay for the candidates
+        std::ostringstream referencePath;
+        referencePath << options.referenceDir << '/' << sceneName << "-w" << options.width << "-spp" << options.referenceSpp << ".pfm";
+        floatImage reference;
+        std::string readError;
+        if (!readPfm(referencePath.str(), reference, readError) || reference.width != options.width || reference.height != scene.cam.outputHeight()) {
+            log << "Rendering reference " << referencePath.str() << " (" << options.referenceSpp << " spp)\n";
+            double seconds = 0;
+            reference = renderLinear(world, scene.cam, options.referenceSpp, referenceSeed, pool.get(), seconds);
+            log << "  " << seconds << " s\n";
+            if (!writePfm(referencePath.str(), reference)) {
+                error = "cannot write " + referencePath.str();
+                return false;
+            }
+        }
+
+        for (const auto& candidate : candidates) {
+            camera cam = scene.cam;
+            if (candidate.configure)
+                candidate.configure(cam);
+            for (int spp = 1; spp <= options.maxSpp; spp *= 2) {
+                convergencePoint point;
+                point.scene = sceneName;
+                point.candidate = candidate.name;
+                point.samplesPerPixel = spp;
+                auto image = renderLinear(world, cam, spp, 1, pool.get(), point.seconds);
+                point.error = compareImages(image, reference, flip);
+                log << "  " << sceneName << ' ' << candidate.name << ' ' << spp << " spp: relMSE " << point.error.relMse
+                    << ", FLIP " << point.error.flip << ", " << point.seconds << " s\n";
+                points.push_back(point);
+            }
+        }
+    }
+    return true;
+}
+
+// Writes the curves as CSV, one row per point
+inline void writeConvergenceCsv(std::ostream& out, const std::vector<convergencePoint>& points) {
+    out << "scene,candidate,spp,seconds,rmse,relmse,flip,efficiency\n" << std::setprecision(9);
+    for (const auto& point : points)
+        out << point.scene << ',' << point.candidate << ',' << point.samplesPerPixel << ',' << point.seconds << ','
+            << point.error.rmse << ',' << point.error.relMse << ',' << point.error.flip << ',' << point.efficiency() << '\n';
+}
+
+// Writes the curves as JSON: an array with one object per scene and candidate holding its points
+inline void writeConvergenceJson(std::ostream& out, const std::vector<convergencePoint>& points) {
+    out << "[\n" << std::setprecision(9);
+    for (std::size_t p = 0; p < points.size(); p++) {
+        const auto& point = points[p];
+        bool first = p == 0 || points[p - 1].scene != point.scene || points[p - 1].candidate != point.candidate;
+        bool last = p + 1 == points.size() || points[p + 1].scene != point.scene || points[p + 1].candidate != point.candidate;
+        if (first)
+            out << "  {\"scene\": \"" << point.scene << "\", \"candidate\": \"" << point.candidate << "\", \"points\": [\n";
+        out << "    {\"spp\": " << point.samplesPerPixel << ", \"seconds\": " << point.seconds << ", \"rmse\": " << point.error.rmse
+            << ", \"relmse\": " << point.error.relMse << ", \"flip\": " << point.error.flip << ", \"efficiency\": " << point.efficiency() << '}'
+            << (last ? "\n" : ",\n");
+        if (last)
+            out << "  ]}" << (p + 1 == points.size() ? "\n" : ",\n");
+    }
+    out << "]\n";
+}
+
+// Stored final points of earlier runs, one line per scene and candidate: "<scene> | <candidate> | spp=<n> rmse=<e> relmse=<e> flip=<e> seconds=<s>"
+// Errors are reproducible since every render is seeded, so they are checked tightly; times differ between machines and only inform the efficiency comparison
+class convergenceBaselines {
+public:
+    explicit convergenceBaselines(std::string path) : path(std::move(path)) {
+        std::ifstream in(this->path);
+        std::string line;
+        while (std::getline(in, line)) {
+            auto separator = line.rfind(" | ");
+            if (separator == std::string::npos || separator == 0)
+                continue;
+            convergencePoint point;
+            if (parse(line.substr(separator + 3), point))
+                entries[line.substr(0, separator)] = point;
+        }
+    }
+
+    bool find(const std::string& scene, const std::string& candidate, convergencePoint& point) const {
+        auto entry = entries.find(scene + " | " + candidate);
+        if (entry == entries.end())
+            return false;
+        point = entry->second;
+        return true;
+    }
+
+    void store(const convergencePoint& point) {
+        entries[point.scene + " | " + point.candidate] = point;
+    }
+
+    bool save() const {
+        std::ofstream out(path, std::ios::trunc);
+        out << std::setprecision(9);
+        for (const auto& [key, point] : entries)
+            out << key << " | spp=" << point.samplesPerPixel << " rmse=" << point.error.rmse << " relmse=" << point.error.relMse
+                << " flip=" << point.error.flip << " seconds=" << point.seconds << '\n';
+        return bool(out);
+    }
+
+private:
+    std::string path;
+    std::map<std::string, convergencePoint> entries;
+
+    static bool parse(const std::string& text, convergencePoint& point) {
+        std::istringstream fields(text);
+        std::string field;
+        while (fields >> field) {
+            auto equals = field.find('=');
+            if (equals == std::string::npos)
+                return false;
+            auto key = field.substr(0, equals);
+            auto value = std::atof(field.substr(equals + 1).c_str());
+            if (key == "spp")          point.samplesPerPixel = int(value);
+            else if (key == "rmse")    point.error.rmse = value;
+            else if (key == "relmse")  point.error.relMse = value;
+            else if (key == "flip")    point.error.flip = value;
+            else if (key == "seconds") point.seconds = value;
+        }
+        return point.samplesPerPixel > 0;
+    }
+};
+
+// Compares the last point of every curve with its baseline and prints a pass/fail line per curve
+// A curve fails when any error metric exceeds the baseline by more than tolerance or it was measured at a different spp; curves without a baseline are reported but pass
+inline bool checkConvergenceBaselines(const std::vector<convergencePoint>& points, const convergenceBaselines& baselines, double tolerance, std::ostream& out) {
+    bool passed = true;
+    out << std::left << std::setw(12) << "scene" << std::setw(12) << "candidate" << std::right << std::setw(14) << "relMSE"
+        << std::setw(12) << "vs base" << std::setw(12) << "FLIP" << std::setw(12) << "vs base" << std::setw(14) << "efficiency" << "  result\n";
+    for (std::size_t p = 0; p < points.size(); p++) {
+        const auto& point = points[p];
+        if (p + 1 < points.size() && points[p + 1].scene == point.scene && points[p + 1].candidate == point.candidate)
+            continue;
+
+        out << std::left << std::setw(12) << point.scene << std::setw(12) << point.candidate << std::right << std::setprecision(4)
+            << std::setw(14) << point.error.relMse;
+        convergencePoint baseline;
+        if (!baselines.find(point.scene, point.candidate, baseline)) {
+            out << std::setw(12) << "-" << std::setw(12) << point.error.flip << std::setw(12) << "-" << std::setw(14) << "-" << "  no baseline\n";
+            continue;
+        }
+        auto ratio = [](double value, double base) { return base > 0 ? value / base : (value > 0 ? infinity : 1.0); };
+        double relMseRatio = ratio(point.error.relMse, baseline.error.relMse);
+        double flipRatio = ratio(point.error.flip, baseline.error.flip);
+        double rmseRatio = ratio(point.error.rmse, baseline.error.rmse);
+        bool ok = point.samplesPerPixel == baseline.samplesPerPixel
+               && relMseRatio <= 1 + tolerance && flipRatio <= 1 + tolerance && rmseRatio <= 1 + tolerance;
+        passed = passed && ok;
+        out << std::setw(12) << relMseRatio << std::setw(12) << point.error.flip << std::setw(12) << flipRatio
+            << std::setw(14) << point.efficiency() / baseline.efficiency() << "  " << (ok ? "pass" : "FAIL") << '\n';
+    }
+    out << (passed ? "convergence check passed" : "CONVERGENCE CHECK FAILED") << '\n';
+    return passed;
+}
+
+// Command line of the harness: WeekendfunRayTracing --convergence [options]
+//   --scenes a,b,...  --width <pixels>  --reference-spp <n>  --max-spp <n>  --threads <n>  --reference-dir <dir>
+//   --curves <file> (default stdout)  --format csv|json  --baseline <file>  --update-baseline  --tolerance <fraction>
+// Returns the process exit code: 1 for bad arguments, failed output or a failed baseline check
+inline int runConvergenceHarness(const std::vector<std::string>& args) {
+    convergenceOptions options;
+    std::string curvesPath, format = "csv", baselinePath;
+    bool updateBaseline = false;
+    for (std::size_t a = 0; a < args.size(); a++) {
+        const auto& arg = args[a];
+        bool hasValue = a + 1 < args.size();
+        if (arg == "--scenes" && hasValue) {
+            options.scenes.clear();
+            std::istringstream names(args[++a]);
+            std::string name;
+            while (std::getline(names, name, ','))
+                if (!name.empty())
+                    options.scenes.push_back(name);
+        }
+        else if (arg == "--width" && hasValue)          options.width = std::max(1, std::atoi(args[++a].c_str()));
+        else if (arg == "--reference-spp" && hasValue)  options.referenceSpp = std::max(1, std::atoi(args[++a].c_str()));
+        else if (arg == "--max-spp" && hasValue)        options.maxSpp = std::max(1, std::atoi(args[++a].c_str()));
+        else if (arg == "--threads" && hasValue)        options.threads = unsigned(std::atoi(args[++a].c_str()));
+        else if (arg == "--reference-dir" && hasValue)  options.referenceDir = args[++a];
+        else if (arg == "--curves" && hasValue)         curvesPath = args[++a];
+        else if (arg == "--format" && hasValue)         format = args[++a];
+        else if (arg == "--baseline" && hasValue)       baselinePath = args[++a];
+        else if (arg == "--tolerance" && hasValue)      options.tolerance = std::atof(args[++a].c_str());
+        else if (arg == "--update-baseline")            updateBaseline = true;
+        else {
+            std::cerr << "unknown convergence option " << arg << '\n';
+            return 1;
+        }
+    }
+    if (format != "csv" && format != "json") {
+        std::cerr << "unknown curve format " << format << " (csv or json)\n";
+        return 1;
+    }
+
+    std::vector<convergencePoint> points;
+    std::string error;
+    if (!runConvergence(options, defaultConvergenceCandidates(), points, error, std::clog)) {
+        std::cerr << error << '\n';
+        return 1;
+    }
+
+    std::ofstream curvesFile;
+    if (!curvesPath.empty())
+        curvesFile.open(curvesPath, std::ios::trunc);
+    std::ostream& curves = curvesPath.empty() ? std::cout : curvesFile;
+    if (format == "json")
+        writeConvergenceJson(curves, points);
+    else
+        writeConvergenceCsv(curves, points);
+    if (!curves.flush()) {
+        std::cerr << "cannot write " << curvesPath << '\n';
+        return 1;
+    }
+
+    if (baselinePath.empty())
+        return 0;
+    convergenceBaselines baselines(baselinePath);
+    if (updateBaseline) {
+        for (const auto& point : points)
+            baselines.store(point);
+        if (!baselines.save()) {
+            std::cerr << "cannot write " << baselinePath << '\n';
+            return 1;
+        }
+        std::clog << "Baselines written to " << baselinePath << '\n';
+        return 0;
+    }
+    return checkConvergenceBaselines(points, baselines, options.tolerance, std::clog) ? 0 : 1;
+}
+
+#endif
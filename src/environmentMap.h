@@ -0,0 +1,337 @@
+#ifndef ENVIRONMENTMAP_H
+#define ENVIRONMENTMAP_H
+
+#include "floatImage.h"
+#include "framebuffer.h"
+#include "profiling.h"
+#include "threadPool.h"
+
+// Libraries for the sampling tables, file decoding and binary searches
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Reads a Radiance RGBE (.hdr) image into image; decoding the scanlines is sequential, converting RGBE to floats is spread over pool when given
+// Supports the standard -Y H +X W orientation with flat, old-style run-length and adaptive run-length encoded scanlines
+inline bool readRadianceHdr(const std::string& path, floatImage& image, std::string& error, threadPool* pool = nullptr) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string line;
+    std::getline(file, line);
+    if (line.rfind("#?", 0) != 0) {
+        error = path + ": not a Radiance HDR image";
+        return false;
+    }
+    // Header lines up to the blank line; only the RGBE pixel format is supported
+    while (std::getline(file, line) && !line.empty()) {
+        if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+            error = path + ": unsupported pixel format " + line.substr(7);
+            return false;
+        }
+    }
+    std::getline(file, line);
+    char ySign = 0, xSign = 0;
+    int width = 0, height = 0;
+    if (std::sscanf(line.c_str(), "%cY %d %cX %d", &ySign, &height, &xSign, &width) != 4 || ySign != '-' || xSign != '+' || width <= 0 || height <= 0) {
+        error = path + ": unsupported resolution line '" + line + "'";
+        return false;
+    }
+    // The rest of the file is read in one go
+    auto start = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::vector<unsigned char> data(std::size_t(file.tellg() - start));
+    file.seekg(start);
+    file.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+
+    // Decodes every scanline into 4 bytes per pixel
+    std::vector<unsigned char> rgbe(std::size_t(width) * height * 4);
+    std::size_t at = 0;
+    auto truncated = [&] {
+        error = path + ": truncated pixel data";
+        return false;
+    };
+    for (int j = 0; j < height; j++) {
+        unsigned char* row = &rgbe[std::size_t(j) * width * 4];
+        if (width >= 8 && width < 0x8000 && at + 4 <= data.size() && data[at] == 2 && data[at + 1] == 2 && (data[at + 2] & 0x80) == 0) {
+            // Adaptive run-length encoding: the four components are stored one after the other, each as runs and literal spans
+            if (((data[at + 2] << 8) | data[at + 3]) != width) {
+                error = path + ": scanline width mismatch";
+                return false;
+            }
+            at += 4;
+            for (int component = 0; component < 4; component++) {
+                for (int i = 0; i < width;) {
+                    if (at >= data.size())
+                        return truncated();
+                    int count = data[at++];
+                    if (count > 128) {
+                        count -= 128;
+                        if (at >= data.size() || i + count > width)
+                            return truncated();
+                        unsigned char value = data[at++];
+                        for (; count > 0; count--)
+                            row[4 * i++ + component] = value;
+                    } else {
+                        if (count == 0 || at + count > data.size() || i + count > width)
+                            return truncated();
+                        for (; count > 0; count--)
+                            row[4 * i++ + component] = data[at++];
+                    }
+                }
+            }
+        } else {
+            // Flat pixels, where (1,1,1,n) repeats the previous pixel n << shift times
+            int shift = 0;
+            for (int i = 0; i < width;) {
+                if (at + 4 > data.size())
+                    return truncated();
+                const unsigned char* pixel = &data[at];
+                at += 4;
+                if (pixel[0] == 1 && pixel[1] == 1 && pixel[2] == 1) {
+                    if (i == 0)
+                        return truncated();
+                    int count = pixel[3] << shift;
+                    for (; count > 0 && i < width; count--, i++)
+                        std::copy(row + 4 * (i - 1), row + 4 * i, row + 4 * i);
+                    shift += 8;
+                } else {
+                    std::copy(pixel, pixel + 4, row + 4 * i++);
+                    shift = 0;
+                }
+            }
+        }
+    }
+
+    // Scale of every shared exponent, with the mantissas taken at the center of their quantization step like Radiance does
+    float exponentScale[256];
+    for (int e = 0; e < 256; e++)
+        exponentScale[e] = e == 0 ? 0.0f : std::ldexp(1.0f, e - (128 + 8));
+
+    image = floatImage(width, height);
+    auto convertRow = [&](int j, int) {
+        for (int i = 0; i < width; i++) {
+            const unsigned char* pixel = &rgbe[(std::size_t(j) * width + i) * 4];
+            float* out = &image.pixels[(std::size_t(j) * width + i) * 3];
+            float scale = exponentScale[pixel[3]];
+            for (int c = 0; c < 3; c++)
+                out[c] = (pixel[c] + 0.5f) * scale;
+        }
+    };
+    if (pool)
+        pool->parallelFor(height, convertRow);
+    else
+        for (int j = 0; j < height; j++)
+            convertRow(j, 0);
+    return true;
+}
+
+// Writes image as a Radiance RGBE (.hdr) file with adaptive run-length encoded scanlines
+inline bool writeRadianceHdr(const std::string& path, const floatImage& image) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << image.height << " +X " << image.width << '\n';
+    const int width = image.width;
+    std::vector<unsigned char> rgbe(std::size_t(width) * 4);
+    std::vector<unsigned char> encoded;
+    for (int j = 0; j < image.height && file; j++) {
+        for (int i = 0; i < width; i++) {
+            color c = image.at(i, j);
+            double largest = std::max({ c.x(), c.y(), c.z() });
+            unsigned char* pixel = &rgbe[std::size_t(i) * 4];
+            if (largest < 1e-32) {
+                pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+                continue;
+            }
+            int exponent;
+            double scale = std::frexp(largest, &exponent) * 256.0 / largest;
+            for (int k = 0; k < 3; k++)
+                pixel[k] = (unsigned char)std::clamp(int(c[k] * scale), 0, 255);
+            pixel[3] = (unsigned char)(exponent + 128);
+        }
+
+        // Widths outside what the run-length header can express are written flat
+        if (width < 8 || width >= 0x8000) {
+            file.write(reinterpret_cast<const char*>(rgbe.data()), std::streamsize(rgbe.size()));
+            continue;
+        }
+        encoded.assign({ 2, 2, (unsigned char)(width >> 8), (unsigned char)(width & 0xff) });
+        for (int component = 0; component < 4; component++) {
+            auto value = [&](int i) { return rgbe[std::size_t(i) * 4 + component]; };
+            for (int i = 0; i < width;) {
+                // Runs of at least 3 equal bytes are worth a run code, everything else goes into literal spans of up to 128 bytes
+                int run = 1;
+                while (i + run < width && run < 127 && value(i + run) == value(i))
+                    run++;
+                if (run >= 3) {
+                    encoded.push_back((unsigned char)(128 + run));
+                    encoded.push_back(value(i));
+                    i += run;
+                    continue;
+                }
+                int start = i, count = 0;
+                while (i < width && count < 128) {
+                    if (i + 2 < width && value(i) == value(i + 1) && value(i) == value(i + 2))
+                        break;
+                    i++;
+                    count++;
+                }
+                encoded.push_back((unsigned char)count);
+                for (int k = start; k < start + count; k++)
+                    encoded.push_back(value(k));
+            }
+        }
+        file.write(reinterpret_cast<const char*>(encoded.data()), std::streamsize(encoded.size()));
+    }
+    return bool(file);
+}
+
+// Distant light surrounding the scene, given as an equirectangular (latitude-longitude) HDR image
+// The image's top row looks straight up (+y) and its horizontal center looks down -z, the default viewing direction of the camera
+// Radiance is piecewise constant per pixel; directions are importance-sampled with a 2D table built from pixel luminance times the solid angle the pixel covers
+class environmentMap {
+public:
+    // Multiplies every radiance value
+    double intensity = 1.0;
+
+    // Turns the environment around the vertical axis, in degrees
+    double rotation = 0;
+
+    // Loads a .pfm or .hdr file and builds the sampling tables; pool, when given, spreads decoding and table building over its threads
+    bool load(const std::string& path, std::string& error, threadPool* pool = nullptr) {
+        stopwatch timer;
+        floatImage loaded;
+        bool isHdr = path.size() > 4 && (path.compare(path.size() - 4, 4, ".hdr") == 0 || path.compare(path.size() - 4, 4, ".HDR") == 0);
+        if (!(isHdr ? readRadianceHdr(path, loaded, error, pool) : readPfm(path, loaded, error)))
+            return false;
+        loadSeconds = timer.seconds();
+        setImage(std::move(loaded), pool);
+        return true;
+    }
+
+    // Uses image as the environment and builds the sampling tables
+    void setImage(floatImage image, threadPool* pool = nullptr) {
+        stopwatch timer;
+        map = std::move(image);
+        const int w = map.width, h = map.height;
+        conditionalCdf.assign(std::size_t(w + 1) * h, 0.0);
+        rowWeight.assign(h, 0.0);
+
+        // Per row: the running sums of luminance times sin(theta), the Jacobian of the latitude-longitude mapping; rows are independent and built in parallel
+        auto buildRow = [&](int j, int) {
+            double sinTheta = std::sin(pi * (j + 0.5) / h);
+            double* cdf = &conditionalCdf[std::size_t(j) * (w + 1)];
+            cdf[0] = 0;
+            for (int i = 0; i < w; i++)
+                cdf[i + 1] = cdf[i] + std::max(0.0, luminance(map.at(i, j))) * sinTheta;
+            rowWeight[j] = cdf[w];
+        };
+        if (pool)
+            pool->parallelFor(h, buildRow);
+        else
+            for (int j = 0; j < h; j++)
+                buildRow(j, 0);
+
+        marginalCdf.assign(h + 1, 0.0);
+        for (int j = 0; j < h; j++)
+            marginalCdf[j + 1] = marginalCdf[j] + rowWeight[j];
+        totalWeight = marginalCdf[h];
+        buildSeconds = timer.seconds();
+    }
+
+    int width() const { return map.width; }
+    int height() const { return map.height; }
+
+    // Time spent reading the file and building the tables by the last load/setImage
+    double loadSeconds = 0;
+    double buildSeconds = 0;
+
+    // Radiance arriving from direction (which need not be normalized)
+    color radiance(const vec3& direction) const {
+        if (map.width == 0)
+            return color(0,0,0);
+        int i, j;
+        pixelOf(direction, i, j);
+        return intensity * map.at(i, j);
+    }
+
+    // Draws a direction with probability proportional to luminance from the uniform numbers u1, u2 in [0,1)
+    // Returns false if the map carries no light; otherwise pdf is the solid angle density of direction and light its radiance
+    bool sample(double u1, double u2, vec3& direction, double& pdf, color& light) const {
+        if (totalWeight <= 0)
+            return false;
+        // Row from the marginal table, then column from the row's conditional table
+        int j = findInterval(marginalCdf.data(), map.height, u2 * totalWeight);
+        const double* cdf = &conditionalCdf[std::size_t(j) * (map.width + 1)];
+        int i = findInterval(cdf, map.width, u1 * rowWeight[j]);
+
+        // Uniform position inside the pixel, reusing what is left of the random numbers
+        double rowFraction = (u2 * totalWeight - marginalCdf[j]) / std::max(1e-300, rowWeight[j]);
+        double columnFraction = (u1 * rowWeight[j] - cdf[i]) / std::max(1e-300, cdf[i + 1] - cdf[i]);
+        double u = (i + std::clamp(columnFraction, 0.0, 1.0)) / map.width;
+        double v = (j + std::clamp(rowFraction, 0.0, 1.0)) / map.height;
+
+        double theta = pi * v, phi = 2 * pi * u + degreesToRadians(rotation);
+        double sinTheta = std::sin(theta);
+        if (sinTheta <= 0)
+            return false;
+        direction = vec3(sinTheta * std::sin(phi), std::cos(theta), sinTheta * std::cos(phi));
+        pdf = pixelDensity(i, j) / (2 * pi * pi * sinTheta);
+        light = intensity * map.at(i, j);
+        return pdf > 0;
+    }
+
+    // Solid angle density with which sample() produces direction
+    double pdf(const vec3& direction) const {
+        if (totalWeight <= 0)
+            return 0;
+        int i, j;
+        pixelOf(direction, i, j);
+        vec3 d = unitVector(direction);
+        double sinTheta = std::sqrt(std::max(0.0, 1 - d.y() * d.y()));
+        if (sinTheta <= 0)
+            return 0;
+        return pixelDensity(i, j) / (2 * pi * pi * sinTheta);
+    }
+
+private:
+    floatImage map;
+    // Per row the running sums of the pixel weights (width + 1 entries per row), each row's total and the running sums of the row totals
+    std::vector<double> conditionalCdf;
+    std::vector<double> rowWeight;
+    std::vector<double> marginalCdf;
+    double totalWeight = 0;
+
+    // Density of pixel (i,j) in the unit square of (u,v) image coordinates
+    double pixelDensity(int i, int j) const {
+        const double* cdf = &conditionalCdf[std::size_t(j) * (map.width + 1)];
+        return (cdf[i + 1] - cdf[i]) / totalWeight * map.width * map.height;
+    }
+
+    void pixelOf(const vec3& direction, int& i, int& j) const {
+        vec3 d = unitVector(direction);
+        double theta = std::acos(std::clamp(d.y(), -1.0, 1.0));
+        double phi = std::fmod(std::atan2(d.x(), d.z()) - degreesToRadians(rotation), 2 * pi);
+        if (phi < 0)
+            phi += 2 * pi;
+        i = std::min(map.width - 1, int(phi / (2 * pi) * map.width));
+        j = std::min(map.height - 1, int(theta / pi * map.height));
+    }
+
+    // Index k of the interval cdf[k] <= value < cdf[k + 1] among count intervals, skipping empty ones
+    static int findInterval(const double* cdf, int count, double value) {
+        int k = int(std::upper_bound(cdf, cdf + count + 1, value) - cdf) - 1;
+        k = std::clamp(k, 0, count - 1);
+        while (k > 0 && cdf[k + 1] <= cdf[k])
+            k--;
+        while (k < count - 1 && cdf[k + 1] <= cdf[k])
+            k++;
+        return k;
+    }
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+// Libraries for the weight table and filter names
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+
+// Pixel reconstruction filters; every filter is separable, the weight of an offset (dx, dy) being f(dx) * f(dy)
+enum class filterType {
+    // Weight 1 inside the pixel: every sample counts for its own pixel only, a plain average
+    box,
+    // Gaussian with a standard deviation of 0.5 pixels, shifted down so it reaches 0 at the radius
+    gaussian,
+    // Mitchell-Netravali cubic with B = C = 1/3; slightly negative lobes sharpen edges
+    mitchell,
+    // Blackman-Harris window, close to a Gaussian but with a smaller tail
+    blackmanHarris
+};
+
+// Parses a filter name as used on the command line
+inline bool parseFilterType(const std::string& name, filterType& type) {
+    if (name == "box")             { type = filterType::box;            return true; }
+    if (name == "gaussian")        { type = filterType::gaussian;       return true; }
+    if (name == "mitchell")        { type = filterType::mitchell;       return true; }
+    if (name == "blackman-harris") { type = filterType::blackmanHarris; return true; }
+    return false;
+}
+
+// A reconstruction filter of a given radius in pixels, with its 1D profile precomputed into a table so splatting a sample costs two table reads per pixel instead of exp or cos calls
+class reconstructionFilter {
+public:
+    // radius <= 0 picks the filter's usual radius: 0.5 for the box, 1.5 for the Gaussian, 2 for Mitchell and Blackman-Harris; radii are capped at maxRadius
+    reconstructionFilter(filterType type = filterType::box, double radius = 0) : type(type) {
+        this->radius = radius > 0 ? std::min(radius, maxRadius) : type == filterType::box ? 0.5 : type == filterType::gaussian ? 1.5 : 2.0;
+        for (int k = 0; k < tableSize; k++)
+            table[k] = float(profile((k + 0.5) * this->radius / tableSize));
+    }
+
+    // Largest radius in pixels, which lets a sample reach at most 7 pixels to each side
+    static constexpr double maxRadius = 7.5;
+
+    filterType kind() const { return type; }
+    double extent() const { return radius; }
+
+    // Whether samples contribute to other pixels than their own; the default box does not and is rendered as a plain average
+    bool splats() const {
+        return type != filterType::box || radius != 0.5;
+    }
+
+    // Number of neighbouring pixels on each side a sample inside a pixel can reach; samples stay within their pixel, at most half a pixel from its center
+    int margin() const {
+        return std::max(0, int(std::ceil(radius + 0.5)) - 1);
+    }
+
+    // Weight of a sample dx, dy pixels away from a pixel center; 0 outside the radius
+    float weight(double dx, double dy) const {
+        return weight1D(dx) * weight1D(dy);
+    }
+
+    float weight1D(double d) const {
+        d = std::fabs(d);
+        if (d >= radius)
+            return 0.0f;
+        return table[std::min(tableSize - 1, int(d * (tableSize / radius)))];
+    }
+
+private:
+    static constexpr int tableSize = 64;
+
+    filterType type;
+    double radius;
+    std::array<float, tableSize> table;
+
+    // 1D filter value at distance x in [0, radius) from the center
+    double profile(double x) const {
+        switch (type) {
+        case filterType::gaussian: {
+            const double sigma = 0.5;
+            return std::exp(-x * x / (2 * sigma * sigma)) - std::exp(-radius * radius / (2 * sigma * sigma));
+        }
+        case filterType::mitchell: {
+            // The cubic spans [-2, 2], scaled to the radius
+            const double B = 1.0 / 3, C = 1.0 / 3;
+            x = 2 * x / radius;
+            if (x < 1)
+                return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6;
+            return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6;
+        }
+        case filterType::blackmanHarris: {
+            // The window runs over [-radius, radius]; t = 0.5 is the center
+            const double t = (x + radius) / (2 * radius);
+            return 0.35875 - 0.48829 * std::cos(2 * pi * t) + 0.14128 * std::cos(4 * pi * t) - 0.01168 * std::cos(6 * pi * t);
+        }
+        default:
+            return 1.0;
+        }
+    }
+};
+
+#endif
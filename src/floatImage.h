@@ -0,0 +1,111 @@
+#ifndef FLOATIMAGE_H
+#define FLOATIMAGE_H
+
+#include "color.h"
+
+// Libraries for the pixel storage, file access and byte order handling
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// High dynamic range RGB image with linear float pixels, stored top row first
+class floatImage {
+public:
+    int width = 0;
+    int height = 0;
+    // width * height RGB triples
+    std::vector<float> pixels;
+
+    floatImage() {}
+    floatImage(int width, int height) : width(width), height(height), pixels(std::size_t(width) * height * 3, 0.0f) {}
+
+    color at(int i, int j) const {
+        const float* p = &pixels[(std::size_t(j) * width + i) * 3];
+        return color(p[0], p[1], p[2]);
+    }
+
+    void set(int i, int j, const color& c) {
+        float* p = &pixels[(std::size_t(j) * width + i) * 3];
+        p[0] = float(c.x());
+        p[1] = float(c.y());
+        p[2] = float(c.z());
+    }
+};
+
+inline bool hostIsLittleEndian() {
+    const std::uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+// Writes image as a little-endian color PFM (Portable Float Map); PFM stores the bottom row first
+inline bool writePfm(const std::string& path, const floatImage& image) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "PF\n" << image.width << ' ' << image.height << "\n-1.0\n";
+    std::vector<float> row(std::size_t(image.width) * 3);
+    for (int j = image.height - 1; j >= 0 && file; j--) {
+        std::memcpy(row.data(), &image.pixels[std::size_t(j) * image.width * 3], row.size() * sizeof(float));
+        if (!hostIsLittleEndian()) {
+            for (auto& value : row) {
+                unsigned char bytes[4];
+                std::memcpy(bytes, &value, 4);
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+                std::memcpy(&value, bytes, 4);
+            }
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size() * sizeof(float)));
+    }
+    return bool(file);
+}
+
+// Reads a color ("PF") or grayscale ("Pf") PFM of either byte order into image; grayscale is replicated to RGB
+// Returns false and sets error if the file is missing, malformed or truncated
+inline bool readPfm(const std::string& path, floatImage& image, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string magic;
+    int width = 0, height = 0;
+    double scale = 0;
+    file >> magic >> width >> height >> scale;
+    // Exactly one whitespace character separates the header from the pixel data
+    file.get();
+    if (!file || (magic != "PF" && magic != "Pf") || width <= 0 || height <= 0 || scale == 0) {
+        error = path + ": not a PFM image";
+        return false;
+    }
+
+    const int channels = magic == "PF" ? 3 : 1;
+    const bool swapBytes = (scale < 0) != hostIsLittleEndian();
+    image = floatImage(width, height);
+    std::vector<float> row(std::size_t(width) * channels);
+    for (int j = height - 1; j >= 0; j--) {
+        if (!file.read(reinterpret_cast<char*>(row.data()), std::streamsize(row.size() * sizeof(float)))) {
+            error = path + ": truncated pixel data";
+            return false;
+        }
+        for (auto& value : row) {
+            if (swapBytes) {
+                unsigned char bytes[4];
+                std::memcpy(bytes, &value, 4);
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+                std::memcpy(&value, bytes, 4);
+            }
+        }
+        float* out = &image.pixels[std::size_t(j) * width * 3];
+        for (int i = 0; i < width; i++)
+            for (int c = 0; c < 3; c++)
+                out[3 * i + c] = row[std::size_t(i) * channels + (channels == 3 ? c : 0)];
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+// Library for dynamic arrays
+#include <vector>
+
+// Relative luminance of a linear color (Rec. 709 weights)
+inline double luminance(const color& c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+// Running per-pixel sums of an image that is refined over several passes
+// Besides the color sum it keeps the sum and sum of squares of each sample's luminance so the noise of the current average can be estimated
+class accumulationBuffer {
+public:
+    accumulationBuffer() {}
+    accumulationBuffer(int width, int height) { reset(width, height); }
+
+    // Clears the buffer and resizes it to width x height pixels
+    void reset(int width, int height) {
+        this->width = width;
+        this->height = height;
+        samples = 0;
+        colorSum.assign(std::size_t(width) * height, color(0,0,0));
+        luminanceSum.assign(colorSum.size(), 0.0);
+        luminanceSumSq.assign(colorSum.size(), 0.0);
+    }
+
+    // Adds one sample to pixel (i,j)
+    void add(int i, int j, const color& sample) {
+        auto index = std::size_t(j) * width + i;
+        colorSum[index] += sample;
+        auto y = luminance(sample);
+        luminanceSum[index] += y;
+        luminanceSumSq[index] += y * y;
+    }
+
+    // Records that every pixel received samplesAdded more samples
+    void finishPass(int samplesAdded) { samples += samplesAdded; }
+
+    // Samples per pixel accumulated so far
+    int samplesPerPixel() const { return samples; }
+
+    int imageWidth() const { return width; }
+    int imageHeight() const { return height; }
+
+    // Current estimate (average of all samples) of pixel (i,j)
+    color average(int i, int j) const {
+        if (samples == 0)
+            return color(0,0,0);
+        return colorSum[std::size_t(j) * width + i] / samples;
+    }
+
+    // Copies the current average of scanline j into row
+    void averageRow(int j, std::vector<color>& row) const {
+        row.resize(width);
+        for (int i = 0; i < width; i++)
+            row[i] = average(i, j);
+    }
+
+    // Image noise: the mean over all pixels of the relative standard error of the pixel's luminance estimate, stderr / (mean + 0.01)
+    // The 0.01 floor keeps nearly black pixels from dominating; returns infinity until two samples per pixel are available
+    double noise() const {
+        if (samples < 2)
+            return infinity;
+        double total = 0;
+        for (std::size_t p = 0; p < colorSum.size(); p++) {
+            auto mean = luminanceSum[p] / samples;
+            auto variance = std::fmax(0.0, (luminanceSumSq[p] - samples * mean * mean) / (samples - 1));
+            total += std::sqrt(variance / samples) / (mean + 0.01);
+        }
+        return total / colorSum.size();
+    }
+
+private:
+    int width = 0;
+    int height = 0;
+    int samples = 0;
+    std::vector<color> colorSum;
+    std::vector<double> luminanceSum;
+    std::vector<double> luminanceSumSq;
+};
+
+#endif
@@ -1,7 +1,13 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "aabb.h"
+
+// Library for std::clamp
+#include <algorithm>
+
 class material;
+class hittable;
 
 // Defines a class to store informatiuon about a ray-object intersection
 class hitRecord { 
@@ -18,6 +24,22 @@ public:
     // bool variable indicating whether the intersection point lies on the front(outer) side of the surface relative to the ray's direction
     bool frontFace;
 
+    // Primitive that produced the hit; traversal only records t and this, finalizeHit fills in everything else
+    const hittable* object = nullptr;
+
+    // Size of the surface that was hit in world units (a sphere's radius); textures turn footprint into a width in texture space with it
+    double surfaceScale = 0;
+    // Width of the ray's footprint at p in world units, set by the camera after the hit; 0 means a point sample
+    double footprint = 0;
+
+    // Texture coordinates of the hit in [0,1]: longitude and latitude of the outward normal, as every primitive is a sphere
+    // u runs around the y axis starting at -x, v from the bottom pole (-y) to the top; they are computed on demand so untextured surfaces never pay for the trigonometry
+    void textureCoordinates(double& u, double& v) const {
+        vec3 outward = frontFace ? normal : -normal;
+        u = (std::atan2(-outward.z(), outward.x()) + pi) / (2 * pi);
+        v = std::acos(std::clamp(-outward.y(), -1.0, 1.0)) / pi;
+    }
+
     // Function to determine whether the ray hit the front or back face of the surface; parameters are the ray and the outward normal which is a normal vector pointing outwards from the surface
     void setFaceNormal(const ray& r, const vec3& outwardNormal) {
         // Set front face to true if the ray is hitting the surface from the outside
@@ -34,11 +56,34 @@ public:
     // a virtual destructor ensuring that dervived classes clean up properly. = default specifies the compilier-generated destructor
     virtual ~hittable() = default;
 
+    // Determines if a ray hits the object within range [raytMin, raytMax] and fills in the complete hitRecord for the closest hit
+    // Traversal and shading data are split: intersect finds the closest hit, finalizeHit then computes its attributes once per ray instead of once per candidate hit
+    bool hit(const ray& r, interval rayT, hitRecord& rec) const {
+        if (!intersect(r, rayT, rec))
+            return false;
+        rec.object->finalizeHit(r, rec);
+        return true;
+    }
+
     // A pure virtual function that derived classes must implement
-    // Determines if a ray hits the object within range [raytMin, raytMax]
-    // hitRecord stores the intersection details if a hit occurs
-    // const = 0 makes hittable an abstract class, meaning you can't instantiate it directly but can derive other classes from it that implement hit()
-    virtual bool hit(const ray& r, interval rayT, hitRecord& rec) const = 0;
+    // Finds the closest hit within rayT and records only rec.t and rec.object, the primitive that was hit; rec is left untouched when nothing is hit
+    // Aggregates pass rec straight on to their children, so the record of a closer hit simply overwrites the previous one without any copying
+    // const = 0 makes hittable an abstract class, meaning you can't instantiate it directly but can derive other classes from it that implement intersect()
+    virtual bool intersect(const ray& r, interval rayT, hitRecord& rec) const = 0;
+
+    // Computes the hit point, face normal and material of a hit that intersect recorded for this primitive
+    // Aggregates never appear in rec.object and keep this default, which forwards to the primitive that does
+    virtual void finalizeHit(const ray& r, hitRecord& rec) const {
+        if (rec.object && rec.object != this)
+            rec.object->finalizeHit(r, rec);
+    }
+
+    // Returns a box enclosing the whole object, used by acceleration structures to place it
+    virtual aabb boundingBox() const = 0;
+
+    // Returns a copy of the object for a per-NUMA-node scene replica (see numa.h); objects that return null are shared between the replicas instead
+    // Materials are always shared: they are small and read once per hit, unlike the geometry every traversal step touches
+    virtual shared_ptr<hittable> clone() const { return nullptr; }
 };
 
 #endif
\ No newline at end of file
@@ -20,28 +20,30 @@ public:
     hittableList(shared_ptr<hittable> object) { add(object); }
 
     // Clears all objects from the objects vector
-    void clear() { objects.clear(); }
+    void clear() {
+        objects.clear();
+        bbox = aabb();
+    }
     
     //Function that adds a shared_ptr to a hittable object to the objects vector
     void add(shared_ptr<hittable> object) {
         objects.push_back(object);
+        // Grows the list's bounding box to enclose the new object
+        bbox = aabb(bbox, object->boundingBox());
     }
 
-    // Overrides the hit function from the hittable base class; checks if any object in the list is hit by the ray r within the range [raytMin, raytMax]
-    bool hit(const ray& r, interval rayT, hitRecord& rec) const override {
-        // Temp hitRecord object used to store hit info for each object in the list
-        hitRecord tempRec;
+    // Overrides the intersect function from the hittable base class; checks if any object in the list is hit by the ray r within the range [raytMin, raytMax]
+    bool intersect(const ray& r, interval rayT, hitRecord& rec) const override {
         // Tracks where any object has been hit by the ray
         bool hitAnything = false;
         // Stores the closest hit distance found so far, initialized to the max t ray length
         auto closestSoFar = rayT.max;
 
         for (const auto& object : objects) {
-            // Checks if the current object is hit by the ray; if true update hitAnything to true, closestSoFar to tempRec.t(the current hit distance), and set rec to tempRec(the most recent hit record)
-            if (object->hit(r, interval(rayT.min, closestSoFar), tempRec)) {
+            // Checks if the current object is hit by the ray closer than the closest hit so far; a hit overwrites t and the primitive in rec, so update hitAnything to true and closestSoFar to rec.t(the current hit distance)
+            if (object->intersect(r, interval(rayT.min, closestSoFar), rec)) {
                 hitAnything = true;
-                closestSoFar = tempRec.t;
-                rec = tempRec;
+                closestSoFar = rec.t;
             }
         }
 
@@ -49,6 +51,22 @@ public:
         return hitAnything;
 
      }
+
+    // Returns the box enclosing every object in the list
+    aabb boundingBox() const override { return bbox; }
+
+    // Copies the list and every object in it that can be copied
+    shared_ptr<hittable> clone() const override {
+        auto copy = make_shared<hittableList>();
+        for (const auto& object : objects) {
+            auto objectCopy = object->clone();
+            copy->add(objectCopy ? objectCopy : object);
+        }
+        return copy;
+    }
+
+private:
+    aabb bbox;
 };
 
 #endif
\ No newline at end of file
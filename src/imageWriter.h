@@ -0,0 +1,228 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+// Libraries for the background thread, the bounded queue and lock-free progress counters
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <streambuf>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stream buffer that swallows everything written to it
+class nullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Output stage of the renderer: finished scanlines are handed to a background thread that converts them to bytes, encodes them as PPM text and writes them
+// Rendering threads only touch a small bounded queue, so slow streams (network filesystems, pipes) never stall tracing unless the queue is full
+class imageWriter {
+public:
+    // Scanlines completed by the renderer; read lock-free by the progress reporter
+    std::atomic<int> rowsRendered{0};
+
+    // Starts the writer thread; queueCapacity bounds the number of rows waiting to be encoded, progressInterval throttles the progress line
+    imageWriter(std::ostream& out, std::ostream& log, int width, int height, std::size_t queueCapacity = 64,
+                std::chrono::milliseconds progressInterval = std::chrono::milliseconds(250))
+        : out(out), log(log), width(width), height(height), capacity(queueCapacity < 1 ? 1 : queueCapacity),
+          progressInterval(progressInterval), worker([this] { run(); }) {}
+
+    // Waits for every submitted row to be written
+    ~imageWriter() { finish(); }
+
+    imageWriter(const imageWriter&) = delete;
+    imageWriter& operator=(const imageWriter&) = delete;
+
+    // Returns an empty row buffer of width pixels, recycled from rows that were already written when possible
+    std::vector<color> acquireRow() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeRows.empty())
+            return std::vector<color>(width);
+        auto row = std::move(freeRows.back());
+        freeRows.pop_back();
+        return row;
+    }
+
+    // Queues finished scanline j (final averaged colors); rows may be submitted in any order and from any thread
+    // Blocks only while the queue is full
+    void submit(int j, std::vector<color>&& row) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this] { return pending.size() < capacity; });
+            pending.push_back({ j, std::move(row) });
+        }
+        rowsRendered.fetch_add(1, std::memory_order_relaxed);
+        notEmpty.notify_one();
+    }
+
+    // Flushes the remaining rows and joins the writer thread; safe to call more than once
+    void finish() {
+        if (!worker.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        notEmpty.notify_one();
+        worker.join();
+    }
+
+private:
+    // A scanline waiting to be encoded
+    struct queuedRow {
+        int j;
+        std::vector<color> pixels;
+    };
+
+    std::ostream& out;
+    std::ostream& log;
+    int width;
+    int height;
+    std::size_t capacity;
+    std::chrono::milliseconds progressInterval;
+
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<queuedRow> pending;
+    std::vector<std::vector<color>> freeRows;
+    bool closing = false;
+
+    // Declared last so it starts after every other member is initialized
+    std::thread worker;
+
+    // Writer thread: drains the queue, restores scanline order, encodes and writes, and reports progress
+    void run() {
+        std::string encoded;
+        encoded.reserve(std::size_t(width) * 12 + 32);
+
+        // PPM header
+        encoded = "P3\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+        out.write(encoded.data(), std::streamsize(encoded.size()));
+
+        // Rows that arrived ahead of the next row to write
+        std::map<int, std::vector<color>> early;
+        int nextRow = 0;
+        auto lastReport = std::chrono::steady_clock::now() - progressInterval;
+
+        while (true) {
+            queuedRow item;
+            bool haveItem = false;
+            bool done = false;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                notEmpty.wait_for(lock, progressInterval, [this] { return closing || !pending.empty(); });
+                if (!pending.empty()) {
+                    item = std::move(pending.front());
+                    pending.pop_front();
+                    haveItem = true;
+                } else {
+                    done = closing;
+                }
+            }
+            if (haveItem) {
+                notFull.notify_one();
+                early.emplace(item.j, std::move(item.pixels));
+            }
+
+            // Writes every row that is now contiguous with what has been written so far
+            for (auto it = early.find(nextRow); it != early.end(); it = early.find(nextRow)) {
+                encodeRow(it->second, encoded);
+                out.write(encoded.data(), std::streamsize(encoded.size()));
+                recycle(std::move(it->second));
+                early.erase(it);
+                nextRow++;
+            }
+
+            // Throttled progress line, based only on the atomic counter
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastReport >= progressInterval) {
+                lastReport = now;
+                log << "\rScanlines remaining: " << (height - rowsRendered.load(std::memory_order_relaxed)) << ' ' << std::flush;
+            }
+
+            if (done)
+                break;
+        }
+
+        out.flush();
+        log << "\rDone.                       \n";
+    }
+
+    // Encodes one row of colors as PPM text into encoded, replacing its previous contents
+    void encodeRow(const std::vector<color>& pixels, std::string& encoded) const {
+        encoded.resize(pixels.size() * 12);
+        char* cursor = encoded.data();
+        char* end = cursor + encoded.size();
+        for (const auto& pixelColor : pixels) {
+            int bytes[3];
+            colorToBytes(pixelColor, bytes[0], bytes[1], bytes[2]);
+            for (int c = 0; c < 3; c++) {
+                cursor = std::to_chars(cursor, end, bytes[c]).ptr;
+                *cursor++ = c < 2 ? ' ' : '\n';
+            }
+        }
+        encoded.resize(std::size_t(cursor - encoded.data()));
+    }
+
+    // Returns a written row buffer to the free list
+    void recycle(std::vector<color>&& row) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeRows.push_back(std::move(row));
+    }
+};
+
+// Streaming binary PPM (P6) encoder for images too large to hold in memory
+// Rows arrive in order as linear float RGBA, are gamma-corrected to 8-bit RGB one row at a time and appended to the file, so memory use is a single encoded row
+// P6 writes 3 bytes per pixel instead of up to 12 characters of text, which keeps multi-gigapixel output disk-bound rather than formatting-bound
+class ppmFileWriter {
+public:
+    ppmFileWriter(const std::string& path, int width, int height)
+        : file(path, std::ios::binary | std::ios::trunc), width(width), encoded(std::size_t(width) * 3) {
+        file << "P6\n" << width << ' ' << height << "\n255\n";
+        bytesWritten = std::uint64_t(file.tellp() > 0 ? std::uint64_t(file.tellp()) : 0);
+    }
+
+    // False once opening or writing the file failed
+    bool good() const { return bool(file); }
+
+    // Encodes and appends rows rows of width RGBA pixels, rowStride floats apart
+    void writeRows(const float* rgba, int rows, std::size_t rowStride) {
+        for (int j = 0; j < rows && file; j++) {
+            const float* pixel = rgba + j * rowStride;
+            for (int i = 0; i < width; i++, pixel += 4) {
+                int r, g, b;
+                colorToBytes(color(pixel[0], pixel[1], pixel[2]), r, g, b);
+                encoded[3 * i + 0] = char(r);
+                encoded[3 * i + 1] = char(g);
+                encoded[3 * i + 2] = char(b);
+            }
+            file.write(encoded.data(), std::streamsize(encoded.size()));
+            bytesWritten += encoded.size();
+        }
+    }
+
+    // Flushes and closes the file; returns false if anything failed
+    bool close() {
+        file.close();
+        return !file.fail();
+    }
+
+    // Bytes written so far, header included
+    std::uint64_t bytesWritten = 0;
+
+private:
+    std::ofstream file;
+    int width;
+    std::vector<char> encoded;
+};
+
+#endif
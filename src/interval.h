@@ -13,6 +13,9 @@ public:
     // Parameterized constructor that initializes the interval with specific min and max values
     interval(double min, double max) : min(min), max(max) {}
 
+    // Constructor that creates the tightest interval enclosing both intervals a and b
+    interval(const interval& a, const interval& b) : min(a.min <= b.min ? a.min : b.min), max(a.max >= b.max ? a.max : b.max) {}
+
     // Member function that returns the size of the interval by calculating max - min
     double size() const {
         return max - min;
@@ -38,14 +41,20 @@ public:
         return x;
     }
 
+    // Returns a copy of the interval padded by delta/2 on both sides
+    interval expand(double delta) const {
+        auto padding = delta/2;
+        return interval(min - padding, max + padding);
+    }
+
     // Declares two static constants for commonly used intervals
     static const interval empty, universe;
 };
 
 // Defines the empty interval as having a range from positive infinity to negative infinity; no valid range
-const interval interval::empty =    interval(+infinity, -infinity);
+inline const interval interval::empty =    interval(+infinity, -infinity);
 
 // Defines the universe interval covering all possible values from negative infinity to positive infinity
-const interval interval::universe = interval(+infinity, -infinity);
+inline const interval interval::universe = interval(-infinity, +infinity);
 
 #endif
\ No newline at end of file
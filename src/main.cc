@@ -1,10 +1,30 @@
 #include "utils.h"
 
+#include "allocationProfiler.h"
+#include "autotune.h"
+#include "batchJobs.h"
+#include "benchmark.h"
 #include "camera.h"
+#include "convergence.h"
+#include "environmentMap.h"
+#include "filter.h"
 #include "hittable.h"
 #include "hittableList.h"
 #include "material.h"
+#include "numa.h"
+#include "renderer.h"
+#include "sceneGenerator.h"
+#include "scenes.h"
 #include "sphere.h"
+#include "texture.h"
+#include "uniformGrid.h"
+#include "wideBvh.h"
+
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
 
 /* Function to determine if a given ray hits a sphere; returns true if the ray intersects the sphere
     // bool hitSphere(const point3& center, double radius, const ray& r) {
@@ -93,7 +113,147 @@
     // }
 */
 
-int main() {
+// Renders the final (or generated) scene through the library interface into one float image and writes it as PPM to std::cout
+// This is the path an embedding application takes; progress comes from the tile callback
+// With an outputPath the image is instead rendered strip by strip straight into a binary PPM file, holding at most memoryBudget bytes of image data
+int renderWithLibrary(const sceneGeneratorConfig* generator, renderAcceleration acceleration, unsigned threads, const renderSettings& settings,
+                      const char* outputPath, std::uint64_t memoryBudget) {
+    renderScene scene;
+    {
+        allocationPhaseScope phase(allocationPhase::sceneBuild);
+        if (generator) {
+            static const char* distributionNames[] = { "uniform", "clustered", "nested" };
+            scene.addGeneratedSphereField(generator->sphereCount, generator->seed, distributionNames[int(generator->distribution)], generator->materialPalette);
+        } else {
+            scene.addRandomSphereField(11);
+        }
+        scene.setAcceleration(acceleration);
+    }
+    {
+        allocationPhaseScope phase(allocationPhase::accelerationBuild);
+        scene.build();
+    }
+
+    const int width = settings.imageWidth;
+    const int height = settings.imageHeight();
+    renderer tracer(threads);
+
+    if (outputPath) {
+        // Strips are encoded while the next one renders, so the output of this mode counts towards the render phase
+        allocationPhaseScope phase(allocationPhase::render);
+        auto summary = tracer.renderToFile(scene, settings, outputPath, memoryBudget);
+        if (!summary.written) {
+            std::cerr << "cannot write " << outputPath << '\n';
+            return 1;
+        }
+        // Figures for sizing machines: throughput of the whole pipeline and the memory the process actually needed
+        const double megapixels = double(width) * height / 1e6;
+        std::clog << width << 'x' << height << " (" << megapixels << " MP) in " << summary.strips << " strips of "
+                  << summary.stripHeight << " rows, " << summary.bufferBytes / 1048576.0 << " MiB strip buffers\n"
+                  << "render " << summary.seconds << " s, " << megapixels / summary.seconds << " MP/s, "
+                  << (summary.primaryRays + summary.secondaryRays) / summary.seconds << " rays/s\n"
+                  << "encode " << summary.encodeSeconds << " s (overlapped), " << summary.fileBytes / 1048576.0 << " MiB written, "
+                  << summary.fileBytes / 1048576.0 / summary.seconds << " MiB/s\n"
+                  << "peak RSS " << peakResidentBytes() / 1048576.0 << " MiB\n";
+        return 0;
+    }
+
+    // Every row goes to the writer as soon as the tiles covering it are finished, so encoding and output overlap the render as in camera::render; the writer's queue therefore counts towards the render phase
+    std::vector<float> image(std::size_t(width) * height * 4);
+    std::vector<int> pixelsLeft(height, width);
+    std::mutex rowsMutex;
+    {
+        allocationPhaseScope phase(allocationPhase::render);
+        imageWriter writer(std::cout, std::clog, width, height);
+        tracer.render(scene, settings, image.data(), 0, [&](const renderTile& tile) {
+            for (int j = tile.y; j < tile.y + tile.height; j++) {
+                {
+                    std::lock_guard<std::mutex> lock(rowsMutex);
+                    pixelsLeft[j] -= tile.width;
+                    if (pixelsLeft[j] > 0)
+                        continue;
+                }
+                auto row = writer.acquireRow();
+                const float* pixel = image.data() + std::size_t(j) * width * 4;
+                for (int i = 0; i < width; i++, pixel += 4)
+                    row[i] = color(pixel[0], pixel[1], pixel[2]);
+                writer.submit(j, std::move(row));
+            }
+        });
+        // Waits for the last rows; the writer logs "Done."
+        writer.finish();
+    }
+    return 0;
+}
+
+// Renders a sequence of interactive preview frames while the camera orbits the vertical axis through lookAt by degreesPerFrame, each reusing the previous frame's samples (camera::renderPreview)
+// Reports every frame on std::clog and writes the last one as PPM to the camera's output
+template <typename World>
+void renderPreviewOrbit(camera& cam, const World& world, int frames, double degreesPerFrame) {
+    const vec3 offset = cam.lookFrom - cam.lookAt;
+    previewHistory history;
+    for (int frame = 0; frame < frames; frame++) {
+        const double angle = degreesToRadians(degreesPerFrame * frame);
+        cam.lookFrom = cam.lookAt + vec3(offset.x() * std::cos(angle) - offset.z() * std::sin(angle), offset.y(),
+                                         offset.x() * std::sin(angle) + offset.z() * std::cos(angle));
+        previewReport report = cam.renderPreview(world, history);
+        std::clog << "Preview frame " << frame << ": " << report.seconds << " s, " << 100.0 * report.reusedPixels / report.pixels() << "% reused, "
+                  << double(report.newSamples) / report.pixels() << " new spp\n";
+    }
+
+    imageWriter writer(*cam.output, std::clog, history.width(), history.height());
+    for (int j = 0; j < history.height(); j++) {
+        auto row = writer.acquireRow();
+        for (int i = 0; i < history.width(); i++)
+            row[i] = history.average(i, j);
+        writer.submit(j, std::move(row));
+    }
+    writer.finish();
+}
+
+// Prints the allocation profile of the run when it was compiled in and turns status into the exit code
+// With failOnRenderAllocation any allocation inside the render hot path fails the run, so a test can guard the allocation-free trace loop
+int finishAllocationProfile(int status, bool failOnRenderAllocation) {
+    if (!allocationProfilingEnabled)
+        return status;
+    printAllocationReport(std::clog);
+    if (failOnRenderAllocation && hotPathAllocations() > 0) {
+        std::cerr << "render hot path allocated " << hotPathAllocations() << " times\n";
+        return 1;
+    }
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+
+    // Benchmark mode: WeekendfunRayTracing --bench <name>
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        if (argc > 2 && runBenchmark(argv[2], std::vector<std::string>(argv + 3, argv + argc)))
+            return 0;
+        std::cerr << "usage: " << argv[0] << " --bench reorder|static|output|grid|widebvh|deferred|envmap|guiding|numa|textures|filters|preview|cancel|vec3|scaling [maxExponent]\n";
+        return 1;
+    }
+
+    // Convergence-quality harness: WeekendfunRayTracing --convergence [options], see runConvergenceHarness
+    if (argc > 1 && std::strcmp(argv[1], "--convergence") == 0)
+        return runConvergenceHarness(std::vector<std::string>(argv + 2, argv + argc));
+
+    // Texture conversion: WeekendfunRayTracing --make-texture <in.hdr|in.pfm> <out.wtex> [tile size], writes the tiled mip-mapped file --texture streams from
+    if (argc > 1 && std::strcmp(argv[1], "--make-texture") == 0) {
+        if (argc < 4) {
+            std::cerr << "usage: " << argv[0] << " --make-texture <in.hdr|in.pfm> <out.wtex> [tile size]\n";
+            return 1;
+        }
+        std::string in = argv[2], error;
+        floatImage image;
+        bool hdr = in.size() >= 4 && in.compare(in.size() - 4, 4, ".hdr") == 0;
+        if (!(hdr ? readRadianceHdr(in, image, error) : readPfm(in, image, error))
+            || !writeTiledTexture(argv[3], image, argc > 4 ? std::atoi(argv[4]) : 64, error)) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        return 0;
+    }
 
     /* Playground Main Function
         // int imageWidth = 256;
@@ -219,62 +379,354 @@ int main() {
     cam.render(world); */
 
     // Final Render 
-        hittableList world;
-
-    auto groundMaterial = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, groundMaterial));
-
-    for (int a = -11; a < 11; a++) {
-        for (int b = -11; b < 11; b++) {
-            auto chooseMat = randomDouble();
-            point3 center(a + 0.9*randomDouble(), 0.2, b + 0.9*randomDouble());
-
-            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphereMaterial;
-
-                if (chooseMat < 0.8) {
-                    // diffuse
-                    auto albedo = color::random() * color::random();
-                    sphereMaterial = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphereMaterial));
-                } else if (chooseMat < 0.95) {
-                    // metal
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = randomDouble(0, 0.5);
-                    sphereMaterial = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphereMaterial));
-                } else {
-                    // glass
-                    sphereMaterial = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphereMaterial));
-                }
-            }
+    camera cam = finalRenderCamera();
+
+    // Coherence-sorted batched bounces can be enabled with --batched, the compile-time specialized scene with --static
+    // --time-budget <seconds> [--target-noise <relative error>] switches to the progressive, deadline-bounded mode
+    // --grid traces the dynamic scene through a uniform grid, --bvh through the compressed 4-wide BVH
+    // --spheres <count> [--distribution uniform|clustered|nested] [--seed <n>] [--palette <materials>] replaces the final scene with a procedurally scaled one
+    // --threads <n> renders on n threads (0 = one per hardware thread)
+    // --width <pixels> and --spp <samples> override the final render's image width and samples per pixel
+    // --output <file> [--memory-budget <MiB>] renders strip by strip straight into a binary PPM file with bounded image memory, for gigapixel renders
+    // --autotune calibrates threads, tile size, ray batch size and samples per pass on this scene and stores them in the tuning cache (--tune-cache <file>, default weekendfun.tune)
+    // Later renders of the same scene on the same host pick the stored settings up; an explicit --threads still wins
+    // --fail-on-render-allocation exits with an error if the per-pixel trace loop allocated; needs a build configured with -DWEEKENDFUN_ALLOCATION_PROFILING=ON, which also prints allocations per phase and thread
+    // --jobs <file> [--concurrent] renders every job of the list against one resident scene instead of the single final render
+    // --numa pins the render threads to NUMA nodes round robin and gives every node its own copy of the dynamic scene and acceleration structure
+    // --guide [--guide-memory <MiB>] trains a path guide during the progressive passes of --time-budget and samples diffuse bounces from it (dynamic scenes only)
+    // --filter box|gaussian|mitchell|blackman-harris [--filter-radius <pixels>] selects the pixel reconstruction filter; all but the default box splat each sample onto its neighbouring pixels
+    // --texture <file.wtex> [--texture-repeat <n>] [--texture-cache <MiB>] gives the ground of the dynamic scene a streamed image texture, repeated n times (default 400) around the ground sphere, read through a tile cache of the given budget (default 256)
+    // --environment <file.hdr|file.pfm> [--environment-intensity <scale>] [--environment-rotation <degrees>] lights the scene with an equirectangular HDR image instead of the sky gradient
+    // --preview <frames> [--preview-orbit <degrees>] renders that many interactive preview frames while the camera orbits the scene by the given angle per frame (default 0.5), each reusing the previous frame's samples, and writes the last one; --spp sets the samples of pixels that start over
+    bool useStaticScene = false;
+    std::optional<unsigned> threads;
+    const char* jobsPath = nullptr;
+    bool concurrentJobs = false;
+    bool useGenerator = false;
+    sceneGeneratorConfig generator;
+    const char* outputPath = nullptr;
+    double memoryBudgetMiB = 256;
+    bool autotuneRequested = false;
+    const char* tuneCachePath = "weekendfun.tune";
+    bool failOnRenderAllocation = false;
+    bool useNuma = false;
+    bool useGuide = false;
+    double guideMemoryMiB = 64;
+    const char* environmentPath = nullptr;
+    double environmentIntensity = 1.0;
+    double environmentRotation = 0;
+    filterType filter = filterType::box;
+    double filterRadius = 0;
+    const char* texturePath = nullptr;
+    double textureRepeat = 400;
+    double textureCacheMiB = 256;
+    bool useGrid = false;
+    bool useBvh = false;
+    double timeBudget = 0;
+    double targetNoise = 0;
+    int previewFrames = 0;
+    double previewOrbit = 0.5;
+    for (int arg = 1; arg < argc; arg++) {
+        if (std::strcmp(argv[arg], "--batched") == 0)
+            cam.batchedBounces = true;
+        if (std::strcmp(argv[arg], "--static") == 0)
+            useStaticScene = true;
+        if (std::strcmp(argv[arg], "--grid") == 0)
+            useGrid = true;
+        if (std::strcmp(argv[arg], "--bvh") == 0)
+            useBvh = true;
+        if (std::strcmp(argv[arg], "--time-budget") == 0 && arg + 1 < argc)
+            timeBudget = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--target-noise") == 0 && arg + 1 < argc)
+            targetNoise = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--preview") == 0 && arg + 1 < argc)
+            previewFrames = std::atoi(argv[++arg]);
+        if (std::strcmp(argv[arg], "--preview-orbit") == 0 && arg + 1 < argc)
+            previewOrbit = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--spheres") == 0 && arg + 1 < argc) {
+            generator.sphereCount = std::size_t(std::atof(argv[++arg]));
+            useGenerator = true;
+        }
+        if (std::strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc)
+            generator.seed = std::strtoull(argv[++arg], nullptr, 10);
+        if (std::strcmp(argv[arg], "--palette") == 0 && arg + 1 < argc)
+            generator.materialPalette = std::size_t(std::atof(argv[++arg]));
+        if (std::strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc)
+            threads = unsigned(std::atoi(argv[++arg]));
+        if (std::strcmp(argv[arg], "--jobs") == 0 && arg + 1 < argc)
+            jobsPath = argv[++arg];
+        if (std::strcmp(argv[arg], "--width") == 0 && arg + 1 < argc)
+            cam.imageWidth = std::atoi(argv[++arg]);
+        if (std::strcmp(argv[arg], "--spp") == 0 && arg + 1 < argc)
+            cam.samplesPerPixel = std::atoi(argv[++arg]);
+        if (std::strcmp(argv[arg], "--output") == 0 && arg + 1 < argc)
+            outputPath = argv[++arg];
+        if (std::strcmp(argv[arg], "--memory-budget") == 0 && arg + 1 < argc)
+            memoryBudgetMiB = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--autotune") == 0)
+            autotuneRequested = true;
+        if (std::strcmp(argv[arg], "--tune-cache") == 0 && arg + 1 < argc)
+            tuneCachePath = argv[++arg];
+        if (std::strcmp(argv[arg], "--concurrent") == 0)
+            concurrentJobs = true;
+        if (std::strcmp(argv[arg], "--fail-on-render-allocation") == 0)
+            failOnRenderAllocation = true;
+        if (std::strcmp(argv[arg], "--numa") == 0)
+            useNuma = true;
+        if (std::strcmp(argv[arg], "--guide") == 0)
+            useGuide = true;
+        if (std::strcmp(argv[arg], "--guide-memory") == 0 && arg + 1 < argc)
+            guideMemoryMiB = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--environment") == 0 && arg + 1 < argc)
+            environmentPath = argv[++arg];
+        if (std::strcmp(argv[arg], "--environment-intensity") == 0 && arg + 1 < argc)
+            environmentIntensity = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--environment-rotation") == 0 && arg + 1 < argc)
+            environmentRotation = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--filter") == 0 && arg + 1 < argc && !parseFilterType(argv[++arg], filter)) {
+            std::cerr << "unknown filter " << argv[arg] << '\n';
+            return 1;
+        }
+        if (std::strcmp(argv[arg], "--filter-radius") == 0 && arg + 1 < argc)
+            filterRadius = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--texture") == 0 && arg + 1 < argc)
+            texturePath = argv[++arg];
+        if (std::strcmp(argv[arg], "--texture-repeat") == 0 && arg + 1 < argc)
+            textureRepeat = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--texture-cache") == 0 && arg + 1 < argc)
+            textureCacheMiB = std::atof(argv[++arg]);
+        if (std::strcmp(argv[arg], "--distribution") == 0 && arg + 1 < argc && !parseDistribution(argv[++arg], generator.distribution)) {
+            std::cerr << "unknown distribution " << argv[arg] << '\n';
+            return 1;
         }
     }
+    cam.filter = reconstructionFilter(filter, filterRadius);
 
-    auto material1 = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+    if (failOnRenderAllocation && !allocationProfilingEnabled) {
+        std::cerr << "--fail-on-render-allocation needs a build configured with -DWEEKENDFUN_ALLOCATION_PROFILING=ON\n";
+        return 1;
+    }
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+    if (useNuma && useStaticScene) {
+        std::cerr << "--numa needs a dynamic scene\n";
+        return 1;
+    }
+    const numaTopology topology = useNuma ? numaTopology::detect() : numaTopology();
+    if (useNuma)
+        std::clog << "NUMA: " << topology.nodeCount() << " node(s)" << (topology.nodeCount() == 1 ? ", threads and scene are left as they are" : "") << '\n';
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    if (useGuide && (useStaticScene || timeBudget <= 0)) {
+        std::cerr << "--guide needs --time-budget and a dynamic scene\n";
+        return 1;
+    }
 
-    camera cam;
+    // The preview traces box-filtered samples through a pinhole, so the reprojection finds every sample's surface again
+    if (previewFrames > 0 && (timeBudget > 0 || jobsPath || filter != filterType::box)) {
+        std::cerr << "--preview cannot be combined with --time-budget, --jobs or a reconstruction filter\n";
+        return 1;
+    }
+    if (previewFrames > 0)
+        cam.defocusAngle = 0;
 
-    cam.aspectRatio      = 16.0 / 9.0;
-    cam.imageWidth       = 1200;
-    cam.samplesPerPixel  = 500;
-    cam.maxDepth         = 50;
+    if (texturePath && useStaticScene) {
+        std::cerr << "--texture needs a dynamic scene\n";
+        return 1;
+    }
+    // Only the texture's header is read here; its tiles stream in while rendering
+    textureCache textures(std::size_t(textureCacheMiB * 1048576.0));
+    shared_ptr<material> groundMaterial;
+    if (texturePath) {
+        std::string error;
+        int id = textures.open(texturePath, error);
+        if (id < 0) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        groundMaterial = make_shared<lambertian>(make_shared<imageTexture>(textures, id, textureRepeat));
+        std::clog << "Texture " << textures.width(id) << 'x' << textures.height(id) << ", cache budget " << textureCacheMiB << " MiB\n";
+    }
 
-    cam.vfov     = 20;
-    cam.lookFrom = point3(13,2,3);
-    cam.lookAt   = point3(0,0,0);
-    cam.vup      = vec3(0,1,0);
+    // The dynamic scene: the generated one when --spheres is given, the final scene otherwise
+    // With --guide it also records the bounds of the guide's spatial tree, which leave out the ground sphere
+    aabb guideSceneBounds;
+    auto buildList = [&]() {
+        allocationPhaseScope phase(allocationPhase::sceneBuild);
+        hittableList list = useGenerator ? generateSphereFieldList(generator) : randomSphereField(11);
+        // Both scenes start with the ground sphere
+        if (groundMaterial)
+            list.objects[0] = make_shared<sphere>(point3(0,-1000,0), 1000, groundMaterial);
+        if (useGuide)
+            guideSceneBounds = guideBounds(list);
+        return list;
+    };
+
+    // Builds one replica of the dynamic scene per NUMA node with build(list) and calls use(world) with the replicated world
+    auto withReplicatedWorld = [&](auto&& use, auto&& build) {
+        hittableList list = buildList();
+        allocationPhaseScope phase(allocationPhase::accelerationBuild);
+        numaReplicatedWorld<std::decay_t<decltype(build(list))>> world(list, topology, build);
+        use(world);
+    };
+
+    // Builds the selected scene representation and calls use(world) with it
+    auto withWorld = [&](auto&& use) {
+        if (useNuma && useBvh) {
+            withReplicatedWorld(use, [](const hittableList& list) { return wideBvh(list); });
+        } else if (useNuma && useGrid) {
+            withReplicatedWorld(use, [](const hittableList& list) { return uniformGrid(list); });
+        } else if (useNuma) {
+            withReplicatedWorld(use, [](const hittableList& list) { return list; });
+        } else if (useStaticScene) {
+            allocationPhaseScope phase(allocationPhase::sceneBuild);
+            sphereFieldScene world = useGenerator ? generateSphereFieldStatic(generator) : randomSphereFieldStatic(11);
+            use(world);
+        } else if (useBvh) {
+            wideBvh world = [&] {
+                allocationPhaseScope phase(allocationPhase::accelerationBuild);
+                return wideBvh(buildList());
+            }();
+            use(world);
+        } else if (useGrid) {
+            uniformGrid world = [&] {
+                allocationPhaseScope phase(allocationPhase::accelerationBuild);
+                return uniformGrid(buildList());
+            }();
+            use(world);
+        } else {
+            hittableList world = buildList();
+            use(world);
+        }
+    };
+
+    // Tuned performance settings of this scene on this host, measured now with --autotune or taken from the cache
+    std::ostringstream sceneKey;
+    sceneKey << (useStaticScene ? "static" : useBvh ? "bvh" : useGrid ? "grid" : "list") << ' ';
+    if (useGenerator)
+        sceneKey << "spheres=" << generator.sphereCount << " seed=" << generator.seed << " distribution=" << int(generator.distribution)
+                 << " palette=" << generator.materialPalette;
+    else
+        sceneKey << "final";
+    sceneKey << " width=" << cam.imageWidth;
+    tuningCache cache(tuneCachePath);
+    tuningConfig tuning;
+    bool tuned = false;
+    if (autotuneRequested) {
+        withWorld([&](const auto& world) { tuning = autotune(world, cam, autotuneOptions(), &std::clog); });
+        cache.store(sceneKey.str(), tuning);
+        if (!cache.save())
+            std::cerr << "cannot write tuning cache " << tuneCachePath << '\n';
+        tuned = true;
+    } else if (cache.find(sceneKey.str(), tuning)) {
+        std::clog << "Tuned settings: " << tuning.toString() << '\n';
+        tuned = true;
+    }
+    if (tuned) {
+        cam.samplesPerPass = tuning.samplesPerPass;
+        cam.rayBatchSize = tuning.rayBatchSize;
+    }
 
-    cam.defocusAngle = 0.6;
-    cam.focusDist    = 10.0;
+    // Plain renders go through the library interface; the batched, static, progressive, preview, batch job, environment-lit, NUMA and textured modes drive the camera directly
+    if (!cam.batchedBounces && !useStaticScene && timeBudget <= 0 && previewFrames <= 0 && !jobsPath && !environmentPath && !useNuma && !texturePath) {
+        auto acceleration = useBvh ? renderAcceleration::bvh : useGrid ? renderAcceleration::grid : renderAcceleration::list;
+        // The defaults of renderSettings are the final render camera
+        renderSettings settings;
+        settings.imageWidth = cam.imageWidth;
+        settings.samplesPerPixel = cam.samplesPerPixel;
+        // renderFilter lists the filters in the order of filterType
+        settings.filter = renderFilter(int(filter));
+        settings.filterRadius = filterRadius;
+        if (tuned)
+            settings.tileSize = tuning.tileSize;
+        unsigned renderThreads = threads ? *threads : tuned ? tuning.threads : 1;
+        int status = renderWithLibrary(useGenerator ? &generator : nullptr, acceleration, renderThreads, settings,
+                                       outputPath, std::uint64_t(memoryBudgetMiB * 1048576.0));
+        return finishAllocationProfile(status, failOnRenderAllocation);
+    }
 
-    cam.render(world);
-}
\ No newline at end of file
+    // The camera's pool holds the workers besides the calling thread
+    if (!threads && tuned && tuning.threads > 1)
+        threads = tuning.threads - 1;
+
+    // Job list of the batch mode, parsed before the scene is built so mistakes are reported immediately
+    std::vector<renderJob> jobs;
+    if (jobsPath) {
+        std::ifstream jobFile(jobsPath);
+        std::string error;
+        if (!jobFile) {
+            std::cerr << "cannot open job list " << jobsPath << '\n';
+            return 1;
+        }
+        if (!parseJobList(jobFile, cam, jobs, error)) {
+            std::cerr << jobsPath << ": " << error << '\n';
+            return 1;
+        }
+        // Batch mode always uses a pool so jobs and scanlines can share it
+        if (!threads)
+            threads = 0;
+    }
+
+    // In NUMA mode the calling thread works on node 0 and the workers are spread over all nodes
+    std::unique_ptr<threadPool> pool;
+    if (useNuma && topology.nodeCount() > 1)
+        pinThreadToNode(topology, 0);
+    if (threads) {
+        pool = std::make_unique<threadPool>(*threads, useNuma && topology.nodeCount() > 1 ? numaWorkerPlacement(topology) : nullptr);
+        cam.pool = pool.get();
+    }
+
+    // The environment is decoded and its sampling tables are built on the render's threads
+    environmentMap environment;
+    if (environmentPath) {
+        allocationPhaseScope phase(allocationPhase::sceneBuild);
+        std::string error;
+        if (!environment.load(environmentPath, error, cam.pool)) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        environment.intensity = environmentIntensity;
+        environment.rotation = environmentRotation;
+        cam.environment = &environment;
+        std::clog << "Environment " << environment.width() << 'x' << environment.height() << ": loaded in " << environment.loadSeconds
+                  << " s, sampling tables built in " << environment.buildSeconds << " s\n";
+    }
+
+    // Scene and acceleration structure build time, reported by the batch mode
+    stopwatch setupTimer;
+
+    // Renders the batch, the preview orbit, or the single image with either the fixed sample count or the time budget
+    auto renderWorld = [&](const auto& world) {
+        // The guide's spatial tree spans the scene's bounds without its oversized objects
+        std::unique_ptr<pathGuide> guide;
+        if constexpr (std::is_base_of_v<hittable, std::decay_t<decltype(world)>>) {
+            if (useGuide) {
+                pathGuideSettings guideSettings;
+                guideSettings.memoryBudgetBytes = std::size_t(guideMemoryMiB * 1048576.0);
+                guide = std::make_unique<pathGuide>(guideSceneBounds, guideSettings);
+                cam.guide = guide.get();
+            }
+        }
+        allocationPhaseScope phase(allocationPhase::render);
+        if (jobsPath)
+            runBatch(world, jobs, *pool, concurrentJobs, setupTimer.seconds()).print(std::clog);
+        else if (timeBudget > 0)
+            cam.renderProgressive(world, timeBudget, targetNoise);
+        else if (previewFrames > 0)
+            renderPreviewOrbit(cam, world, previewFrames, previewOrbit);
+        else
+            cam.render(world);
+        cam.guide = nullptr;
+    };
+
+    withWorld(renderWorld);
+    if (texturePath) {
+        // The render threads add their counters every few thousand lookups; the rest are added here
+        if (pool)
+            pool->onEachWorker([&] { textures.flushThreadStats(); });
+        textures.flushThreadStats();
+        textureCacheStats textureStats = textures.stats();
+        std::clog << "Texture cache: " << textureStats.lookups << " lookups, hit rate " << 100 * textureStats.hitRate() << "%, "
+                  << textureStats.misses << " tiles read, " << textureStats.evictions << " evicted, resident " << textureStats.residentBytes / 1048576.0
+                  << " MiB (peak " << textureStats.peakResidentBytes / 1048576.0 << " MiB), " << textureStats.meanLookupNanoseconds << " ns per lookup\n";
+    }
+    return finishAllocationProfile(0, failOnRenderAllocation);
+}
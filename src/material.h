@@ -2,6 +2,7 @@
 #define MATERIAL_H
 
 #include "hittable.h"
+#include "texture.h"
 
 // An abstract base class that represents a material for objects in the ray tracing system
 // Materials define how rays interact with objects - whether they reflect, refract, or absorb light
@@ -22,6 +23,12 @@ public:
         // By default the function returns false, meaning the ray is absorbed or does not scatter
         return false;
     }
+
+    // Reports the albedo of a material that reflects diffusely (cosine-weighted, like lambertian::scatter); light sampling only connects to such surfaces
+    // Specular materials keep the default and return false
+    virtual bool diffuseAlbedo(const hitRecord& /*rec*/, color& /*albedo*/) const {
+        return false;
+    }
 };
 
 // Class that represents a Lambertian(diffuse) material, which scatters light equally in all directions. It inherits from the material class, meaning it must implement the scatter function
@@ -29,6 +36,8 @@ class lambertian : public material {
 public: 
     // Constructor that initializes the material's albedo(the material's base color)
     lambertian(const color& albedo) : albedo(albedo) {}
+    // Constructor that takes the albedo from a texture at every hit instead, e.g. an imageTexture streamed through a textureCache
+    lambertian(shared_ptr<texture> tex) : albedo(0,0,0), tex(std::move(tex)) {}
 
     // Overrides the scatter function from the material class to describe how an incoming ray interacts with the Lambertian material, scattering light in random directions
     bool scatter(const ray& rIncoming, const hitRecord& rec, color& attenuation, ray& scattered)
@@ -44,14 +53,21 @@ public:
         // Creates a scattered ray using the hit point rec.p as the origin and scatterDirection as the direction, represents the light that bounces off the surface in a new random direction
         scattered = ray(rec.p, scatterDirection);
         // Sets the attenuation(how much light is reflected) to the materials albedo which controls how much light is scattered versus absorbed
-        attenuation = albedo;
+        attenuation = tex ? tex->value(rec) : albedo;
         // return true if the ray was successfully scattered
         return true;
     }
 
+    bool diffuseAlbedo(const hitRecord& rec, color& result) const override {
+        result = tex ? tex->value(rec) : albedo;
+        return true;
+    }
+
 private: 
     // A color that represents how much light the material reflects. For exmaple, an albedo of color(0.5, 0.3, 0.3) would reflect 50% red, 30% green and blue light
     color albedo;
+    // Replaces albedo when set
+    shared_ptr<texture> tex;
 };
 
 // Defines a metal material class that inherits from material, representing reflective surfaces like metal
@@ -59,6 +75,8 @@ class metal : public material {
 public:
     // Constructor that initializes the materia's albedo, which controls the color of the reflected light, fuzz is clamped to a max value of 1 ensuring fuzziness stays within reasonable range
     metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+    // Constructor that takes the reflected color from a texture at every hit instead
+    metal(shared_ptr<texture> tex, double fuzz) : albedo(0,0,0), fuzz(fuzz < 1 ? fuzz : 1), tex(std::move(tex)) {}
 
     // Implements scatter for a metal surface
     bool scatter(const ray& rIncoming, const hitRecord& rec, color& attenuation, ray& scattered)
@@ -69,7 +87,7 @@ public:
         reflected = unitVector(reflected) + (fuzz * randomUnitVector());
         // Sets the scattered ray to start at the hit point and travel in the reflected direction
         scattered = ray(rec.p, reflected);
-        attenuation = albedo;
+        attenuation = tex ? tex->value(rec) : albedo;
         // Returns true if the scattered ray's direction is in the same hemisphere as the surface normal(the reflection is valid); ensures that the ray doesn't scatter into the surface but rather reflects outward
         return (dot(scattered.direction(), rec.normal) > 0);
     }
@@ -78,6 +96,8 @@ private:
     color albedo;
     // Fuzz value determines how "blurry" the reflections are
     double fuzz;
+    // Replaces albedo when set
+    shared_ptr<texture> tex;
 };
 
 // This class represents a dielectric material, such as glass or water, which refracts light
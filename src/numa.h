@@ -0,0 +1,166 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include "hittableList.h"
+
+// Libraries for the sysfs topology, thread affinity and the replica build threads
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// NUMA placement for multi-socket render nodes without depending on libnuma
+// The topology comes from sysfs, threads are pinned with pthread affinity, and memory ends up local through Linux's default first-touch policy: whatever a pinned thread allocates and writes first lives on its own node
+// On single-node machines (and anything that is not Linux with sysfs) the topology is one node holding every usable CPU, so all of this degrades to plain threading with a single copy of the scene
+// Affinity is Linux only: elsewhere the one node lists hardware_concurrency CPUs and pinThreadToNode returns false
+
+// Parses a sysfs CPU or node list such as "0-3,8-11" into its numbers
+inline std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> numbers;
+    std::stringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        int first = 0, last = 0;
+        auto dash = range.find('-');
+        try {
+            first = std::stoi(range.substr(0, dash));
+            last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        } catch (...) {
+            continue;
+        }
+        for (int n = first; n <= last; n++)
+            numbers.push_back(n);
+    }
+    return numbers;
+}
+
+// The NUMA nodes this process may run on and their CPUs
+class numaTopology {
+public:
+    // CPUs of every node, restricted to the process's affinity mask; nodes without usable CPUs (memory-only nodes, CPUs excluded by a container) are left out
+    std::vector<std::vector<int>> nodeCpus;
+
+    int nodeCount() const { return int(nodeCpus.size()); }
+
+    static numaTopology detect() {
+        numaTopology topology;
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        auto usable = [&](int cpu) { return !haveMask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)); };
+
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string nodes;
+        if (online && std::getline(online, nodes)) {
+            for (int node : parseCpuList(nodes)) {
+                std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string cpus;
+                std::vector<int> nodeCpus;
+                if (list && std::getline(list, cpus))
+                    for (int cpu : parseCpuList(cpus))
+                        if (usable(cpu))
+                            nodeCpus.push_back(cpu);
+                if (!nodeCpus.empty())
+                    topology.nodeCpus.push_back(nodeCpus);
+            }
+        }
+
+        // No NUMA information: one node with every usable CPU
+        if (topology.nodeCpus.empty()) {
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE && haveMask; cpu++)
+                if (CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            topology.nodeCpus.push_back(cpus);
+        }
+#else
+        std::vector<int> cpus;
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+            cpus.push_back(int(cpu));
+        topology.nodeCpus.push_back(cpus);
+#endif
+        return topology;
+    }
+};
+
+// Node of the calling thread's scene replica and local buffers; threads that were never pinned use node 0
+inline thread_local int numaThreadNode = 0;
+
+// Restricts the calling thread to the CPUs of node and makes it use that node's replicas; returns false if the affinity could not be set
+inline bool pinThreadToNode(const numaTopology& topology, int node) {
+    if (node < 0 || node >= topology.nodeCount())
+        return false;
+    numaThreadNode = node;
+    const auto& cpus = topology.nodeCpus[node];
+    if (cpus.empty())
+        return false;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// Worker start hook for threadPool that spreads the workers over the nodes round robin
+// The thread that calls parallelFor takes part in every loop, so it is expected to be pinned to node 0 and the first worker goes to node 1
+inline std::function<void(unsigned)> numaWorkerPlacement(const numaTopology& topology) {
+    return [topology](unsigned worker) { pinThreadToNode(topology, int((worker + 1) % unsigned(topology.nodeCount()))); };
+}
+
+// A scene with one copy per NUMA node: each node's geometry and acceleration structure are built by a thread pinned to that node, so their pages are local to it
+// Intersection queries go to the replica of the calling thread's node (numaThreadNode); hits point into that replica, so shading stays local as well
+// World is the acceleration structure (hittableList, wideBvh, uniformGrid), made from a hittableList by build
+template <typename World>
+class numaReplicatedWorld : public hittable {
+public:
+    // build(const hittableList&) returns the World of one replica; on a single node it runs once on the source list, without copying the objects
+    template <typename Build>
+    numaReplicatedWorld(const hittableList& source, const numaTopology& topology, Build&& build) {
+        replicas.resize(std::max(1, topology.nodeCount()));
+        if (replicas.size() == 1) {
+            replicas[0] = std::make_unique<World>(build(source));
+            return;
+        }
+        std::vector<std::thread> builders;
+        for (std::size_t node = 0; node < replicas.size(); node++)
+            builders.emplace_back([&, node] {
+                pinThreadToNode(topology, int(node));
+                auto local = std::static_pointer_cast<hittableList>(source.clone());
+                replicas[node] = std::make_unique<World>(build(*local));
+            });
+        for (auto& builder : builders)
+            builder.join();
+    }
+
+    int replicaCount() const { return int(replicas.size()); }
+    const World& replica(int node) const { return *replicas[node]; }
+
+    // Replica used by the calling thread
+    const World& local() const { return *replicas[std::min(std::size_t(numaThreadNode), replicas.size() - 1)]; }
+
+    bool intersect(const ray& r, interval rayT, hitRecord& rec) const override {
+        return local().intersect(r, rayT, rec);
+    }
+
+    aabb boundingBox() const override { return replicas[0]->boundingBox(); }
+
+private:
+    std::vector<std::unique_ptr<World>> replicas;
+};
+
+#endif
@@ -0,0 +1,389 @@
+#ifndef PATHGUIDING_H
+#define PATHGUIDING_H
+
+#include "aabb.h"
+#include "hittableList.h"
+
+// Libraries for the lock-free training sums, the trees and the memory accounting
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Online path guiding in the style of practical path guiding (Mueller et al. 2017): a spatial-directional tree (SD-tree) learns where light arrives from
+// A binary tree over the scene bounds holds one directional quadtree per leaf; the quadtrees store incident radiance over the sphere of directions
+// Rendering alternates between training iterations: paths sample the distribution learned in the previous iteration and record what they find into a fresh tree
+// Iteration k lasts 2^k progressive passes, after which the recorded tree is refined (spatially where many paths went, directionally where much light came from) and becomes the sampling tree
+
+// Adds value to an atomic float; several render threads record into the same quadtree nodes
+inline void atomicAdd(std::atomic<float>& target, float value) {
+    float current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+}
+
+// Maps a unit direction to the unit square with the equal-area cylindrical mapping (cos theta, phi), so a square's area is proportional to its solid angle
+inline void directionToSquare(const vec3& d, double& x, double& y) {
+    x = std::clamp(0.5 * (d.z() + 1.0), 0.0, 1.0);
+    double phi = std::atan2(d.y(), d.x());
+    if (phi < 0)
+        phi += 2 * pi;
+    y = std::clamp(phi / (2 * pi), 0.0, 1.0);
+}
+
+inline vec3 squareToDirection(double x, double y) {
+    double cosTheta = 2 * x - 1;
+    double sinTheta = std::sqrt(std::max(0.0, 1 - cosTheta * cosTheta));
+    double phi = 2 * pi * y;
+    return vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+// Node of a directional quadtree; child[k] is 0 for a leaf quadrant, otherwise the index of the node subdividing quadrant k
+// Quadrants are numbered x + 2 y with x, y in {0, 1} for the lower and upper half of the node's square
+class quadNode {
+public:
+    std::uint32_t child[4] = { 0, 0, 0, 0 };
+    // Radiance recorded (training) or learned (sampling) per quadrant, over everything below it
+    std::atomic<float> sum[4];
+
+    quadNode() {
+        for (auto& s : sum)
+            s.store(0.0f, std::memory_order_relaxed);
+    }
+    quadNode(const quadNode& other) { *this = other; }
+    quadNode& operator=(const quadNode& other) {
+        for (int k = 0; k < 4; k++) {
+            child[k] = other.child[k];
+            sum[k].store(other.sum[k].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    float total() const {
+        return sum[0].load(std::memory_order_relaxed) + sum[1].load(std::memory_order_relaxed)
+             + sum[2].load(std::memory_order_relaxed) + sum[3].load(std::memory_order_relaxed);
+    }
+};
+
+// Directional distribution of one spatial region as a quadtree over the unit square of directionToSquare; node 0 is the root
+class directionalTree {
+public:
+    std::vector<quadNode> nodes = std::vector<quadNode>(1);
+
+    float total() const { return nodes[0].total(); }
+
+    // Adds value to every node on the way down to the leaf containing (x,y)
+    void record(double x, double y, float value) {
+        std::uint32_t index = 0;
+        while (true) {
+            int quadrant = quadrantOf(x, y);
+            atomicAdd(nodes[index].sum[quadrant], value);
+            std::uint32_t next = nodes[index].child[quadrant];
+            if (next == 0)
+                return;
+            x = 2 * x - (quadrant & 1);
+            y = 2 * y - (quadrant >> 1);
+            index = next;
+        }
+    }
+
+    // Picks a point of the unit square with density proportional to the recorded radiance; u1, u2 are uniform in [0,1) and get reused level by level
+    void sample(double u1, double u2, double& x, double& y) const {
+        std::uint32_t index = 0;
+        double originX = 0, originY = 0, size = 1;
+        while (true) {
+            const quadNode& node = nodes[index];
+            // Upper or lower half first, then the quadrant within it
+            double bottom = node.sum[0].load(std::memory_order_relaxed) + node.sum[1].load(std::memory_order_relaxed);
+            double all = bottom + node.sum[2].load(std::memory_order_relaxed) + node.sum[3].load(std::memory_order_relaxed);
+            double fractionBottom = all > 0 ? bottom / all : 0.5;
+            int row;
+            if (u2 < fractionBottom) {
+                row = 0;
+                u2 /= fractionBottom;
+            } else {
+                row = 1;
+                u2 = (u2 - fractionBottom) / (1 - fractionBottom);
+            }
+            double left = node.sum[2 * row].load(std::memory_order_relaxed);
+            double rowTotal = left + node.sum[2 * row + 1].load(std::memory_order_relaxed);
+            double fractionLeft = rowTotal > 0 ? left / rowTotal : 0.5;
+            int column;
+            if (u1 < fractionLeft) {
+                column = 0;
+                u1 /= fractionLeft;
+            } else {
+                column = 1;
+                u1 = (u1 - fractionLeft) / (1 - fractionLeft);
+            }
+            u1 = std::clamp(u1, 0.0, 0.999999999);
+            u2 = std::clamp(u2, 0.0, 0.999999999);
+
+            size *= 0.5;
+            originX += column * size;
+            originY += row * size;
+            std::uint32_t next = node.child[column + 2 * row];
+            if (next == 0) {
+                x = originX + u1 * size;
+                y = originY + u2 * size;
+                return;
+            }
+            index = next;
+        }
+    }
+
+    // Density of sample() at (x,y) with respect to area on the unit square
+    double pdf(double x, double y) const {
+        double density = 1;
+        std::uint32_t index = 0;
+        while (true) {
+            const quadNode& node = nodes[index];
+            double all = node.total();
+            if (all <= 0)
+                return density;
+            int quadrant = quadrantOf(x, y);
+            density *= 4 * node.sum[quadrant].load(std::memory_order_relaxed) / all;
+            std::uint32_t next = node.child[quadrant];
+            if (next == 0 || density == 0)
+                return density;
+            x = 2 * x - (quadrant & 1);
+            y = 2 * y - (quadrant >> 1);
+            index = next;
+        }
+    }
+
+    // Builds the tree of the next training iteration from this one's sums: quadrants holding more than threshold of the total energy are subdivided (down to maxDepth levels), the rest become leaves
+    // The new tree starts with zero sums
+    directionalTree refined(double threshold, int maxDepth) const {
+        directionalTree next;
+        const double all = total();
+        if (all <= 0)
+            return next;
+        // Each entry: node of this tree (or -1 when the region was a single leaf quadrant here), its energy fraction, the node in the new tree and its depth
+        class pending {
+        public:
+            std::int64_t source;
+            double fraction;
+            std::uint32_t target;
+            int depth;
+        };
+        std::vector<pending> stack{ { 0, 1.0, 0, 1 } };
+        while (!stack.empty()) {
+            pending item = stack.back();
+            stack.pop_back();
+            for (int k = 0; k < 4; k++) {
+                // Energy of the quadrant; where this tree has no finer structure it is assumed to spread evenly
+                double fraction = item.source >= 0 ? nodes[item.source].sum[k].load(std::memory_order_relaxed) / all : item.fraction / 4;
+                if (fraction <= threshold || item.depth >= maxDepth)
+                    continue;
+                std::uint32_t created = std::uint32_t(next.nodes.size());
+                next.nodes.emplace_back();
+                next.nodes[item.target].child[k] = created;
+                std::int64_t source = item.source >= 0 && nodes[item.source].child[k] != 0 ? std::int64_t(nodes[item.source].child[k]) : -1;
+                stack.push_back({ source, fraction, created, item.depth + 1 });
+            }
+        }
+        return next;
+    }
+
+private:
+    static int quadrantOf(double x, double y) {
+        return (x >= 0.5 ? 1 : 0) + (y >= 0.5 ? 2 : 0);
+    }
+};
+
+// Spatial leaf of the SD-tree: the distribution paths sample from and the one they record into during the current iteration
+class guideRegion {
+public:
+    directionalTree sampling;
+    directionalTree training;
+    // Paths that recorded into training during this iteration
+    std::atomic<std::uint64_t> samples{0};
+
+    // Whether the previous iteration learned anything to sample from
+    bool canSample() const { return sampling.total() > 0; }
+
+    vec3 sample(double u1, double u2) const {
+        double x, y;
+        sampling.sample(u1, u2, x, y);
+        return squareToDirection(x, y);
+    }
+
+    // Solid angle density of sample(); the cylindrical mapping is area preserving with the sphere's 4 pi steradians spread over the unit square
+    double pdf(const vec3& direction) const {
+        double x, y;
+        directionToSquare(direction, x, y);
+        return sampling.pdf(x, y) / (4 * pi);
+    }
+
+    // Records radiance arriving from direction (a unit vector), divided by the density it was sampled with
+    void record(const vec3& direction, double weightedRadiance) {
+        if (!(weightedRadiance > 0) || !std::isfinite(weightedRadiance))
+            return;
+        double x, y;
+        directionToSquare(direction, x, y);
+        training.record(x, y, float(weightedRadiance));
+        samples.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Bounds for the spatial tree of a guide over the objects of list, leaving out objects much larger than the typical one: those whose longest side exceeds largeObjectFactor times the median longest side, the rule uniformGrid uses for its out-of-grid primitives
+// Over the whole scene box a radius-1000 ground sphere would make the root cell 2000 units wide, and the tree would spend its first dozens of splits on empty space before reaching the few units where paths go; points outside the bounds fall into the nearest cell
+inline aabb guideBounds(const hittableList& list, double largeObjectFactor = 16.0) {
+    if (list.objects.empty())
+        return aabb();
+    std::vector<double> extents;
+    extents.reserve(list.objects.size());
+    for (const auto& object : list.objects)
+        extents.push_back(object->boundingBox().maxExtent());
+    std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+    const double largeLimit = largeObjectFactor * extents[extents.size() / 2];
+    aabb bounds;
+    for (const auto& object : list.objects)
+        if (object->boundingBox().maxExtent() <= largeLimit)
+            bounds = aabb(bounds, object->boundingBox());
+    return bounds;
+}
+
+// Settings of a pathGuide
+class pathGuideSettings {
+public:
+    // Probability of sampling lambertian scattering rather than the learned distribution at a diffuse hit
+    double bsdfSamplingFraction = 0.5;
+    // A spatial leaf is split once it received more than this many paths times sqrt(2^iteration); lower values suit small images, whose iterations trace fewer paths
+    double spatialThreshold = 1000;
+    // Quadrants holding more than this fraction of a region's recorded energy are subdivided
+    double directionalThreshold = 0.01;
+    int maxDirectionalDepth = 20;
+    // Upper bound on the memory of both trees together; refinement stops splitting regions and coarsens the directional trees, down to a single node each, instead of exceeding it
+    // Only a budget below the spatial tree plus one node per directional tree is exceeded, since no coarser guide exists
+    std::size_t memoryBudgetBytes = std::size_t(64) << 20;
+    // Training stops after this many iterations and the last sampling tree is kept
+    int maxIterations = 12;
+};
+
+// The SD-tree; camera records into it from any number of threads during a pass, endPass() refines it between passes
+class pathGuide {
+public:
+    pathGuideSettings settings;
+
+    pathGuide(const aabb& bounds, const pathGuideSettings& settings = pathGuideSettings()) : settings(settings) {
+        // A cube around the scene, so splitting the axes in turn keeps the cells cubical
+        double extent = std::max(1e-6, bounds.maxExtent());
+        origin = point3(bounds.x.min, bounds.y.min, bounds.z.min);
+        size = extent;
+        nodes.push_back({ -1, { 0, 0 }, 0, 0 });
+        regions.push_back(std::make_unique<guideRegion>());
+    }
+
+    // Region the point p belongs to; points outside the bounds go to the nearest region
+    guideRegion& regionAt(const point3& p) {
+        double local[3];
+        for (int axis = 0; axis < 3; axis++)
+            local[axis] = std::clamp((p[axis] - origin[axis]) / size, 0.0, 1.0);
+        std::uint32_t index = 0;
+        while (nodes[index].axis >= 0) {
+            const spatialNode& node = nodes[index];
+            double& coordinate = local[node.axis];
+            int side = coordinate >= 0.5 ? 1 : 0;
+            coordinate = 2 * coordinate - side;
+            index = node.child[side];
+        }
+        return *regions[nodes[index].region];
+    }
+
+    // Called after every progressive pass; refines the tree and starts a new iteration once the current one has had its 2^iteration passes
+    // Returns true if the sampling distribution changed
+    bool endPass() {
+        if (iteration >= settings.maxIterations)
+            return false;
+        if (++passesInIteration < (1 << iteration))
+            return false;
+        refine();
+        passesInIteration = 0;
+        iteration++;
+        return true;
+    }
+
+    // Finished training iterations
+    int iterations() const { return iteration; }
+    std::size_t regionCount() const { return regions.size(); }
+
+    // Bytes held by the spatial tree and both directional trees of every region
+    std::size_t memoryBytes() const {
+        std::size_t bytes = nodes.size() * sizeof(spatialNode) + regions.size() * sizeof(guideRegion);
+        for (const auto& region : regions)
+            bytes += (region->sampling.nodes.size() + region->training.nodes.size()) * sizeof(quadNode);
+        return bytes;
+    }
+
+private:
+    // Inner node (axis 0-2, split in the middle of the cell) or leaf (axis -1) holding the index of its region
+    class spatialNode {
+    public:
+        int axis;
+        std::uint32_t child[2];
+        std::uint32_t region;
+        // Cells split along x, y and z in turn
+        int depth;
+    };
+
+    point3 origin;
+    double size;
+    std::vector<spatialNode> nodes;
+    std::vector<std::unique_ptr<guideRegion>> regions;
+    int iteration = 0;
+    int passesInIteration = 0;
+
+    // Ends the iteration: the recorded trees become the sampling trees, busy regions are split, and every region gets a refined empty training tree
+    void refine() {
+        // Spatial splits; children inherit the parent's recorded distribution and an even share of its paths
+        const double splitAt = settings.spatialThreshold * std::sqrt(double(1u << iteration));
+        std::size_t bytes = memoryBytes();
+        for (std::size_t n = 0; n < nodes.size(); n++) {
+            if (nodes[n].axis >= 0)
+                continue;
+            guideRegion& region = *regions[nodes[n].region];
+            std::size_t cost = 2 * sizeof(spatialNode) + sizeof(guideRegion) + 2 * region.training.nodes.size() * sizeof(quadNode);
+            if (region.samples.load() <= splitAt || bytes + cost > settings.memoryBudgetBytes)
+                continue;
+            bytes += cost;
+            auto sibling = std::make_unique<guideRegion>();
+            sibling->training = region.training;
+            sibling->samples.store(region.samples.load() / 2);
+            region.samples.store(region.samples.load() / 2);
+            const int depth = nodes[n].depth + 1;
+            std::uint32_t first = std::uint32_t(nodes.size());
+            nodes.push_back({ -1, { 0, 0 }, nodes[n].region, depth });
+            nodes.push_back({ -1, { 0, 0 }, std::uint32_t(regions.size()), depth });
+            regions.push_back(std::move(sibling));
+            nodes[n].axis = nodes[n].depth % 3;
+            nodes[n].child[0] = first;
+            nodes[n].child[1] = first + 1;
+        }
+
+        // Directional refinement, coarsening every region's tree until all of them fit the budget; at a threshold of 1 no quadrant is subdivided and every tree is a single node
+        double threshold = settings.directionalThreshold;
+        while (true) {
+            std::size_t bytes = nodes.size() * sizeof(spatialNode) + regions.size() * sizeof(guideRegion);
+            std::vector<directionalTree> next;
+            next.reserve(regions.size());
+            for (const auto& region : regions) {
+                next.push_back(region->training.refined(threshold, settings.maxDirectionalDepth));
+                bytes += (region->training.nodes.size() + next.back().nodes.size()) * sizeof(quadNode);
+            }
+            if (bytes <= settings.memoryBudgetBytes || threshold >= 1) {
+                for (std::size_t r = 0; r < regions.size(); r++) {
+                    regions[r]->sampling = std::move(regions[r]->training);
+                    regions[r]->training = std::move(next[r]);
+                    regions[r]->samples.store(0);
+                }
+                return;
+            }
+            threshold *= 2;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef PREVIEWHISTORY_H
+#define PREVIEWHISTORY_H
+
+#include "floatImage.h"
+
+// Libraries for the per-pixel buffers
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Summary of one frame of camera::renderPreview
+class previewReport {
+public:
+    // Wall-clock time of the frame, including the primary hits and the reprojection
+    double seconds = 0;
+    // Pixels whose history was reprojected and accepted
+    std::size_t reusedPixels = 0;
+    // Pixels that had to start over, by reason: no previous frame or history outside its view, failed depth or normal test (disocclusion), or a specular surface whose look depends on the view
+    std::size_t outsidePixels = 0;
+    std::size_t disoccludedPixels = 0;
+    std::size_t specularPixels = 0;
+    // New samples traced in this frame
+    std::uint64_t newSamples = 0;
+
+    std::size_t pixels() const { return reusedPixels + outsidePixels + disoccludedPixels + specularPixels; }
+};
+
+// Pinhole view of a preview frame, enough to project a point into that frame's pixels
+class previewView {
+public:
+    point3 center;
+    // Center of pixel (0,0) on the focus plane and the steps to the next pixel along a row and down a column
+    point3 pixel00;
+    vec3 pixelDeltaU, pixelDeltaV;
+    // Viewing direction
+    vec3 forward;
+    double focusDist = 0;
+    int width = 0, height = 0;
+
+    // Continuous pixel coordinates (pixel centers at integers) where this view sees point p (or the direction p - center when atInfinity)
+    // False if p is behind the camera or farther than half a pixel outside the image
+    bool project(const point3& p, bool atInfinity, double& x, double& y) const {
+        vec3 d = atInfinity ? p : p - center;
+        double z = dot(d, forward);
+        if (z <= 1e-9)
+            return false;
+        vec3 onPlane = center + d * (focusDist / z) - pixel00;
+        x = dot(onPlane, pixelDeltaU) / pixelDeltaU.squaredLength();
+        y = dot(onPlane, pixelDeltaV) / pixelDeltaV.squaredLength();
+        return x >= -0.5 && y >= -0.5 && x < width - 0.5 && y < height - 0.5;
+    }
+};
+
+// Accumulated radiance and first hits of the previous preview frame, reused by camera::renderPreview after the camera moved
+// Each pixel keeps the sum and count of its samples plus the point and normal its center ray hit first; the next frame accepts a pixel's history only where the same surface is seen again
+class previewHistory {
+public:
+    // New samples for a pixel whose history was accepted; pixels without usable history get the camera's samplesPerPixel
+    int refreshSamples = 1;
+    // Most samples a pixel's history counts; older ones fade out, which bounds how long a wrong reprojection or the view dependence of glossy light lingers
+    int historyLimit = 64;
+    // Most samples kept for a pixel where some of the previous pixels around the projected point showed another surface; the bilinear resampling then mixes in samples from across the edge, and without this bound the mix compounds frame after frame into a visible darkening along silhouettes
+    int partialHistoryLimit = 4;
+    // Largest relative difference between the distance to the reprojected hit and the distance the previous frame stored
+    double depthTolerance = 0.02;
+    // Smallest cosine between the new and the stored normal
+    double minNormalCosine = 0.9;
+
+    // Frames rendered since the last reset
+    std::uint64_t frames() const { return frame; }
+
+    // Forgets the history, so the next frame renders from scratch
+    void reset() {
+        frame = 0;
+        current.clear();
+        previous.clear();
+    }
+
+    int width() const { return view.width; }
+    int height() const { return view.height; }
+
+    // Estimate of pixel (i,j) after the last frame
+    color average(int i, int j) const {
+        const pixelHistory& p = current[std::size_t(j) * view.width + i];
+        return p.samples > 0 ? p.colorSum / p.samples : color(0,0,0);
+    }
+
+    // The last frame as a linear image
+    floatImage image() const {
+        floatImage result(view.width, view.height);
+        for (int j = 0; j < view.height; j++)
+            for (int i = 0; i < view.width; i++)
+                result.set(i, j, average(i, j));
+        return result;
+    }
+
+private:
+    friend class camera;
+
+    class pixelHistory {
+    public:
+        color colorSum = color(0,0,0);
+        double samples = 0;
+        // First hit of the pixel's center ray; for a miss, the ray's direction
+        point3 hit;
+        vec3 normal;
+        bool missed = false;
+    };
+
+    std::uint64_t frame = 0;
+    // View of the last frame and of the one before it
+    previewView view, previousView;
+    std::vector<pixelHistory> current, previous;
+
+    // Makes the last frame the previous one and sizes the buffers for the next frame's view
+    void beginFrame(const previewView& next) {
+        std::swap(current, previous);
+        if (frame == 0)
+            previous.clear();
+        previousView = view;
+        view = next;
+        current.assign(std::size_t(next.width) * next.height, pixelHistory());
+    }
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef PROFILING_H
+#define PROFILING_H
+
+// Libraries for wall-clock timing and the Linux hardware performance counter interface
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Counts last-level cache misses of the calling thread between start() and stop() using perf_event_open
+// On platforms without perf events (or when the kernel forbids access) available() returns false and value() stays 0
+class cacheMissCounter {
+public:
+    cacheMissCounter() {
+#if defined(__linux__)
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // Measure only the calling thread on any cpu
+        fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~cacheMissCounter() {
+#if defined(__linux__)
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    cacheMissCounter(const cacheMissCounter&) = delete;
+    cacheMissCounter& operator=(const cacheMissCounter&) = delete;
+
+    // True when the hardware counter could be opened
+    bool available() const { return fd >= 0; }
+
+    // Resets and enables the counter
+    void start() {
+#if defined(__linux__)
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    // Disables the counter and latches the number of misses counted since start()
+    void stop() {
+#if defined(__linux__)
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        std::uint64_t count = 0;
+        if (read(fd, &count, sizeof(count)) == sizeof(count))
+            misses = count;
+#endif
+    }
+
+    // Number of cache misses latched by the last stop()
+    std::uint64_t value() const { return misses; }
+
+private:
+    int fd = -1;
+    std::uint64_t misses = 0;
+};
+
+// Current resident set size of the process in bytes (Linux only, 0 elsewhere)
+inline std::uint64_t residentBytes() {
+#if defined(__linux__)
+    long pages = 0, resident = 0;
+    if (FILE* statm = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(statm);
+    }
+    return std::uint64_t(resident) * std::uint64_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// Highest resident set size the process has reached so far in bytes (Linux only, 0 elsewhere)
+inline std::uint64_t peakResidentBytes() {
+#if defined(__linux__)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    // ru_maxrss is in kilobytes on Linux
+    return std::uint64_t(usage.ru_maxrss) * 1024;
+#else
+    return 0;
+#endif
+}
+
+// Bytes currently allocated on the heap (glibc 2.33 or newer), falls back to the resident set size elsewhere
+inline std::uint64_t heapBytesInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    auto info = mallinfo2();
+    return std::uint64_t(info.uordblks) + std::uint64_t(info.hblkhd);
+#else
+    return residentBytes();
+#endif
+}
+
+// Simple wall-clock stopwatch used by the render statistics and the benchmarks
+class stopwatch {
+public:
+    stopwatch() : begin(std::chrono::steady_clock::now()) {}
+
+    // Restarts the measurement from now
+    void reset() { begin = std::chrono::steady_clock::now(); }
+
+    // Seconds elapsed since construction or the last reset()
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point begin;
+};
+
+// Counters gathered by camera::render; rays are counted per intersection query so primary and secondary rays are both included
+class renderStats {
+public:
+    // Number of camera rays generated
+    std::uint64_t primaryRays = 0;
+    // Number of scattered rays that were traced after a bounce
+    std::uint64_t secondaryRays = 0;
+    // Wall-clock time spent in render()
+    double seconds = 0;
+    // Last-level cache misses during render(), only meaningful when cacheMissesAvailable is true
+    std::uint64_t cacheMisses = 0;
+    bool cacheMissesAvailable = false;
+
+    // Total number of rays traced
+    std::uint64_t rays() const { return primaryRays + secondaryRays; }
+
+    // Throughput in rays per second
+    double raysPerSecond() const { return seconds > 0 ? rays() / seconds : 0; }
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef RAYBATCH_H
+#define RAYBATCH_H
+
+#include "hittable.h"
+
+// Libraries for sorting and dynamic arrays
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// One in-flight camera path of the batched bounce mode
+class pathState {
+public:
+    // The ray that will be intersected with the scene in the next bounce
+    ray r;
+    // Product of the attenuations of all surfaces the path has scattered from so far
+    color throughput;
+    // Index of the pixel (within the row being rendered) that receives the path's radiance
+    int pixel;
+    // Width of the path's ray cone at the origin of r (see camera::traceFootprint)
+    double coneWidth = 0;
+};
+
+// Spreads the lower 20 bits of x so that there are two zero bits between each of them
+inline std::uint64_t expandBits(std::uint64_t x) {
+    x &= 0xfffff;
+    x = (x | (x << 32)) & 0x00001f00000000ffULL;
+    x = (x | (x << 16)) & 0x001f0000ff0000ffULL;
+    x = (x | (x << 8))  & 0x100f00f00f00f00fULL;
+    x = (x | (x << 4))  & 0x10c30c30c30c30c3ULL;
+    x = (x | (x << 2))  & 0x1249249249249249ULL;
+    return x;
+}
+
+// Interleaves three 20 bit integer coordinates into a 60 bit Morton (Z-order) code
+inline std::uint64_t mortonCode(std::uint64_t x, std::uint64_t y, std::uint64_t z) {
+    return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+}
+
+// Returns 0-7 depending on the signs of the direction components, rays in the same octant traverse the scene in a similar order
+inline std::uint64_t directionOctant(const vec3& d) {
+    return (d.x() < 0 ? 4 : 0) | (d.y() < 0 ? 2 : 0) | (d.z() < 0 ? 1 : 0);
+}
+
+// A batch of paths that are advanced one bounce at a time
+// Before each bounce the paths are reordered by a coherence key so that neighbouring rays start close to each other and travel in the same octant, which keeps the objects they touch hot in the cache
+class rayBatch {
+public:
+    std::vector<pathState> paths;
+
+    // Grows paths and the sort buffers to hold count paths, so a batch of that size traces without allocating
+    void reserve(std::size_t count) {
+        paths.reserve(count);
+        keys.reserve(count);
+        scratch.reserve(count);
+    }
+
+    // Sorts the paths by (direction octant, Morton code of the origin); the origin is quantized inside the bounds of the current batch
+    void sortByCoherence() {
+        if (paths.size() < 2)
+            return;
+
+        // Bounds of all ray origins in the batch
+        point3 lo( infinity,  infinity,  infinity);
+        point3 hi(-infinity, -infinity, -infinity);
+        for (const auto& p : paths) {
+            for (int axis = 0; axis < 3; axis++) {
+                lo[axis] = std::fmin(lo[axis], p.r.origin()[axis]);
+                hi[axis] = std::fmax(hi[axis], p.r.origin()[axis]);
+            }
+        }
+
+        // Scale factors mapping the bounds onto the 20 bit grid of the Morton code
+        const double cells = double((1 << 20) - 1);
+        double scale[3];
+        for (int axis = 0; axis < 3; axis++) {
+            auto extent = hi[axis] - lo[axis];
+            scale[axis] = extent > 0 ? cells / extent : 0;
+        }
+
+        // Builds (key, index) pairs, the octant occupies the top three bits so it dominates the ordering
+        keys.resize(paths.size());
+        for (std::size_t i = 0; i < paths.size(); i++) {
+            const auto& o = paths[i].r.origin();
+            auto qx = std::uint64_t((o.x() - lo.x()) * scale[0]);
+            auto qy = std::uint64_t((o.y() - lo.y()) * scale[1]);
+            auto qz = std::uint64_t((o.z() - lo.z()) * scale[2]);
+            keys[i] = { (directionOctant(paths[i].r.direction()) << 60) | mortonCode(qx, qy, qz), std::uint32_t(i) };
+        }
+        std::sort(keys.begin(), keys.end());
+
+        // Gathers the paths into their sorted order
+        scratch.resize(paths.size());
+        for (std::size_t i = 0; i < keys.size(); i++)
+            scratch[i] = paths[keys[i].second];
+        paths.swap(scratch);
+    }
+
+private:
+    // Reused buffers so sorting does not allocate once the batch has reached its working size
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> keys;
+    std::vector<pathState> scratch;
+};
+
+#endif
@@ -0,0 +1,381 @@
+#include "renderer.h"
+
+#include "utils.h"
+
+#include "camera.h"
+#include "hittableList.h"
+#include "material.h"
+#include "sceneGenerator.h"
+#include "scenes.h"
+#include "sphere.h"
+#include "threadPool.h"
+#include "uniformGrid.h"
+#include "wideBvh.h"
+
+// Libraries for the one-time acceleration build, the material table, asynchronous renders and cancellation timing
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <vector>
+
+// Scene objects plus the acceleration structure built from them on the first render
+class renderScene::state {
+public:
+    hittableList world;
+    std::vector<shared_ptr<material>> materials;
+    renderAcceleration acceleration = renderAcceleration::bvh;
+
+    // Builds the acceleration structure once, even when the first renders start concurrently
+    void prepare() {
+        std::call_once(built, [this] {
+            if (acceleration == renderAcceleration::grid)
+                grid = std::make_unique<uniformGrid>(world);
+            else if (acceleration == renderAcceleration::bvh)
+                bvh = std::make_unique<wideBvh>(world);
+            frozen = true;
+        });
+    }
+
+    // Calls body with the scene as its concrete acceleration type so the trace loop is specialized for it
+    template <typename Body>
+    void visit(Body&& body) const {
+        if (grid)
+            body(*grid);
+        else if (bvh)
+            body(*bvh);
+        else
+            body(world);
+    }
+
+    // Set once the scene has been rendered; it can no longer change from then on
+    // Atomic because the first render sets it inside call_once while the application may still call the add functions on another thread
+    std::atomic<bool> frozen{false};
+
+private:
+    std::once_flag built;
+    std::unique_ptr<uniformGrid> grid;
+    std::unique_ptr<wideBvh> bvh;
+};
+
+renderScene::renderScene() : impl(std::make_unique<state>()) {}
+renderScene::~renderScene() = default;
+renderScene::renderScene(renderScene&&) noexcept = default;
+renderScene& renderScene::operator=(renderScene&&) noexcept = default;
+
+int renderScene::addLambertian(const renderVector& albedo) {
+    impl->materials.push_back(make_shared<lambertian>(color(albedo.x, albedo.y, albedo.z)));
+    return int(impl->materials.size()) - 1;
+}
+
+int renderScene::addMetal(const renderVector& albedo, double fuzz) {
+    impl->materials.push_back(make_shared<metal>(color(albedo.x, albedo.y, albedo.z), fuzz));
+    return int(impl->materials.size()) - 1;
+}
+
+int renderScene::addDielectric(double refractionIndex) {
+    impl->materials.push_back(make_shared<dielectric>(refractionIndex));
+    return int(impl->materials.size()) - 1;
+}
+
+bool renderScene::addSphere(const renderVector& center, double radius, int materialId) {
+    if (impl->frozen || materialId < 0 || materialId >= int(impl->materials.size()))
+        return false;
+    impl->world.add(make_shared<sphere>(point3(center.x, center.y, center.z), radius, impl->materials[materialId]));
+    return true;
+}
+
+void renderScene::addRandomSphereField(int halfExtent, std::uint64_t seed) {
+    if (impl->frozen)
+        return;
+    // The field is drawn from the calling thread's generator restarted from the scene's seed; the caller's own sequence is put back afterwards, so the application's random numbers do not depend on building a scene
+    const randomGenerator callerRandom = threadRandom();
+    seedRandom(seed);
+    hittableList field = randomSphereField(halfExtent);
+    threadRandom() = callerRandom;
+    for (const auto& object : field.objects)
+        impl->world.add(object);
+}
+
+bool renderScene::addGeneratedSphereField(std::size_t sphereCount, std::uint64_t seed, const std::string& distribution, std::size_t materialPalette) {
+    sceneGeneratorConfig config;
+    config.sphereCount = sphereCount;
+    config.seed = seed;
+    config.materialPalette = materialPalette;
+    if (impl->frozen || !parseDistribution(distribution, config.distribution))
+        return false;
+    for (const auto& object : generateSphereFieldList(config).objects)
+        impl->world.add(object);
+    return true;
+}
+
+void renderScene::setAcceleration(renderAcceleration acceleration) {
+    if (!impl->frozen)
+        impl->acceleration = acceleration;
+}
+
+void renderScene::build() {
+    impl->prepare();
+}
+
+std::size_t renderScene::size() const {
+    return impl->world.objects.size();
+}
+
+int renderSettings::imageHeight() const {
+    camera cam;
+    cam.imageWidth = imageWidth;
+    cam.aspectRatio = aspectRatio;
+    return cam.outputHeight();
+}
+
+// Worker threads of a renderer; the calling thread of a render is the last participant
+class renderer::state {
+public:
+    std::unique_ptr<threadPool> pool;
+    unsigned threads = 1;
+
+    // Camera for settings that renders on the pool and never writes to a stream
+    camera makeCamera(const renderSettings& settings) const {
+        camera cam;
+        cam.imageWidth = settings.imageWidth;
+        cam.aspectRatio = settings.aspectRatio;
+        cam.samplesPerPixel = settings.samplesPerPixel;
+        cam.maxDepth = settings.maxDepth;
+        cam.vfov = settings.vfov;
+        cam.lookFrom = point3(settings.lookFrom.x, settings.lookFrom.y, settings.lookFrom.z);
+        cam.lookAt = point3(settings.lookAt.x, settings.lookAt.y, settings.lookAt.z);
+        cam.vup = vec3(settings.vup.x, settings.vup.y, settings.vup.z);
+        cam.defocusAngle = settings.defocusAngle;
+        cam.focusDist = settings.focusDist;
+        cam.seed = settings.seed;
+        const filterType filters[] = { filterType::box, filterType::gaussian, filterType::mitchell, filterType::blackmanHarris };
+        cam.filter = reconstructionFilter(filters[int(settings.filter)], settings.filterRadius);
+        cam.pool = pool.get();
+        cam.output = nullptr;
+        cam.progressLog = nullptr;
+        return cam;
+    }
+
+    // Renders scene tile by tile into image (or per-thread tile buffers when image is null) and reports each tile to onTile; cancel, when given, stops the render early
+    // firstRow/lastRow restrict the render to a strip of rows that image holds (see camera::renderTiles)
+    renderSummary renderInto(const renderScene& scene, const renderSettings& settings, float* image, std::size_t rowStride, const renderTileCallback& onTile,
+                             const std::atomic<bool>* cancel = nullptr, int firstRow = 0, int lastRow = -1) {
+        camera cam = makeCamera(settings);
+        cam.cancel = cancel;
+        scene.impl->prepare();
+        scene.impl->visit([&](const auto& world) {
+            cam.renderTiles(world, settings.tileSize, image, rowStride, [&](const imageTile& tile) {
+                if (!onTile)
+                    return;
+                renderTile view;
+                view.x = tile.x;
+                view.y = tile.y;
+                view.width = tile.width;
+                view.height = tile.height;
+                view.pixels = tile.pixels;
+                view.rowStride = tile.rowStride;
+                onTile(view);
+            }, firstRow, lastRow);
+        });
+
+        renderSummary summary;
+        summary.primaryRays = cam.stats.primaryRays;
+        summary.secondaryRays = cam.stats.secondaryRays;
+        summary.seconds = cam.stats.seconds;
+        return summary;
+    }
+};
+
+// Shared state of an asynchronous render: its image, which tiles are finished, the cancel request and the eventual result
+class renderTask::state {
+public:
+    int width = 0, height = 0;
+    int tileSize = 1, tilesX = 0, tileCount = 0;
+    // Image the render writes into: the caller's or ownImage
+    float* image = nullptr;
+    std::size_t rowStride = 0;
+    std::vector<float> ownImage;
+    // One flag per tile, set after the tile's last pixel is written so snapshot() never reads pixels that are still changing
+    std::unique_ptr<std::atomic<bool>[]> tileFinished;
+    std::atomic<int> tilesFinished{0};
+
+    std::atomic<bool> cancelFlag{false};
+    // Steady-clock time of the first cancel request in nanoseconds, 0 while there is none
+    std::atomic<std::int64_t> cancelRequested{0};
+
+    std::shared_future<renderSummary> result;
+
+    // The render writes into memory this state points at, so it has to stop before the state goes away
+    ~state() {
+        cancelFlag.store(true, std::memory_order_relaxed);
+        if (result.valid())
+            result.wait();
+    }
+
+    static std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+renderTask::renderTask() {}
+renderTask::~renderTask() = default;
+
+bool renderTask::valid() const {
+    return impl != nullptr;
+}
+
+void renderTask::cancel() {
+    if (!impl)
+        return;
+    std::int64_t none = 0;
+    impl->cancelRequested.compare_exchange_strong(none, state::now());
+    impl->cancelFlag.store(true, std::memory_order_relaxed);
+}
+
+bool renderTask::done() const {
+    return impl && impl->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+double renderTask::progress() const {
+    if (!impl || impl->tileCount == 0)
+        return 0;
+    return double(impl->tilesFinished.load(std::memory_order_relaxed)) / impl->tileCount;
+}
+
+void renderTask::snapshot(float* rgba, std::size_t rowStride) const {
+    if (!impl)
+        return;
+    if (rowStride == 0)
+        rowStride = std::size_t(impl->width) * 4;
+    const int tileSize = impl->tileSize;
+    for (int t = 0; t < impl->tileCount; t++) {
+        const int x = (t % impl->tilesX) * tileSize;
+        const int y = (t / impl->tilesX) * tileSize;
+        const std::size_t rowBytes = std::size_t(std::min(tileSize, impl->width - x)) * 4 * sizeof(float);
+        const bool finished = impl->tileFinished[t].load(std::memory_order_acquire);
+        for (int j = y; j < std::min(y + tileSize, impl->height); j++) {
+            float* to = rgba + j * rowStride + std::size_t(x) * 4;
+            if (finished)
+                std::memcpy(to, impl->image + j * impl->rowStride + std::size_t(x) * 4, rowBytes);
+            else
+                std::memset(to, 0, rowBytes);
+        }
+    }
+}
+
+renderSummary renderTask::wait() const {
+    return impl ? impl->result.get() : renderSummary();
+}
+
+renderer::renderer(unsigned threadCount) : impl(std::make_unique<state>()) {
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    impl->threads = threadCount;
+    // The calling thread always participates, so one thread needs no pool at all
+    if (threadCount > 1)
+        impl->pool = std::make_unique<threadPool>(threadCount - 1);
+}
+
+renderer::~renderer() = default;
+
+renderSummary renderer::render(const renderScene& scene, const renderSettings& settings, float* rgba, std::size_t rowStride, const renderTileCallback& onTile) {
+    if (rowStride == 0)
+        rowStride = std::size_t(settings.imageWidth) * 4;
+    return impl->renderInto(scene, settings, rgba, rowStride, onTile);
+}
+
+renderSummary renderer::renderTiles(const renderScene& scene, const renderSettings& settings, const renderTileCallback& onTile) {
+    return impl->renderInto(scene, settings, nullptr, 0, onTile);
+}
+
+fileRenderSummary renderer::renderToFile(const renderScene& scene, const renderSettings& settings, const std::string& path, std::uint64_t memoryBudget) {
+    fileRenderSummary summary;
+    const int width = settings.imageWidth;
+    const int height = settings.imageHeight();
+    const std::size_t rowStride = std::size_t(width) * 4;
+    const std::uint64_t rowBytes = rowStride * sizeof(float);
+
+    // Two strips: one being rendered and one being encoded
+    summary.stripHeight = int(std::max<std::uint64_t>(1, std::min<std::uint64_t>(height, memoryBudget / (2 * rowBytes))));
+    std::vector<float> strips[2];
+    for (auto& strip : strips)
+        strip.resize(std::size_t(summary.stripHeight) * rowStride);
+    summary.bufferBytes = 2 * summary.stripHeight * rowBytes;
+
+    ppmFileWriter file(path, width, height);
+    if (!file.good())
+        return summary;
+
+    stopwatch timer;
+    std::future<double> encoding;
+    for (int firstRow = 0; firstRow < height; firstRow += summary.stripHeight) {
+        const int rows = std::min(summary.stripHeight, height - firstRow);
+        float* strip = strips[summary.strips % 2].data();
+        auto part = impl->renderInto(scene, settings, strip, rowStride, {}, nullptr, firstRow, firstRow + rows);
+        summary.primaryRays += part.primaryRays;
+        summary.secondaryRays += part.secondaryRays;
+        summary.strips++;
+
+        // The other buffer is reused by the next strip, so its encoding has to be done first
+        if (encoding.valid())
+            summary.encodeSeconds += encoding.get();
+        encoding = std::async(std::launch::async, [&file, strip, rows, rowStride]() {
+            stopwatch encodeTimer;
+            file.writeRows(strip, rows, rowStride);
+            return encodeTimer.seconds();
+        });
+    }
+    if (encoding.valid())
+        summary.encodeSeconds += encoding.get();
+
+    summary.fileBytes = file.bytesWritten;
+    summary.written = file.close();
+    summary.seconds = timer.seconds();
+    return summary;
+}
+
+renderTask renderer::renderAsync(const renderScene& scene, const renderSettings& settings, float* rgba, std::size_t rowStride, const renderTileCallback& onTile) {
+    renderTask task;
+    task.impl = std::make_shared<renderTask::state>();
+    auto& work = *task.impl;
+    work.width = settings.imageWidth;
+    work.height = settings.imageHeight();
+    work.tileSize = std::max(1, settings.tileSize);
+    work.tilesX = (work.width + work.tileSize - 1) / work.tileSize;
+    work.tileCount = work.tilesX * ((work.height + work.tileSize - 1) / work.tileSize);
+    work.tileFinished = std::make_unique<std::atomic<bool>[]>(work.tileCount);
+    if (rgba) {
+        work.image = rgba;
+        work.rowStride = rowStride ? rowStride : std::size_t(work.width) * 4;
+    } else {
+        work.ownImage.assign(std::size_t(work.width) * work.height * 4, 0.0f);
+        work.image = work.ownImage.data();
+        work.rowStride = std::size_t(work.width) * 4;
+    }
+
+    // The render thread only sees the state through a plain pointer; the state outlives it because its destructor waits for the result
+    renderer::state* tracer = impl.get();
+    renderTask::state* shared = task.impl.get();
+    work.result = std::async(std::launch::async, [tracer, shared, &scene, settings, onTile]() {
+        auto summary = tracer->renderInto(scene, settings, shared->image, shared->rowStride, [&](const renderTile& tile) {
+            int t = (tile.y / shared->tileSize) * shared->tilesX + tile.x / shared->tileSize;
+            shared->tileFinished[t].store(true, std::memory_order_release);
+            shared->tilesFinished.fetch_add(1, std::memory_order_relaxed);
+            if (onTile)
+                onTile(tile);
+        }, &shared->cancelFlag);
+
+        std::int64_t requested = shared->cancelRequested.load();
+        summary.cancelled = requested != 0 && shared->tilesFinished.load() < shared->tileCount;
+        if (requested != 0)
+            summary.cancelLatency = std::max<std::int64_t>(0, renderTask::state::now() - requested) * 1e-9;
+        return summary;
+    }).share();
+    return task;
+}
+
+unsigned renderer::threadCount() const {
+    return impl->threads;
+}
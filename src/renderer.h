@@ -0,0 +1,222 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+// Public interface of the weekendfun library, for applications that link the ray tracer instead of running the executable
+// Only standard headers are included and the renderer's own types stay in renderer.cc, so the interface does not change when the internals do
+// Nothing here writes to stdout or stderr and no global state is used: every render draws its random numbers from its own seed
+
+// Libraries for sizes, seeds, the tile callback, opaque implementations and distribution names
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Position, direction or color passed into the library
+class renderVector {
+public:
+    double x = 0, y = 0, z = 0;
+
+    renderVector() {}
+    renderVector(double x, double y, double z) : x(x), y(y), z(z) {}
+};
+
+// Acceleration structure a scene is traced through
+enum class renderAcceleration {
+    // Tests every object against every ray; fine for a handful of objects
+    list,
+    // Uniform grid with 3D-DDA traversal
+    grid,
+    // Compressed 4-wide BVH, the best choice for large scenes
+    bvh
+};
+
+// Reconstruction filter that turns the samples into pixels
+enum class renderFilter {
+    // Plain average of each pixel's samples
+    box,
+    // The others also weight samples into the neighbouring pixels, which gives smoother, less noisy and less aliased images at the same sample count but blurs edges somewhat; Mitchell keeps the most sharpness (see --bench filters)
+    gaussian,
+    mitchell,
+    blackmanHarris
+};
+
+// Collection of spheres and materials to render
+// Objects can be added until the first render; the acceleration structure is built on the first render and reused by all later ones
+class renderScene {
+public:
+    renderScene();
+    ~renderScene();
+    renderScene(renderScene&&) noexcept;
+    renderScene& operator=(renderScene&&) noexcept;
+
+    // Adds a material and returns its id for addSphere
+    int addLambertian(const renderVector& albedo);
+    int addMetal(const renderVector& albedo, double fuzz);
+    int addDielectric(double refractionIndex);
+
+    // Adds a sphere made of the material materialId; returns false (and adds nothing) for an unknown material or after the first render
+    bool addSphere(const renderVector& center, double radius, int materialId);
+
+    // Adds the random sphere field of the final render (halfExtent = 11 is the book cover scene)
+    void addRandomSphereField(int halfExtent = 11, std::uint64_t seed = 1);
+
+    // Adds a procedurally generated sphere field; distribution is "uniform", "clustered" or "nested" and materialPalette limits the distinct materials per type (0 = one per sphere)
+    // Returns false for an unknown distribution
+    bool addGeneratedSphereField(std::size_t sphereCount, std::uint64_t seed = 1, const std::string& distribution = "uniform", std::size_t materialPalette = 0);
+
+    // Selects the acceleration structure; only has an effect before the first render
+    void setAcceleration(renderAcceleration acceleration);
+
+    // Builds the acceleration structure now instead of on the first render, so its cost (time and memory) can be measured apart from rendering
+    // The scene can no longer change afterwards, just like after the first render
+    void build();
+
+    // Number of objects in the scene
+    std::size_t size() const;
+
+private:
+    class state;
+    std::unique_ptr<state> impl;
+    friend class renderer;
+};
+
+// Camera and sampling settings of one render, with the defaults of the final render
+class renderSettings {
+public:
+    int imageWidth = 1200;
+    double aspectRatio = 16.0 / 9.0;
+    int samplesPerPixel = 500;
+    int maxDepth = 50;
+
+    // Vertical field of view in degrees
+    double vfov = 20;
+    renderVector lookFrom = renderVector(13, 2, 3);
+    renderVector lookAt = renderVector(0, 0, 0);
+    renderVector vup = renderVector(0, 1, 0);
+
+    // Defocus blur cone angle in degrees and distance of the plane of perfect focus
+    double defocusAngle = 0.6;
+    double focusDist = 10.0;
+
+    // Seed of the render's random numbers; the same seed gives the same image regardless of thread count and tile size
+    std::uint64_t seed = 1;
+
+    // Edge length in pixels of the square tiles the image is rendered in
+    int tileSize = 32;
+
+    // Reconstruction filter and its radius in pixels (0 = the filter's usual radius)
+    renderFilter filter = renderFilter::box;
+    double filterRadius = 0;
+
+    // Height of the image in pixels, derived from imageWidth and aspectRatio
+    int imageHeight() const;
+};
+
+// Finished rectangle of the image, passed to the tile callback
+// pixels holds linear (not gamma-corrected) float RGBA with alpha 1; rowStride is the distance in floats between two pixel rows
+class renderTile {
+public:
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+    const float* pixels = nullptr;
+    std::size_t rowStride = 0;
+};
+
+// Called once per finished tile, possibly from several threads at the same time
+using renderTileCallback = std::function<void(const renderTile&)>;
+
+// Counters of one render
+class renderSummary {
+public:
+    std::uint64_t primaryRays = 0;
+    std::uint64_t secondaryRays = 0;
+    double seconds = 0;
+    // Set when the render was cancelled before it finished; cancelLatency is the time in seconds from the cancel request until every thread had stopped
+    bool cancelled = false;
+    double cancelLatency = 0;
+};
+
+// Counters of a render written straight to disk with renderer::renderToFile
+class fileRenderSummary : public renderSummary {
+public:
+    // False if the file could not be created or written
+    bool written = false;
+    // Rows per strip and number of strips the image was rendered in
+    int stripHeight = 0;
+    int strips = 0;
+    // Memory held by the strip buffers, the bulk of what the render needs besides the scene
+    std::uint64_t bufferBytes = 0;
+    // Size of the file and the time spent encoding and writing it, which overlaps with rendering
+    std::uint64_t fileBytes = 0;
+    double encodeSeconds = 0;
+};
+
+// Handle of a render started with renderer::renderAsync
+// Copies share the same render; when the last copy goes away an unfinished render is cancelled and waited for, so its image is never written after that
+// The scene and the renderer must outlive the render
+class renderTask {
+public:
+    renderTask();
+    ~renderTask();
+
+    // False for a default-constructed handle
+    bool valid() const;
+
+    // Asks the render to stop; threads finish the sample they are tracing and start no new work, unfinished tiles stay unrendered
+    void cancel();
+
+    // True once the render has finished or stopped after a cancel
+    bool done() const;
+
+    // Fraction of tiles finished, in [0,1]
+    double progress() const;
+
+    // Copies the finished tiles of the image into rgba (imageWidth x imageHeight RGBA floats, rows rowStride floats apart, 0 = tightly packed)
+    // Pixels of unfinished tiles are set to 0, including alpha, so a preview can tell them apart; safe to call while the render runs
+    void snapshot(float* rgba, std::size_t rowStride = 0) const;
+
+    // Blocks until the render has finished or stopped and returns its counters; may be called any number of times
+    renderSummary wait() const;
+
+private:
+    class state;
+    std::shared_ptr<state> impl;
+    friend class renderer;
+};
+
+// Renders scenes on a fixed set of threads
+// render and renderTiles may be called from several threads at once; concurrent renders share the threads
+class renderer {
+public:
+    // threadCount threads take part in every render including the calling one; 0 uses one per hardware thread
+    explicit renderer(unsigned threadCount = 0);
+    ~renderer();
+    renderer(const renderer&) = delete;
+    renderer& operator=(const renderer&) = delete;
+
+    // Renders into the caller's image of settings.imageWidth x settings.imageHeight() RGBA floats, rows rowStride floats apart (0 = tightly packed)
+    // Pixels are written in place, there is no intermediate copy; onTile, when given, is called after each tile with a view into the image
+    renderSummary render(const renderScene& scene, const renderSettings& settings, float* rgba, std::size_t rowStride = 0, const renderTileCallback& onTile = {});
+
+    // Renders without a caller image; every tile is handed to onTile from a per-thread buffer that is only valid during the call
+    renderSummary renderTiles(const renderScene& scene, const renderSettings& settings, const renderTileCallback& onTile);
+
+    // Renders an image of any size straight into a binary PPM file while holding at most memoryBudget bytes of image data
+    // The image is rendered in strips of full rows; while one strip renders, the previous one is encoded and written on another thread, so the budget covers two strip buffers
+    // Strips are at least one row high, so the budget is exceeded only when two rows of float RGBA do not fit in it
+    fileRenderSummary renderToFile(const renderScene& scene, const renderSettings& settings, const std::string& path, std::uint64_t memoryBudget);
+
+    // Starts a render on its own thread and returns immediately
+    // Renders into rgba like render() does; without an image the renderer keeps one for the task, which snapshot() reads from
+    renderTask renderAsync(const renderScene& scene, const renderSettings& settings, float* rgba = nullptr, std::size_t rowStride = 0, const renderTileCallback& onTile = {});
+
+    // Number of threads taking part in a render
+    unsigned threadCount() const;
+
+private:
+    class state;
+    std::unique_ptr<state> impl;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include "hittableList.h"
+#include "material.h"
+#include "sphere.h"
+#include "staticScene.h"
+
+// Libraries for the seeded random engine, string parsing and dynamic arrays
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// How the small spheres are spread over the ground plane
+enum class sceneDistribution {
+    // One sphere per jittered unit cell of a square field, the layout of the final render scene
+    uniform,
+    // Gaussian clusters of spheres around uniformly placed cluster centers
+    clustered,
+    // Clusters of clusters: every level splits into sub-clusters with a quarter of the spread, giving dense spots at several scales
+    nested
+};
+
+// Parses "uniform", "clustered" or "nested"; returns false for anything else
+inline bool parseDistribution(const std::string& name, sceneDistribution& distribution) {
+    if (name == "uniform")   { distribution = sceneDistribution::uniform;   return true; }
+    if (name == "clustered") { distribution = sceneDistribution::clustered; return true; }
+    if (name == "nested")    { distribution = sceneDistribution::nested;    return true; }
+    return false;
+}
+
+// Deterministic uniform value in [0,1) for (seed, key, channel), based on the splitmix64 mixing function
+inline double hashUnit(std::uint64_t seed, std::uint64_t key, std::uint64_t channel) {
+    std::uint64_t z = seed + 0x9e3779b97f4a7c15ULL * (key * 4 + channel + 1);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Deterministic standard normal value for (seed, key, channel) using the Box-Muller transform
+inline double hashGaussian(std::uint64_t seed, std::uint64_t key, std::uint64_t channel) {
+    double u1 = 1.0 - hashUnit(seed, key, 2 * channel);
+    double u2 = hashUnit(seed, key, 2 * channel + 1);
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(2 * pi * u2);
+}
+
+// Settings of the procedural benchmark scene
+class sceneGeneratorConfig {
+public:
+    // Number of small spheres (the ground and the three feature spheres come on top); the final scene has about 480
+    std::size_t sphereCount = 484;
+    // Seed of the generator's own random engine, the same seed always produces the same scene
+    std::uint64_t seed = 1;
+    sceneDistribution distribution = sceneDistribution::uniform;
+    // Adds the three large glass, diffuse and metal spheres of the final scene
+    bool featureSpheres = true;
+    // Number of distinct materials per material type; 0 gives every sphere its own material like the final scene, a small palette keeps 10^8 sphere scenes from being dominated by material objects
+    std::size_t materialPalette = 0;
+};
+
+// Generates the spheres of a scaled version of the final render scene
+// The material mix matches main.cc: 80% lambertian (albedo = random * random), 15% metal (albedo in [0.5,1), fuzz in [0,0.5)), 5% dielectric (index 1.5)
+// addSphere(center, radius, material, materialId) is called for every sphere with a concrete material value; materialId is the palette slot when materialPalette > 0 and SIZE_MAX for unique materials
+// Spheres are produced one at a time so even 10^8 sphere scenes can be streamed into a compact representation
+template <typename AddSphere>
+void generateSphereField(const sceneGeneratorConfig& config, AddSphere&& addSphere) {
+    std::mt19937_64 engine(config.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    auto random = [&](double min, double max) { return min + (max - min) * unit(engine); };
+    const std::size_t unique = SIZE_MAX;
+
+    addSphere(point3(0,-1000,0), 1000, lambertian(color(0.5, 0.5, 0.5)), unique);
+
+    // Palette materials are drawn from a separate engine so the sphere layout does not depend on the palette size
+    std::mt19937_64 paletteEngine(config.seed ^ 0x9e3779b97f4a7c15ULL);
+    auto paletteRandom = [&](double min, double max) { return min + (max - min) * unit(paletteEngine); };
+    std::vector<lambertian> diffusePalette;
+    std::vector<metal> metalPalette;
+    for (std::size_t m = 0; m < config.materialPalette; m++) {
+        diffusePalette.emplace_back(color(paletteRandom(0,1), paletteRandom(0,1), paletteRandom(0,1)) * color(paletteRandom(0,1), paletteRandom(0,1), paletteRandom(0,1)));
+        metalPalette.emplace_back(color(paletteRandom(0.5,1), paletteRandom(0.5,1), paletteRandom(0.5,1)), paletteRandom(0, 0.5));
+    }
+
+    // Emits one small sphere at center with a material drawn from the final scene's mix
+    auto emit = [&](const point3& center) {
+        const double radius = 0.2;
+        auto chooseMat = unit(engine);
+        if (config.materialPalette > 0) {
+            auto slot = std::size_t(unit(engine) * config.materialPalette) % config.materialPalette;
+            if (chooseMat < 0.8)
+                addSphere(center, radius, diffusePalette[slot], slot);
+            else if (chooseMat < 0.95)
+                addSphere(center, radius, metalPalette[slot], config.materialPalette + slot);
+            else
+                addSphere(center, radius, dielectric(1.5), 2 * config.materialPalette);
+            return;
+        }
+        if (chooseMat < 0.8) {
+            // diffuse
+            auto albedo = color(random(0,1), random(0,1), random(0,1)) * color(random(0,1), random(0,1), random(0,1));
+            addSphere(center, radius, lambertian(albedo), unique);
+        } else if (chooseMat < 0.95) {
+            // metal
+            auto albedo = color(random(0.5,1), random(0.5,1), random(0.5,1));
+            auto fuzz = random(0, 0.5);
+            addSphere(center, radius, metal(albedo, fuzz), unique);
+        } else {
+            // glass
+            addSphere(center, radius, dielectric(1.5), unique);
+        }
+    };
+
+    // Keeps the spot of the large metal sphere free, like the final scene
+    auto accept = [](const point3& center) { return (center - point3(4, 0.2, 0)).length() > 0.9; };
+
+    // The field covers about one unit square per sphere, as in the 22x22 final scene
+    const double halfSide = 0.5 * std::ceil(std::sqrt(double(config.sphereCount)));
+    std::size_t emitted = 0;
+
+    if (config.distribution == sceneDistribution::uniform) {
+        // Walks the jittered unit cells row by row; the keep-out spot rejects at most four cells, so a side of ceil(sqrt(N + 4)) always yields N spheres
+        const long side = long(std::ceil(std::sqrt(double(config.sphereCount) + 4)));
+        const long half = side / 2;
+        for (long a = -half; a < side - half && emitted < config.sphereCount; a++) {
+            for (long b = -half; b < side - half && emitted < config.sphereCount; b++) {
+                point3 center(a + 0.9*unit(engine), 0.2, b + 0.9*unit(engine));
+                if (accept(center)) {
+                    emit(center);
+                    emitted++;
+                }
+            }
+        }
+    } else {
+        // Cluster centers are derived from a hash of the cluster's path, so they are fixed for a seed without storing them
+        // Clustered: sqrt(N) clusters; nested: N^(1/4) top clusters, each splitting into 8 sub-clusters over three more levels with a quarter of the spread per level
+        const bool nested = config.distribution == sceneDistribution::nested;
+        const int levels = nested ? 4 : 1;
+        const std::size_t topClusters = std::max<std::size_t>(1, std::size_t(nested ? std::pow(double(config.sphereCount), 0.25) : std::sqrt(double(config.sphereCount))));
+        const double topSpread = std::fmax(1.0, halfSide / std::sqrt(double(topClusters)));
+        std::normal_distribution<double> gaussian(0.0, 1.0);
+
+        while (emitted < config.sphereCount) {
+            // Top-level cluster center, uniform over the field
+            std::uint64_t key = std::uint64_t(unit(engine) * topClusters) % topClusters;
+            double x = -halfSide + 2 * halfSide * hashUnit(config.seed, key, 0);
+            double z = -halfSide + 2 * halfSide * hashUnit(config.seed, key, 1);
+            double spread = topSpread;
+            // Sub-cluster centers, Gaussian around their parent
+            for (int level = 1; level < levels; level++) {
+                key = key * 8 + std::uint64_t(unit(engine) * 8) % 8 + 1;
+                x += spread * hashGaussian(config.seed, key, 0);
+                z += spread * hashGaussian(config.seed, key, 1);
+                spread *= 0.25;
+            }
+            point3 center(x + spread * gaussian(engine), 0.2, z + spread * gaussian(engine));
+            if (accept(center)) {
+                emit(center);
+                emitted++;
+            }
+        }
+    }
+
+    if (config.featureSpheres) {
+        addSphere(point3(0, 1, 0), 1.0, dielectric(1.5), unique);
+        addSphere(point3(-4, 1, 0), 1.0, lambertian(color(0.4, 0.2, 0.1)), unique);
+        addSphere(point3(4, 1, 0), 1.0, metal(color(0.7, 0.6, 0.5), 0.0), unique);
+    }
+}
+
+// Generates the scene as a dynamic hittableList; palette materials are shared between the spheres that use them
+inline hittableList generateSphereFieldList(const sceneGeneratorConfig& config) {
+    hittableList world;
+    world.objects.reserve(config.sphereCount + 4);
+    std::vector<shared_ptr<material>> palette;
+    generateSphereField(config, [&](const point3& center, double radius, const auto& mat, std::size_t materialId) {
+        using Material = std::decay_t<decltype(mat)>;
+        shared_ptr<material> sphereMaterial;
+        if (materialId == SIZE_MAX) {
+            sphereMaterial = make_shared<Material>(mat);
+        } else {
+            if (materialId >= palette.size())
+                palette.resize(materialId + 1);
+            if (!palette[materialId])
+                palette[materialId] = make_shared<Material>(mat);
+            sphereMaterial = palette[materialId];
+        }
+        world.add(make_shared<sphere>(center, radius, sphereMaterial));
+    });
+    return world;
+}
+
+// Generates the scene as a compile-time specialized staticScene
+inline staticScene<lambertian, metal, dielectric> generateSphereFieldStatic(const sceneGeneratorConfig& config) {
+    staticScene<lambertian, metal, dielectric> world;
+    generateSphereField(config, [&](const point3& center, double radius, const auto& mat, std::size_t) {
+        world.add(center, radius, mat);
+    });
+    return world;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "camera.h"
+#include "hittableList.h"
+#include "material.h"
+#include "sphere.h"
+#include "staticScene.h"
+
+// Library for std::decay_t
+#include <type_traits>
+
+// Generates the spheres of the final render scene: a huge ground sphere, a (2*halfExtent)^2 field of small random spheres and three large feature spheres
+// halfExtent = 11 reproduces the 22x22 field of the book cover; larger values scale the same layout and material mix to more spheres
+// addSphere(center, radius, material) is called with a concrete material value so both the dynamic and the static scene can be built from the same sequence of random numbers
+template <typename AddSphere>
+void forEachRandomFieldSphere(int halfExtent, AddSphere&& addSphere) {
+    addSphere(point3(0,-1000,0), 1000, lambertian(color(0.5, 0.5, 0.5)));
+
+    for (int a = -halfExtent; a < halfExtent; a++) {
+        for (int b = -halfExtent; b < halfExtent; b++) {
+            auto chooseMat = randomDouble();
+            point3 center(a + 0.9*randomDouble(), 0.2, b + 0.9*randomDouble());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                if (chooseMat < 0.8) {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    addSphere(center, 0.2, lambertian(albedo));
+                } else if (chooseMat < 0.95) {
+                    // metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = randomDouble(0, 0.5);
+                    addSphere(center, 0.2, metal(albedo, fuzz));
+                } else {
+                    // glass
+                    addSphere(center, 0.2, dielectric(1.5));
+                }
+            }
+        }
+    }
+
+    addSphere(point3(0, 1, 0), 1.0, dielectric(1.5));
+    addSphere(point3(-4, 1, 0), 1.0, lambertian(color(0.4, 0.2, 0.1)));
+    addSphere(point3(4, 1, 0), 1.0, metal(color(0.7, 0.6, 0.5), 0.0));
+}
+
+// Builds the final render scene as a dynamic hittableList with shared materials
+inline hittableList randomSphereField(int halfExtent = 11) {
+    hittableList world;
+    forEachRandomFieldSphere(halfExtent, [&](const point3& center, double radius, const auto& mat) {
+        using Material = std::decay_t<decltype(mat)>;
+        world.add(make_shared<sphere>(center, radius, make_shared<Material>(mat)));
+    });
+    return world;
+}
+
+// Compile-time specialized form of the final render scene
+using sphereFieldScene = staticScene<lambertian, metal, dielectric>;
+
+// Builds the final render scene as a staticScene; with the same random seed it contains exactly the spheres of randomSphereField
+inline sphereFieldScene randomSphereFieldStatic(int halfExtent = 11) {
+    sphereFieldScene world;
+    forEachRandomFieldSphere(halfExtent, [&](const point3& center, double radius, const auto& mat) {
+        world.add(center, radius, mat);
+    });
+    return world;
+}
+
+// Camera looking at the random sphere field from the same viewpoint as the final render
+inline camera finalRenderCamera() {
+    camera cam;
+
+    cam.aspectRatio      = 16.0 / 9.0;
+    cam.imageWidth       = 1200;
+    cam.samplesPerPixel  = 500;
+    cam.maxDepth         = 50;
+
+    cam.vfov     = 20;
+    cam.lookFrom = point3(13,2,3);
+    cam.lookAt   = point3(0,0,0);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocusAngle = 0.6;
+    cam.focusDist    = 10.0;
+
+    return cam;
+}
+
+// The materials test scene of the playground in main(): a lambertian ground and center sphere, a hollow glass sphere on the left and a fuzzy metal sphere on the right
+inline hittableList materialSpheres() {
+    hittableList world;
+
+    auto materialGround = make_shared<lambertian>(color(0.8, 0.8, 0.0));
+    auto materialCenter = make_shared<lambertian>(color(0.1, 0.2, 0.5));
+    auto materialLeft = make_shared<dielectric>(1.50);
+    auto materialBubble = make_shared<dielectric>(1.00 / 1.50);
+    auto materialRight = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
+
+    world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, materialGround));
+    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.2), 0.5, materialCenter));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, materialLeft));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.4, materialBubble));
+    world.add(make_shared<sphere>(point3(1.0, -0.0, -1.0), 0.5, materialRight));
+    return world;
+}
+
+// The positionable camera of the playground looking at materialSpheres from above and to the left, with strong defocus blur
+inline camera materialSpheresCamera() {
+    camera cam;
+
+    cam.aspectRatio      = 16.0 / 9.0;
+    cam.imageWidth       = 400;
+    cam.samplesPerPixel  = 100;
+    cam.maxDepth         = 50;
+
+    cam.vfov     = 25;
+    cam.lookFrom = point3(-2,2,1);
+    cam.lookAt   = point3(0,0,-1);
+    cam.vup      = vec3(0,1,0);
+
+    cam.defocusAngle = 10.0;
+    cam.focusDist    = 3.4;
+
+    return cam;
+}
+
+// The field of view test scene of the playground: a blue and a red sphere touching in front of the camera
+inline hittableList touchingSpheres() {
+    hittableList world;
+    auto R = std::cos(pi/4);
+
+    auto materialLeft  = make_shared<lambertian>(color(0,0,1));
+    auto materialRight = make_shared<lambertian>(color(1,0,0));
+
+    world.add(make_shared<sphere>(point3(-R, 0, -1), R, materialLeft));
+    world.add(make_shared<sphere>(point3( R, 0, -1), R, materialRight));
+    return world;
+}
+
+// Camera of the field of view test: a 90 degree view from the origin down -z in widescreen, with the viewport one unit away like the playground's focal length
+inline camera touchingSpheresCamera() {
+    camera cam;
+
+    cam.aspectRatio      = 16.0 / 9.0;
+    cam.imageWidth       = 400;
+    cam.samplesPerPixel  = 100;
+    cam.maxDepth         = 50;
+
+    cam.vfov      = 90;
+    cam.focusDist = 1.0;
+
+    return cam;
+}
+
+#endif
@@ -3,43 +3,66 @@
 
 #include "hittable.h"
 
+// Ray-sphere intersection shared by every sphere representation; stores the nearest root inside rayT in root and returns true if there is one
+inline bool intersectSphere(const point3& center, double radius, const ray& r, interval rayT, double& root) {
+    // oc is the vector from the ray's origin to the spheres center 
+    vec3 oc = center - r.origin();
+    // a is the squared length of the ray's direction vector
+    auto a = r.direction().squaredLength();
+    // h is the dot product of the ray's direction and oc representing their alignment
+    auto h = dot(r.direction(), oc);
+    // c is te squared length of the oc ray minus the square of the sphere's radius
+    auto c = oc.squaredLength() - radius*radius;
+    // Discriminant checks if there'es an intersection; if negative no hit occurs - return false
+    auto discriminant = h*h - a*c;
+    if (discriminant < 0)
+        return false;
+
+    // Computes the square root of the discriminant for finding the intersection points
+    auto sqrtD = std::sqrt(discriminant);
+
+    // Find the nearest root that lies in the acceptable range (t value)
+    root = (h - sqrtD) / a;
+    // Check if the root is outside the valid range, if so try another root
+    if (!rayT.surrounds(root)) {
+        // Calculates the second possible intersection
+        root = (h + sqrtD) / a;
+        // If this root is also out of range, return false since there is not valid intersection
+        if (!rayT.surrounds(root))
+            return false;
+    }
+
+    return true;
+}
+
 // Defines a sphere class that inherits from hittable, making it a specific type of object that a ray can hit
 class sphere : public hittable {
 public:
     // Constructor initializes center and radius of the sphere; uses fmax which returns the maximum of two floating point arguements, ensures the radius is non-negative
-    sphere(const point3& center, double radius, shared_ptr<material> mat) : center(center), radius(std::fmax(0,radius)), mat(mat) {}
-
-    // Overrides the hit function from the hittable base class to determine if the ray hits the sphere
-    bool hit(const ray& r, interval rayT, hitRecord& rec) const override {
-        // oc is the vector from the ray's origin to the spheres center 
-        vec3 oc = center - r.origin();
-        // a is the squared length of the ray's direction vector
-        auto a = r.direction().squaredLength();
-        // h is the dot product of the ray's direction and oc representing their alignment
-        auto h = dot(r.direction(), oc);
-        // c is te squared length of the oc ray minus the square of the sphere's radius
-        auto c = oc.squaredLength() - radius*radius;
-        // Discriminant checks if there'es an intersection; if negative no hit occurs - return false
-        auto discriminant = h*h - a*c;
-        if (discriminant < 0)
+    sphere(const point3& center, double radius, shared_ptr<material> mat) : center(center), radius(std::fmax(0,radius)), mat(mat) {
+        // The bounding box spans the center plus and minus the radius along every axis
+        auto rvec = vec3(this->radius, this->radius, this->radius);
+        bbox = aabb(center - rvec, center + rvec);
+    }
+
+    // Overrides the intersect function from the hittable base class to determine if the ray hits the sphere
+    bool intersect(const ray& r, interval rayT, hitRecord& rec) const override {
+        // Finds the nearest intersection distance within rayT; no hit means nothing to record
+        double root;
+        if (!intersectSphere(center, radius, r, rayT, root))
             return false;
 
-        // Computes the square root of the discriminant for finding the intersection points
-        auto sqrtD = std::sqrt(discriminant);
-
-        // Find the nearest root that lies in the acceptable range (t value)
-        auto root = (h - sqrtD) / a;
-        // Check if the root is outside the valid range, if so try another root
-        if (!rayT.surrounds(root)) {
-            // Calculates the second possible intersection
-            root = (h + sqrtD) / a;
-            // If this root is also out of range, return false since there is not valid intersection
-            if (!rayT.surrounds(root))
-                return false;
-        }
-
-        // Sets rec.t to the valid intersection point t
+        // Sets rec.t to the valid intersection point t and remembers this sphere; the rest of the record waits until the hit is known to be the closest
         rec.t = root;
+        rec.object = this;
+        return true;
+    }
+
+    // Copy of the sphere for a NUMA replica of the scene; the material stays shared
+    shared_ptr<hittable> clone() const override { return make_shared<sphere>(*this); }
+
+    // Completes the record of the closest hit once traversal is over
+    void finalizeHit(const ray& r, hitRecord& rec) const override {
         // Calculates the intersection point p using the ray function r.at(t)
         rec.p = r.at(rec.t);
 
@@ -50,16 +73,19 @@ public:
         rec.setFaceNormal(r, outwardNormal);
 
         rec.mat = mat;
+        rec.surfaceScale = radius;
         // Calculate the normal vector at the intersection point, pointing outward from the sphere's surface
             // rec.normal - (rec.p - center) / radius;
-
-        // Return true indicating a valid intersection occured 
-        return true;
     }
+
+    // Returns the precomputed bounding box of the sphere
+    aabb boundingBox() const override { return bbox; }
+
 private:
     point3 center;
     double radius;
     shared_ptr<material> mat;
+    aabb bbox;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,165 @@
+#ifndef STATICSCENE_H
+#define STATICSCENE_H
+
+#include "hittable.h"
+#include "material.h"
+#include "sphere.h"
+
+// Libraries for the heterogeneous container tuple and compile-time index sequences
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A sphere that stores its material by value; the material type is part of the sphere type so no pointer or virtual call is involved
+template <typename Material>
+class staticSphere {
+public:
+    staticSphere(const point3& center, double radius, const Material& mat) : center(center), radius(std::fmax(0,radius)), mat(mat) {}
+
+    point3 center;
+    double radius;
+    Material mat;
+};
+
+// Hit record of a static scene; remembers which container (group) and which element produced the closest hit instead of a material pointer
+class staticHitRecord : public hitRecord {
+public:
+    std::size_t group;
+    std::size_t index;
+};
+
+// Compile-time specialized scene: one homogeneous std::vector of spheres per material type
+// camera::render instantiates its trace loop for each staticScene type, so intersection and scattering are resolved at compile time and inline into rayColor
+// Example: staticScene<lambertian, metal, dielectric> holds three sphere containers
+template <typename... Materials>
+class staticScene {
+public:
+    // camera uses this record type when rendering a staticScene
+    using record = staticHitRecord;
+
+    // Adds a sphere to the container that matches the material type
+    template <typename Material>
+    void add(const point3& center, double radius, const Material& mat) {
+        std::get<std::vector<staticSphere<Material>>>(groups).emplace_back(center, radius, mat);
+    }
+
+    // Total number of spheres over all containers
+    std::size_t size() const {
+        return std::apply([](const auto&... group) { return (std::size_t(0) + ... + group.size()); }, groups);
+    }
+
+    // Finds the closest hit over all containers and fills in the hit point, face normal and which sphere was hit
+    bool hit(const ray& r, interval rayT, record& rec) const {
+        bool hitAnything = false;
+        double closestSoFar = rayT.max;
+        hitGroups(r, rayT.min, closestSoFar, hitAnything, rec, std::index_sequence_for<Materials...>{});
+        if (!hitAnything)
+            return false;
+
+        // Only the closest hit gets its point and normal computed
+        rec.t = closestSoFar;
+        rec.p = r.at(rec.t);
+        // Always assigned by the sphere's group; the initial values only keep the compiler from assuming otherwise
+        point3 center(0,0,0);
+        double radius = 1;
+        sphereOf(rec, center, radius, std::index_sequence_for<Materials...>{});
+        rec.setFaceNormal(r, (rec.p - center) / radius);
+        rec.surfaceScale = radius;
+        return true;
+    }
+
+    // Scatters with the material of the sphere recorded in rec; the switch over containers is unrolled at compile time
+    bool scatter(const ray& rIncoming, const record& rec, color& attenuation, ray& scattered) const {
+        return scatterGroups(rIncoming, rec, attenuation, scattered, std::index_sequence_for<Materials...>{});
+    }
+
+    // Albedo of the sphere recorded in rec if its material is diffuse, resolved at compile time like scatter
+    bool diffuseAlbedo(const record& rec, color& albedo) const {
+        return diffuseGroups(rec, albedo, std::index_sequence_for<Materials...>{});
+    }
+
+private:
+    std::tuple<std::vector<staticSphere<Materials>>...> groups;
+
+    // Intersects every sphere of container I, narrowing closestSoFar as closer hits are found
+    template <std::size_t I>
+    void hitGroup(const ray& r, double tMin, double& closestSoFar, bool& hitAnything, record& rec) const {
+        const auto& spheres = std::get<I>(groups);
+        for (std::size_t i = 0; i < spheres.size(); i++) {
+            double root;
+            if (intersectSphere(spheres[i].center, spheres[i].radius, r, interval(tMin, closestSoFar), root)) {
+                hitAnything = true;
+                closestSoFar = root;
+                rec.group = I;
+                rec.index = i;
+            }
+        }
+    }
+
+    template <std::size_t... I>
+    void hitGroups(const ray& r, double tMin, double& closestSoFar, bool& hitAnything, record& rec, std::index_sequence<I...>) const {
+        (hitGroup<I>(r, tMin, closestSoFar, hitAnything, rec), ...);
+    }
+
+    // Looks up the center and radius of the sphere recorded in rec
+    template <std::size_t... I>
+    void sphereOf(const record& rec, point3& center, double& radius, std::index_sequence<I...>) const {
+        ((rec.group == I ? (center = std::get<I>(groups)[rec.index].center, radius = std::get<I>(groups)[rec.index].radius, true) : false) || ...);
+    }
+
+    // Calls the scatter function of the concrete material type; the qualified call rules out virtual dispatch
+    template <std::size_t I>
+    bool scatterGroup(const ray& rIncoming, const record& rec, color& attenuation, ray& scattered) const {
+        using Material = std::tuple_element_t<I, std::tuple<Materials...>>;
+        return std::get<I>(groups)[rec.index].mat.Material::scatter(rIncoming, rec, attenuation, scattered);
+    }
+
+    template <std::size_t... I>
+    bool scatterGroups(const ray& rIncoming, const record& rec, color& attenuation, ray& scattered, std::index_sequence<I...>) const {
+        bool scatteredRay = false;
+        ((rec.group == I ? (scatteredRay = scatterGroup<I>(rIncoming, rec, attenuation, scattered), true) : false) || ...);
+        return scatteredRay;
+    }
+
+    template <std::size_t I>
+    bool diffuseGroup(const record& rec, color& albedo) const {
+        using Material = std::tuple_element_t<I, std::tuple<Materials...>>;
+        return std::get<I>(groups)[rec.index].mat.Material::diffuseAlbedo(rec, albedo);
+    }
+
+    template <std::size_t... I>
+    bool diffuseGroups(const record& rec, color& albedo, std::index_sequence<I...>) const {
+        bool diffuse = false;
+        ((rec.group == I ? (diffuse = diffuseGroup<I>(rec, albedo), true) : false) || ...);
+        return diffuse;
+    }
+};
+
+// Selects the hit record type a scene is traced with: hitRecord for dynamic hittables, the scene's own record type otherwise
+template <typename World, typename = void>
+struct sceneRecord { using type = hitRecord; };
+
+template <typename World>
+struct sceneRecord<World, std::void_t<typename World::record>> { using type = typename World::record; };
+
+// Scatters a ray off the surface described by rec; dynamic scenes go through the material pointer, static scenes resolve the material at compile time
+template <typename World>
+inline bool scatterAt(const World& world, const ray& rIncoming, const typename sceneRecord<World>::type& rec, color& attenuation, ray& scattered) {
+    if constexpr (std::is_base_of_v<hittable, World>)
+        return rec.mat->scatter(rIncoming, rec, attenuation, scattered);
+    else
+        return world.scatter(rIncoming, rec, attenuation, scattered);
+}
+
+// Albedo of the surface described by rec if it reflects diffusely; false for specular materials
+template <typename World>
+inline bool diffuseAlbedoAt(const World& world, const typename sceneRecord<World>::type& rec, color& albedo) {
+    if constexpr (std::is_base_of_v<hittable, World>)
+        return rec.mat->diffuseAlbedo(rec, albedo);
+    else
+        return world.diffuseAlbedo(rec, albedo);
+}
+
+#endif
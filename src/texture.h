@@ -0,0 +1,47 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "hittable.h"
+#include "textureCache.h"
+
+// An abstract base class for a surface color that varies over a surface, such as the albedo of a lambertian or metal material
+class texture {
+public:
+    virtual ~texture() = default;
+
+    // Color at the hit described by rec; rec.footprint tells how wide an area of the surface the ray's pixel covers there
+    virtual color value(const hitRecord& rec) const = 0;
+};
+
+// The same color everywhere
+class solidColor : public texture {
+public:
+    solidColor(const color& albedo) : albedo(albedo) {}
+
+    color value(const hitRecord&) const override { return albedo; }
+
+private:
+    color albedo;
+};
+
+// A tiled texture file streamed through a textureCache; the image is repeated `repeat` times along each direction of the surface's texture coordinates
+// The footprint of the ray becomes a width in texture space, which picks the mip levels the cache filters between
+class imageTexture : public texture {
+public:
+    imageTexture(const textureCache& cache, int id, double repeat = 1) : cache(cache), id(id), repeat(repeat) {}
+
+    color value(const hitRecord& rec) const override {
+        double u, v;
+        rec.textureCoordinates(u, v);
+        // v runs over half the circumference of the sphere, pi * surfaceScale
+        double footprint = rec.surfaceScale > 0 ? rec.footprint * repeat / (pi * rec.surfaceScale) : 0.0;
+        return cache.lookup(id, u * repeat, v * repeat, footprint);
+    }
+
+private:
+    const textureCache& cache;
+    int id;
+    double repeat;
+};
+
+#endif
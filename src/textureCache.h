@@ -0,0 +1,478 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include "floatImage.h"
+
+// Libraries for the shared tile store, its locks and counters, positioned file reads and the lookup timing
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Tiled texture files (.wtex) hold a texture's whole mip chain as square tiles of 8-bit sRGB texels, so a renderer can read any tile of any level on its own
+// Layout: a 32 byte header of the magic "WTEXTIL1" and the little-endian uint32 width, height, tile size and level count, then the tiles of level 0, 1, ... each in row-major order
+// Every tile is tileSize^2 RGB triples, tileSize a power of two so texel addressing needs no division; tiles on the right and bottom edges are padded to full size, so a tile's file offset is computed instead of stored
+inline constexpr char tiledTextureMagic[8] = { 'W', 'T', 'E', 'X', 'T', 'I', 'L', '1' };
+inline constexpr std::size_t tiledTextureHeaderBytes = 32;
+
+// Tile sizes a tiled texture can have
+inline bool validTileSize(int tileSize) {
+    return tileSize > 0 && tileSize <= 4096 && (tileSize & (tileSize - 1)) == 0;
+}
+
+// Size of mip level `level` of a texture whose finest level is size texels wide (or high)
+inline int mipLevelSize(int size, int level) {
+    return std::max(1, size >> level);
+}
+
+// Number of levels of a full mip chain, down to 1x1
+inline int mipLevelCount(int width, int height) {
+    int levels = 1;
+    while (mipLevelSize(width, levels - 1) > 1 || mipLevelSize(height, levels - 1) > 1)
+        levels++;
+    return levels;
+}
+
+// Linear value of every 8-bit sRGB code
+inline const float* srgbDecodeTable() {
+    static const std::vector<float> table = [] {
+        std::vector<float> values(256);
+        for (int code = 0; code < 256; code++) {
+            double c = code / 255.0;
+            values[code] = float(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+// 8-bit sRGB code of a linear value in [0,1]
+inline unsigned char srgbEncode(double linear) {
+    linear = std::clamp(linear, 0.0, 1.0);
+    double c = linear <= 0.0031308 ? 12.92 * linear : 1.055 * std::pow(linear, 1 / 2.4) - 0.055;
+    return static_cast<unsigned char>(std::lround(c * 255));
+}
+
+// Halves an image with a 2x2 box filter; odd edges repeat their last row or column
+inline floatImage downsampleHalf(const floatImage& image) {
+    floatImage half(mipLevelSize(image.width, 1), mipLevelSize(image.height, 1));
+    for (int j = 0; j < half.height; j++) {
+        for (int i = 0; i < half.width; i++) {
+            int x0 = std::min(2 * i, image.width - 1), x1 = std::min(2 * i + 1, image.width - 1);
+            int y0 = std::min(2 * j, image.height - 1), y1 = std::min(2 * j + 1, image.height - 1);
+            half.set(i, j, 0.25 * (image.at(x0, y0) + image.at(x1, y0) + image.at(x0, y1) + image.at(x1, y1)));
+        }
+    }
+    return half;
+}
+
+// Writes image (linear RGB, values above 1 are clipped) as a tiled texture with its full mip chain
+// Returns false and sets error if the file cannot be written
+inline bool writeTiledTexture(const std::string& path, const floatImage& image, int tileSize, std::string& error) {
+    if (image.width <= 0 || image.height <= 0 || !validTileSize(tileSize)) {
+        error = "cannot write an empty texture or tile size " + std::to_string(tileSize) + " (a power of two up to 4096)";
+        return false;
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        error = "cannot write " + path;
+        return false;
+    }
+    const int levels = mipLevelCount(image.width, image.height);
+    unsigned char header[tiledTextureHeaderBytes] = {};
+    std::memcpy(header, tiledTextureMagic, sizeof(tiledTextureMagic));
+    const std::uint32_t fields[4] = { std::uint32_t(image.width), std::uint32_t(image.height), std::uint32_t(tileSize), std::uint32_t(levels) };
+    for (int f = 0; f < 4; f++)
+        for (int b = 0; b < 4; b++)
+            header[8 + 4 * f + b] = static_cast<unsigned char>(fields[f] >> (8 * b));
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    std::vector<unsigned char> tile(std::size_t(tileSize) * tileSize * 3);
+    floatImage level = image;
+    for (int l = 0; l < levels; l++) {
+        if (l > 0)
+            level = downsampleHalf(level);
+        const int tilesX = (level.width + tileSize - 1) / tileSize, tilesY = (level.height + tileSize - 1) / tileSize;
+        for (int ty = 0; ty < tilesY; ty++) {
+            for (int tx = 0; tx < tilesX; tx++) {
+                std::fill(tile.begin(), tile.end(), 0);
+                for (int y = 0; y < tileSize && ty * tileSize + y < level.height; y++) {
+                    for (int x = 0; x < tileSize && tx * tileSize + x < level.width; x++) {
+                        color c = level.at(tx * tileSize + x, ty * tileSize + y);
+                        unsigned char* texel = &tile[(std::size_t(y) * tileSize + x) * 3];
+                        texel[0] = srgbEncode(c.x());
+                        texel[1] = srgbEncode(c.y());
+                        texel[2] = srgbEncode(c.z());
+                    }
+                }
+                file.write(reinterpret_cast<const char*>(tile.data()), std::streamsize(tile.size()));
+            }
+        }
+    }
+    if (!file) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+// Counters of a textureCache; tile requests are the texel fetches' tile accesses, which either find the tile resident or read it from disk
+class textureCacheStats {
+public:
+    std::uint64_t lookups = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t readErrors = 0;
+    std::size_t residentBytes = 0;
+    std::size_t peakResidentBytes = 0;
+    std::size_t budgetBytes = 0;
+    // Mean wall time of a filtered lookup, measured on every 64th lookup of each thread; includes the two clock reads, a few tens of nanoseconds
+    double meanLookupNanoseconds = 0;
+
+    double hitRate() const {
+        return hits + misses > 0 ? double(hits) / double(hits + misses) : 1.0;
+    }
+};
+
+// Streams the tiles of tiled texture files on demand, keeping at most budgetBytes of texels resident and evicting the least recently used tiles first
+// Lookups are thread-safe and filter trilinearly between the two mip levels whose texel size matches the footprint of the ray in texture space
+// The resident tiles are split over shards with their own lock and LRU list, so threads fetching different tiles rarely wait on each other; each thread also keeps its last few tiles, which serves most fetches of a lookup without any lock
+// Textures are opened before rendering starts; open must not run concurrently with lookups
+class textureCache {
+public:
+    // When false every lookup reads the finest level, which shows what footprint filtering saves in tile traffic
+    bool mipFiltering = true;
+
+    explicit textureCache(std::size_t budgetBytes) : budgetBytes(budgetBytes), serial(nextSerial()) {}
+
+    textureCache(const textureCache&) = delete;
+    textureCache& operator=(const textureCache&) = delete;
+
+    ~textureCache() {
+        for (const auto& file : files)
+            ::close(file.descriptor);
+    }
+
+    // Opens a tiled texture file and returns its id for lookup, or -1 with error set if the file is missing or not a valid .wtex file
+    // Only the header is read; tiles are read when a lookup first touches them
+    int open(const std::string& path, std::string& error) {
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            error = "cannot open " + path;
+            return -1;
+        }
+        unsigned char header[tiledTextureHeaderBytes];
+        std::uint32_t fields[4] = {};
+        bool valid = readFully(descriptor, header, sizeof(header), 0) && std::memcmp(header, tiledTextureMagic, sizeof(tiledTextureMagic)) == 0;
+        for (int f = 0; f < 4; f++)
+            for (int b = 0; b < 4; b++)
+                fields[f] |= std::uint32_t(header[8 + 4 * f + b]) << (8 * b);
+        textureFile file;
+        file.descriptor = descriptor;
+        file.width = int(fields[0]);
+        file.height = int(fields[1]);
+        file.tileSize = int(fields[2]);
+        valid = valid && file.width > 0 && file.height > 0 && validTileSize(file.tileSize)
+                && fields[3] == std::uint32_t(mipLevelCount(file.width, file.height)) && files.size() < 65536;
+        if (!valid) {
+            ::close(descriptor);
+            error = path + " is not a tiled texture";
+            return -1;
+        }
+        file.tileBytes = std::size_t(file.tileSize) * file.tileSize * 3;
+        while ((1 << file.tileShift) < file.tileSize)
+            file.tileShift++;
+        std::uint64_t offset = tiledTextureHeaderBytes;
+        for (int l = 0; l < int(fields[3]); l++) {
+            mipLevel level;
+            level.width = mipLevelSize(file.width, l);
+            level.height = mipLevelSize(file.height, l);
+            level.tilesX = (level.width + file.tileSize - 1) / file.tileSize;
+            level.offset = offset;
+            offset += std::uint64_t(level.tilesX) * ((level.height + file.tileSize - 1) / file.tileSize) * file.tileBytes;
+            file.levels.push_back(level);
+        }
+        files.push_back(std::move(file));
+        return int(files.size()) - 1;
+    }
+
+    int width(int id) const { return files[id].width; }
+    int height(int id) const { return files[id].height; }
+
+    // Filtered texture value at (u, v), both wrapping around [0,1); footprint is the width of the ray's footprint in the same units
+    color lookup(int id, double u, double v, double footprint) const {
+        localTiles& local = localTilesOf();
+        const bool timed = (++local.lookups & 63) == 0;
+        const auto begin = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+        const textureFile& file = files[id];
+        u -= std::floor(u);
+        v -= std::floor(v);
+        // The level whose texels are as wide as the footprint; between two levels both are blended
+        double lod = 0;
+        if (mipFiltering && footprint > 0)
+            lod = std::clamp(std::log2(footprint * std::max(file.width, file.height)), 0.0, double(file.levels.size() - 1));
+        const int fine = int(lod);
+        const double blend = lod - fine;
+        color value = bilinear(local, id, fine, u, v);
+        if (blend > 0)
+            value = (1 - blend) * value + blend * bilinear(local, id, fine + 1, u, v);
+
+        if (timed) {
+            local.timedLookups++;
+            local.timedNanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+        }
+        if ((local.lookups & (flushInterval - 1)) == 0)
+            flush(local);
+        return value;
+    }
+
+    // Current counters; each thread adds its lookups, hits and timings every flushInterval lookups, so those lag by at most that many per thread
+    textureCacheStats stats() const {
+        textureCacheStats result;
+        result.lookups = lookups.load(std::memory_order_relaxed);
+        result.hits = hits.load(std::memory_order_relaxed);
+        result.misses = misses.load(std::memory_order_relaxed);
+        result.evictions = evictions.load(std::memory_order_relaxed);
+        result.readErrors = readErrors.load(std::memory_order_relaxed);
+        result.residentBytes = residentBytes.load(std::memory_order_relaxed);
+        result.peakResidentBytes = peakResidentBytes.load(std::memory_order_relaxed);
+        result.budgetBytes = budgetBytes;
+        std::uint64_t timed = timedLookups.load(std::memory_order_relaxed);
+        result.meanLookupNanoseconds = timed > 0 ? timedNanoseconds.load(std::memory_order_relaxed) / double(timed) : 0.0;
+        return result;
+    }
+
+    // Adds the calling thread's pending counters; after a render on a threadPool, call it on every worker as well (threadPool::onEachWorker) so stats() misses no lookups
+    void flushThreadStats() const {
+        localTiles& local = localTilesOf();
+        flush(local);
+    }
+
+private:
+    static constexpr int shardCount = 16;
+    static constexpr int localSlots = 8;
+    static constexpr std::uint64_t flushInterval = 4096;
+
+    class mipLevel {
+    public:
+        int width, height, tilesX;
+        std::uint64_t offset;
+    };
+
+    class textureFile {
+    public:
+        int descriptor = -1;
+        int width = 0, height = 0, tileSize = 0, tileShift = 0;
+        std::size_t tileBytes = 0;
+        std::vector<mipLevel> levels;
+    };
+
+    // Texels of one tile as 8-bit sRGB triples
+    class textureTile {
+    public:
+        std::vector<unsigned char> texels;
+    };
+
+    class residentTile {
+    public:
+        std::shared_ptr<const textureTile> tile;
+        std::list<std::uint64_t>::iterator position;
+    };
+
+    // One lock's share of the resident tiles, most recently used at the front of lru
+    class cacheShard {
+    public:
+        std::mutex mutex;
+        std::list<std::uint64_t> lru;
+        std::unordered_map<std::uint64_t, residentTile> tiles;
+        std::size_t bytes = 0;
+    };
+
+    // The tiles a thread used last and its counters that have not been added to the cache's yet
+    // The slots hold references, so an evicted tile stays valid until the thread replaces it; a lookup keeps its own references to the tiles it reads
+    class localTiles {
+    public:
+        std::uint64_t owner = 0;
+        std::uint64_t keys[localSlots];
+        std::shared_ptr<const textureTile> tiles[localSlots];
+        int next = 0;
+        std::uint64_t lookups = 0, flushedLookups = 0, hits = 0, misses = 0, timedLookups = 0;
+        double timedNanoseconds = 0;
+    };
+
+    std::size_t budgetBytes;
+    std::uint64_t serial;
+    std::vector<textureFile> files;
+    mutable cacheShard shards[shardCount];
+    mutable std::atomic<std::uint64_t> lookups{0}, hits{0}, misses{0}, evictions{0}, readErrors{0}, timedLookups{0};
+    mutable std::atomic<double> timedNanoseconds{0};
+    mutable std::atomic<std::size_t> residentBytes{0}, peakResidentBytes{0};
+
+    // Distinguishes caches, so a thread's local tiles are never taken for tiles of another cache that reused the same address
+    static std::uint64_t nextSerial() {
+        static std::atomic<std::uint64_t> counter{0};
+        return ++counter;
+    }
+
+    // The calling thread's local tiles, emptied when the thread last used a different cache
+    localTiles& localTilesOf() const {
+        thread_local localTiles local;
+        if (local.owner != serial) {
+            local = localTiles();
+            local.owner = serial;
+            std::fill(std::begin(local.keys), std::end(local.keys), ~std::uint64_t(0));
+        }
+        return local;
+    }
+
+    void flush(localTiles& local) const {
+        lookups.fetch_add(local.lookups - local.flushedLookups, std::memory_order_relaxed);
+        local.flushedLookups = local.lookups;
+        hits.fetch_add(local.hits, std::memory_order_relaxed);
+        misses.fetch_add(local.misses, std::memory_order_relaxed);
+        timedLookups.fetch_add(local.timedLookups, std::memory_order_relaxed);
+        double nanoseconds = timedNanoseconds.load(std::memory_order_relaxed);
+        while (!timedNanoseconds.compare_exchange_weak(nanoseconds, nanoseconds + local.timedNanoseconds, std::memory_order_relaxed)) {}
+        local.hits = local.misses = local.timedLookups = 0;
+        local.timedNanoseconds = 0;
+    }
+
+    color bilinear(localTiles& local, int id, int level, double u, double v) const {
+        const mipLevel& size = files[id].levels[level];
+        double x = u * size.width - 0.5, y = v * size.height - 0.5;
+        double fx = std::floor(x), fy = std::floor(y);
+        int x0 = int(fx), y0 = int(fy);
+        fx = x - fx;
+        fy = y - fy;
+        // Wraps the neighbours across the edges, like the coordinates
+        int x1 = x0 + 1 >= size.width ? 0 : x0 + 1, y1 = y0 + 1 >= size.height ? 0 : y0 + 1;
+        if (x0 < 0) x0 = size.width - 1;
+        if (y0 < 0) y0 = size.height - 1;
+        const textureFile& file = files[id];
+        const int shift = file.tileShift;
+        // The taps hold their own references: a later miss in this lookup may replace the slot a tile came from, and if the shard has evicted that tile, the slot held its last reference
+        std::shared_ptr<const textureTile> tiles[4];
+        tiles[0] = tileAt(local, id, level, x0 >> shift, y0 >> shift);
+        // Most footprints fall inside one tile, which then serves all four texels
+        const bool oneTile = (x0 >> shift) == (x1 >> shift) && (y0 >> shift) == (y1 >> shift);
+        if (!oneTile) {
+            tiles[1] = tileAt(local, id, level, x1 >> shift, y0 >> shift);
+            tiles[2] = tileAt(local, id, level, x0 >> shift, y1 >> shift);
+            tiles[3] = tileAt(local, id, level, x1 >> shift, y1 >> shift);
+        }
+        const textureTile* t0 = tiles[0].get();
+        const textureTile* t1 = oneTile ? t0 : tiles[1].get();
+        const textureTile* t2 = oneTile ? t0 : tiles[2].get();
+        const textureTile* t3 = oneTile ? t0 : tiles[3].get();
+        const int mask = file.tileSize - 1;
+        const float* decode = srgbDecodeTable();
+        auto texel = [&](const textureTile* tile, int x, int y) {
+            const unsigned char* t = &tile->texels[((std::size_t(y & mask) << shift) + (x & mask)) * 3];
+            return color(decode[t[0]], decode[t[1]], decode[t[2]]);
+        };
+        return (1 - fy) * ((1 - fx) * texel(t0, x0, y0) + fx * texel(t1, x1, y0))
+               + fy * ((1 - fx) * texel(t2, x0, y1) + fx * texel(t3, x1, y1));
+    }
+
+    // Finds a tile in the thread's slots, then in its shard, and reads it from disk if it is not resident
+    // Returns a reference of the caller's own, since the slot may be reused by the next miss
+    std::shared_ptr<const textureTile> tileAt(localTiles& local, int id, int level, int tx, int ty) const {
+        const std::uint64_t key = (std::uint64_t(id) << 48) | (std::uint64_t(level) << 40) | (std::uint64_t(ty) << 20) | std::uint64_t(tx);
+        for (int slot = 0; slot < localSlots; slot++) {
+            if (local.keys[slot] == key) {
+                local.hits++;
+                return local.tiles[slot];
+            }
+        }
+
+        cacheShard& shard = shards[(key * 0x9e3779b97f4a7c15ULL) >> 60];
+        std::shared_ptr<const textureTile> tile;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto found = shard.tiles.find(key);
+            if (found != shard.tiles.end()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, found->second.position);
+                tile = found->second.tile;
+            }
+        }
+        if (tile) {
+            local.hits++;
+        } else {
+            // Read without holding the lock; a thread that loaded the same tile meanwhile wins and this copy is dropped
+            local.misses++;
+            tile = insert(shard, key, readTile(id, level, tx, ty));
+        }
+
+        const int slot = local.next;
+        local.next = (local.next + 1) % localSlots;
+        local.keys[slot] = key;
+        local.tiles[slot] = tile;
+        return tile;
+    }
+
+    std::shared_ptr<const textureTile> readTile(int id, int level, int tx, int ty) const {
+        const textureFile& file = files[id];
+        const mipLevel& size = file.levels[level];
+        auto tile = std::make_shared<textureTile>();
+        tile->texels.resize(file.tileBytes);
+        std::uint64_t offset = size.offset + (std::uint64_t(ty) * size.tilesX + tx) * file.tileBytes;
+        if (!readFully(file.descriptor, tile->texels.data(), file.tileBytes, offset)) {
+            readErrors.fetch_add(1, std::memory_order_relaxed);
+            std::fill(tile->texels.begin(), tile->texels.end(), 0);
+        }
+        return tile;
+    }
+
+    // Makes tile resident as key and evicts the shard's least recently used tiles beyond its share of the budget; returns the resident tile
+    std::shared_ptr<const textureTile> insert(cacheShard& shard, std::uint64_t key, std::shared_ptr<const textureTile> tile) const {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.tiles.find(key);
+        if (found != shard.tiles.end())
+            return found->second.tile;
+        shard.lru.push_front(key);
+        shard.tiles.emplace(key, residentTile{ tile, shard.lru.begin() });
+        shard.bytes += tile->texels.size();
+        std::size_t added = tile->texels.size(), removed = 0;
+        // A shard always keeps the tile just read, even if a single tile exceeds its share
+        while (shard.bytes > budgetBytes / shardCount && shard.lru.size() > 1) {
+            auto victim = shard.tiles.find(shard.lru.back());
+            shard.bytes -= victim->second.tile->texels.size();
+            removed += victim->second.tile->texels.size();
+            shard.tiles.erase(victim);
+            shard.lru.pop_back();
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::size_t resident = residentBytes.fetch_add(added - removed, std::memory_order_relaxed) + added - removed;
+        std::size_t peak = peakResidentBytes.load(std::memory_order_relaxed);
+        while (resident > peak && !peakResidentBytes.compare_exchange_weak(peak, resident, std::memory_order_relaxed)) {}
+        return tile;
+    }
+
+    static bool readFully(int descriptor, void* buffer, std::size_t bytes, std::uint64_t offset) {
+        auto* out = static_cast<unsigned char*>(buffer);
+        while (bytes > 0) {
+            ssize_t got = ::pread(descriptor, out, bytes, off_t(offset));
+            if (got <= 0)
+                return false;
+            out += got;
+            bytes -= std::size_t(got);
+            offset += std::uint64_t(got);
+        }
+        return true;
+    }
+};
+
+#endif
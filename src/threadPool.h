@@ -0,0 +1,157 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Libraries for worker threads, the task queue and futures
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads shared by everything that renders in the process
+// Whole render jobs are submitted as tasks; inside a render, parallelFor spreads scanlines over the same workers
+class threadPool {
+public:
+    // Starts threadCount workers; 0 picks one per hardware thread
+    // onWorkerStart(worker), if given, runs first on each worker thread, e.g. to pin it to a set of CPUs
+    explicit threadPool(unsigned threadCount = 0, std::function<void(unsigned)> onWorkerStart = nullptr) {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned t = 0; t < threadCount; t++)
+            workers.emplace_back([this, t, onWorkerStart] {
+                if (onWorkerStart)
+                    onWorkerStart(t);
+                workerLoop();
+            });
+    }
+
+    // Finishes the queued tasks and joins the workers
+    ~threadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    threadPool(const threadPool&) = delete;
+    threadPool& operator=(const threadPool&) = delete;
+
+    // Number of worker threads
+    unsigned size() const { return unsigned(workers.size()); }
+
+    // Queues task and returns a future for its result
+    template <typename Task>
+    auto submit(Task&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        auto future = packaged->get_future();
+        enqueue([packaged] { (*packaged)(); });
+        return future;
+    }
+
+    // Calls body(index, slot) for every index in [0, count) and returns when all calls are done
+    // slot is in [0, size()] and identifies the participating thread, so callers can keep per-thread scratch state in a vector of size() + 1
+    // The calling thread participates as well, which keeps nested use (a pool task calling parallelFor) free of deadlocks
+    template <typename Body>
+    void parallelFor(int count, Body&& body) {
+        if (count <= 0)
+            return;
+
+        // Shared with the helper tasks, which may still be queued after the loop has finished
+        struct loopState {
+            std::atomic<int> next{0};
+            std::atomic<int> done{0};
+            std::atomic<int> slots{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<loopState>();
+        std::function<void(int, int)> call = std::forward<Body>(body);
+
+        // Claims indices until none are left; the last one to finish wakes the caller
+        auto participate = [state, count, &call] {
+            int slot = state->slots.fetch_add(1);
+            int index;
+            while ((index = state->next.fetch_add(1)) < count) {
+                call(index, slot);
+                if (state->done.fetch_add(1) + 1 == count) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+
+        // Helpers only touch call while indices remain, and the caller waits for every index, so the reference stays valid
+        int helpers = std::min<int>(int(size()), count - 1);
+        for (int h = 0; h < helpers; h++)
+            enqueue([state, count, participate] {
+                if (state->next.load() < count)
+                    participate();
+            });
+
+        participate();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&] { return state->done.load() == count; });
+    }
+
+    // Calls body() once on every worker thread and returns when all calls are done, e.g. to collect state the workers keep in thread_local variables
+    // Each worker waits until all of them have taken their call, so none takes two; the pool must not be busy with other tasks, and a pool task must not call this
+    template <typename Body>
+    void onEachWorker(Body&& body) {
+        std::mutex arrivedMutex;
+        std::condition_variable allArrived;
+        unsigned arrived = 0;
+        std::vector<std::future<void>> calls;
+        calls.reserve(workers.size());
+        for (std::size_t w = 0; w < workers.size(); w++)
+            calls.push_back(submit([&] {
+                body();
+                std::unique_lock<std::mutex> lock(arrivedMutex);
+                if (++arrived == size())
+                    allArrived.notify_all();
+                allArrived.wait(lock, [&] { return arrived == size(); });
+            }));
+        for (auto& call : calls)
+            call.get();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+#endif
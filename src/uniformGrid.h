@@ -0,0 +1,199 @@
+#ifndef UNIFORMGRID_H
+#define UNIFORMGRID_H
+
+#include "hittable.h"
+#include "hittableList.h"
+
+// Libraries for sorting, fixed-width indices and dynamic arrays
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Uniform grid acceleration structure, traversed with a 3D-DDA
+// Well suited to dense, evenly spread primitives such as the random sphere field: building is two linear passes and memory is one index per primitive-cell overlap
+// Primitives that are much larger than the typical primitive (the radius-1000 ground sphere) are kept out of the grid and tested against every ray, otherwise they would fill every cell
+class uniformGrid : public hittable {
+public:
+    // Builds the grid over the objects of list
+    // cellsPerPrimitive controls the resolution: the grid gets roughly cellsPerPrimitive * N cells shaped to the extent of the in-grid primitives
+    // A primitive is kept out of the grid if its longest box side exceeds largeObjectFactor times the median longest side
+    uniformGrid(const hittableList& list, double cellsPerPrimitive = 2.0, double largeObjectFactor = 16.0) {
+        build(list.objects, cellsPerPrimitive, largeObjectFactor);
+    }
+
+    bool intersect(const ray& r, interval rayT, hitRecord& rec) const override {
+        bool hitAnything = false;
+        auto closestSoFar = rayT.max;
+
+        // Large primitives first: the ground usually produces a hit that lets the grid walk stop early
+        for (const auto& object : outOfGrid) {
+            if (object->intersect(r, interval(rayT.min, closestSoFar), rec)) {
+                hitAnything = true;
+                closestSoFar = rec.t;
+            }
+        }
+
+        // Clips the ray against the grid bounds
+        interval gridT(rayT.min, closestSoFar);
+        if (cellItems.empty() || !bounds.hit(r, gridT))
+            return hitAnything;
+
+        // Sets up the DDA: the starting cell, the distance to the next cell boundary on each axis and the distance between boundaries
+        const point3 entry = r.at(gridT.min);
+        int cell[3], step[3], stop[3];
+        double tNext[3], tDelta[3];
+        for (int axis = 0; axis < 3; axis++) {
+            const double origin = bounds.axisInterval(axis).min;
+            const double dir = r.direction()[axis];
+            cell[axis] = std::clamp(int((entry[axis] - origin) * invCellSize[axis]), 0, res[axis] - 1);
+            if (dir > 0) {
+                tNext[axis] = gridT.min + (origin + (cell[axis] + 1) * cellSize[axis] - entry[axis]) / dir;
+                tDelta[axis] = cellSize[axis] / dir;
+                step[axis] = 1;
+                stop[axis] = res[axis];
+            } else if (dir < 0) {
+                tNext[axis] = gridT.min + (origin + cell[axis] * cellSize[axis] - entry[axis]) / dir;
+                tDelta[axis] = -cellSize[axis] / dir;
+                step[axis] = -1;
+                stop[axis] = -1;
+            } else {
+                tNext[axis] = infinity;
+                tDelta[axis] = infinity;
+                step[axis] = 0;
+                stop[axis] = -1;
+            }
+        }
+
+        while (true) {
+            // Tests the primitives overlapping the current cell
+            auto index = std::size_t(cell[0]) + std::size_t(res[0]) * (std::size_t(cell[1]) + std::size_t(res[1]) * cell[2]);
+            for (auto k = cellStart[index]; k < cellStart[index + 1]; k++) {
+                if (objects[cellItems[k]]->intersect(r, interval(rayT.min, closestSoFar), rec)) {
+                    hitAnything = true;
+                    closestSoFar = rec.t;
+                }
+            }
+
+            // Steps along the axis whose cell boundary is closest
+            int axis = (tNext[0] < tNext[1]) ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+            // A hit that lies inside the current cell cannot be beaten by anything in later cells
+            if (closestSoFar <= tNext[axis])
+                break;
+            cell[axis] += step[axis];
+            if (cell[axis] == stop[axis])
+                break;
+            tNext[axis] += tDelta[axis];
+        }
+
+        return hitAnything;
+    }
+
+    aabb boundingBox() const override { return totalBounds; }
+
+    // Number of cells along axis (0 = x, 1 = y, 2 = z)
+    int resolution(int axis) const { return res[axis]; }
+
+    // Number of primitives stored outside the grid
+    std::size_t outOfGridCount() const { return outOfGrid.size(); }
+
+    // Bytes used by the cell index arrays and the primitive pointer arrays
+    std::size_t memoryBytes() const {
+        return cellStart.size() * sizeof(std::uint32_t) + cellItems.size() * sizeof(std::uint32_t)
+             + (objects.size() + outOfGrid.size()) * sizeof(shared_ptr<hittable>);
+    }
+
+private:
+    // Primitives placed in the grid, referenced by index from the cells
+    std::vector<shared_ptr<hittable>> objects;
+    // Primitives tested against every ray
+    std::vector<shared_ptr<hittable>> outOfGrid;
+    // Bounds of the grid cells and of everything including the out-of-grid primitives
+    aabb bounds;
+    aabb totalBounds;
+    int res[3] = {0, 0, 0};
+    double cellSize[3];
+    double invCellSize[3];
+    // Compressed cell lists: the primitives of cell c are cellItems[cellStart[c]] .. cellItems[cellStart[c+1]-1]
+    std::vector<std::uint32_t> cellStart;
+    std::vector<std::uint32_t> cellItems;
+
+    // Range of cells overlapped by box along axis
+    void cellRange(const aabb& box, int axis, int& first, int& last) const {
+        const interval& extent = box.axisInterval(axis);
+        const double origin = bounds.axisInterval(axis).min;
+        first = std::clamp(int((extent.min - origin) * invCellSize[axis]), 0, res[axis] - 1);
+        last  = std::clamp(int((extent.max - origin) * invCellSize[axis]), 0, res[axis] - 1);
+    }
+
+    void build(const std::vector<shared_ptr<hittable>>& source, double cellsPerPrimitive, double largeObjectFactor) {
+        if (source.empty())
+            return;
+
+        // Median of the longest box sides, the reference size for detecting oversized primitives
+        std::vector<double> extents;
+        extents.reserve(source.size());
+        for (const auto& object : source)
+            extents.push_back(object->boundingBox().maxExtent());
+        std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+        const double largeLimit = largeObjectFactor * extents[extents.size() / 2];
+
+        // Splits the primitives into grid and out-of-grid sets
+        for (const auto& object : source) {
+            auto box = object->boundingBox();
+            totalBounds = aabb(totalBounds, box);
+            if (box.maxExtent() > largeLimit) {
+                outOfGrid.push_back(object);
+            } else {
+                objects.push_back(object);
+                bounds = aabb(bounds, box);
+            }
+        }
+        if (objects.empty())
+            return;
+
+        // Pads the bounds slightly so primitives on the boundary fall inside the last cell
+        // Flat or point-like bounds (primitives in a plane, or a single degenerate one) are widened so no axis is thinner than a thousandth of the longest, which keeps the volume and cellsPerUnit below finite
+        const double maxExtent = bounds.maxExtent();
+        const double minSize = maxExtent > 0 ? 1e-3 * maxExtent : 1e-3;
+        auto pad = [&](const interval& axis) { return axis.expand(std::max(1e-6 * maxExtent, minSize - axis.size())); };
+        bounds = aabb(pad(bounds.x), pad(bounds.y), pad(bounds.z));
+
+        // Resolution heuristic: cubic cells sized so the grid holds about cellsPerPrimitive * N cells, at least one and at most 512 per axis
+        double volume = bounds.x.size() * bounds.y.size() * bounds.z.size();
+        double cellsPerUnit = std::cbrt(cellsPerPrimitive * objects.size() / volume);
+        for (int axis = 0; axis < 3; axis++) {
+            res[axis] = std::clamp(int(std::min(bounds.axisInterval(axis).size() * cellsPerUnit, 512.0)), 1, 512);
+            cellSize[axis] = bounds.axisInterval(axis).size() / res[axis];
+            invCellSize[axis] = 1.0 / cellSize[axis];
+        }
+
+        // First pass counts the primitives of each cell, a prefix sum turns the counts into start offsets
+        const std::size_t cellCount = std::size_t(res[0]) * res[1] * res[2];
+        cellStart.assign(cellCount + 1, 0);
+        forEachOverlap([&](std::size_t cellIndex, std::uint32_t) { cellStart[cellIndex + 1]++; });
+        for (std::size_t c = 0; c < cellCount; c++)
+            cellStart[c + 1] += cellStart[c];
+
+        // Second pass writes the primitive indices
+        cellItems.resize(cellStart[cellCount]);
+        std::vector<std::uint32_t> cursor(cellStart.begin(), cellStart.end() - 1);
+        forEachOverlap([&](std::size_t cellIndex, std::uint32_t primitive) { cellItems[cursor[cellIndex]++] = primitive; });
+    }
+
+    // Calls visit(cell index, primitive index) for every cell overlapped by every in-grid primitive's box
+    template <typename Visit>
+    void forEachOverlap(Visit&& visit) const {
+        for (std::uint32_t p = 0; p < objects.size(); p++) {
+            auto box = objects[p]->boundingBox();
+            int lo[3], hi[3];
+            for (int axis = 0; axis < 3; axis++)
+                cellRange(box, axis, lo[axis], hi[axis]);
+            for (int z = lo[2]; z <= hi[2]; z++)
+                for (int y = lo[1]; y <= hi[1]; y++)
+                    for (int x = lo[0]; x <= hi[0]; x++)
+                        visit(std::size_t(x) + std::size_t(res[0]) * (std::size_t(y) + std::size_t(res[1]) * z), p);
+        }
+    }
+};
+
+#endif
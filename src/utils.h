@@ -4,9 +4,11 @@
 // Includes necessary standard libraries for:
 // mathematical functions (<cmath>)
 // input/output operations (<iostream>) 
+// fixed-width integers for the random generator (<cstdint>)
 // handling limits of data types (<limits>)
 // smart pointers (<memory>)
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
@@ -27,11 +29,53 @@ inline double degreesToRadians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// Small, fast pseudo-random number generator (SplitMix64)
+// Every thread owns one (see threadRandom), so rendering threads never share random state and a sequence can be restarted from a seed at any point
+class randomGenerator {
+public:
+    explicit randomGenerator(std::uint64_t seed = 1) : state(seed) {}
+
+    // Restarts the sequence from seed
+    void seed(std::uint64_t seed) { state = seed; }
+
+    // Returns the next 64 random bits
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Returns a random double in [0,1) built from the top 53 bits
+    double nextDouble() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    std::uint64_t state;
+};
+
+// Mixes two values into a well-distributed seed, used to derive independent sequences for pixels, rows and passes
+inline std::uint64_t hashSeed(std::uint64_t a, std::uint64_t b) {
+    randomGenerator mix(a ^ (b * 0xD1B54A32D192ED03ull));
+    return mix.next();
+}
+
+// Generator of the calling thread; every thread starts from seed 1
+inline randomGenerator& threadRandom() {
+    thread_local randomGenerator generator;
+    return generator;
+}
+
+// Restarts the calling thread's random sequence; scene builders and renders call this so their results do not depend on what ran before on the thread
+inline void seedRandom(std::uint64_t seed) {
+    threadRandom().seed(seed);
+}
+
 // Function that returns a random double value between 0 and 1
 inline double randomDouble() {
-    // Uses the rand() function(which generates a randon int) and divides it by RAND_MAX + 1.0 to scale the result to the range [0.0,1.0]
-    // RAND_MAX is a constant representing the max value that rand() can return
-    return std::rand() / (RAND_MAX + 1.0);
+    // Draws from the calling thread's generator, so concurrent renders neither contend on nor disturb each other's random state (std::rand shares one global state)
+    return threadRandom().nextDouble();
 }
 
 // Function that returns a random double value within the range [min,max]
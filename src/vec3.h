@@ -1,6 +1,64 @@
 #ifndef VEC3_H
 #define VEC3_H
 
+// SIMD backends of the vector math: SSE2 on x86-64 (VEX-encoded with fused multiply-adds when built with AVX2/FMA, see WEEKENDFUN_NATIVE), NEON on AArch64, plain scalar code elsewhere
+// Defining VEC3_SCALAR forces the scalar fallback
+#if !defined(VEC3_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define VEC3_SSE2 1
+#include <immintrin.h>
+#elif !defined(VEC3_SCALAR) && defined(__ARM_NEON) && defined(__aarch64__)
+#define VEC3_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Name of the active backend, printed by the vector benchmark
+#if defined(VEC3_SSE2) && defined(__FMA__)
+inline const char* vec3Backend = "SSE2/AVX with FMA";
+#elif defined(VEC3_SSE2)
+inline const char* vec3Backend = "SSE2";
+#elif defined(VEC3_NEON)
+inline const char* vec3Backend = "NEON";
+#else
+inline const char* vec3Backend = "scalar";
+#endif
+
+// Largest relative difference between the SIMD kernels and the plain scalar formulas, measured against the magnitude of the result
+// Without fused multiply-adds every kernel performs the scalar operations in the same order and the results are bit-identical; fusing skips one rounding per multiply-add, which moves results by a few units in the last place
+const double vec3Tolerance = 1e-12;
+
+// a*b + c in one rounding where the hardware has a fused multiply-add, two roundings otherwise (std::fma without hardware support is a slow library call)
+inline double multiplyAdd(double a, double b, double c) {
+#if defined(FP_FAST_FMA) || defined(__FMA__) || defined(__aarch64__)
+    return std::fma(a, b, c);
+#else
+    return a * b + c;
+#endif
+}
+
+// Two-lane register holding the x and y components of a vec3; z is handled as a plain double next to it
+// Keeping three doubles per vector (instead of padding to four for 256-bit registers) leaves every sphere, ray and hit record the same size
+// Only the horizontal kernels (dot products and lengths) use it: for component-wise arithmetic the compiler already emits packed instructions from the scalar code and can vectorize loops over it, which explicit intrinsics would prevent
+#if defined(VEC3_SSE2)
+using vec3Pair = __m128d;
+inline vec3Pair pairLoad(const double* p) { return _mm_loadu_pd(p); }
+inline vec3Pair pairMul(vec3Pair a, vec3Pair b) { return _mm_mul_pd(a, b); }
+// lo + hi
+inline double pairSum(vec3Pair a) { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+#elif defined(VEC3_NEON)
+using vec3Pair = float64x2_t;
+inline vec3Pair pairLoad(const double* p) { return vld1q_f64(p); }
+inline vec3Pair pairMul(vec3Pair a, vec3Pair b) { return vmulq_f64(a, b); }
+inline double pairSum(vec3Pair a) { return vaddvq_f64(a); }
+#else
+class vec3Pair {
+public:
+    double lo, hi;
+};
+inline vec3Pair pairLoad(const double* p) { return { p[0], p[1] }; }
+inline vec3Pair pairMul(vec3Pair a, vec3Pair b) { return { a.lo * b.lo, a.hi * b.hi }; }
+inline double pairSum(vec3Pair a) { return a.lo + a.hi; }
+#endif
+
 // Class to represent a 3D vector
 class vec3 {
     public: 
@@ -18,6 +76,9 @@ class vec3 {
     double y() const { return e[1]; }
     double z() const { return e[2]; }
 
+    // x and y as one register
+    vec3Pair xy() const { return pairLoad(e); }
+
     // Overloads the - operator to return a vector with all components negated
     vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
 
@@ -37,7 +98,7 @@ class vec3 {
     vec3& operator*=(double t) {
         e[0] *= t;
         e[1] *= t;
-        e[2] += t;
+        e[2] *= t;
         return *this;
     }
 
@@ -53,7 +114,7 @@ class vec3 {
 
     // Returns the squared length using the Pythagorean theorem
     double squaredLength() const {
-        return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
+        return multiplyAdd(e[2], e[2], pairSum(pairMul(xy(), xy())));
     }
 
     // Checks if the vector is close to zero in all dimensions(x,y,z)
@@ -114,22 +175,23 @@ inline vec3 operator/(const vec3& v, double t) {
 }
 
 // Calculates the dot product, good to know how parallel two vectors are
+// x and y are multiplied in one register and summed, z is added with a multiply-add
 inline double dot(const vec3& u, const vec3& v) {
-    return u.e[0] * v.e[0]
-    + u.e[1] * v.e[1]
-    + u.e[2] * v.e[2];
+    return multiplyAdd(u.e[2], v.e[2], pairSum(pairMul(u.xy(), v.xy())));
 }
 
 // Calculates the cross product, producing a vector perpendicular to u and v
+// Each component is one multiply and one multiply-add; a two-lane version needs more shuffles than it saves (see --bench vec3)
 inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    return vec3(multiplyAdd(u.e[1], v.e[2], -(u.e[2] * v.e[1])),
+                multiplyAdd(u.e[2], v.e[0], -(u.e[0] * v.e[2])),
+                multiplyAdd(u.e[0], v.e[1], -(u.e[1] * v.e[0])));
 }
 
 // Returns a unit vector (vector with length 1) pointing in the same direction as v 
+// Takes one reciprocal of the length and multiplies all components by it instead of dividing three times
 inline vec3 unitVector(const vec3& v) {
-    return v / v.length();
+    return (1.0 / v.length()) * v;
 }
 
 // Function generates a random vec3 that lies within or on the surface of a unit sphere, the vector is returned as a unit vector(normalized to a length of 1)
@@ -165,7 +227,9 @@ inline vec3 randomOnHemisphere(const vec3& normal) {
 // Defines a function that calculates the reflection of vector v off a surface with normal n
 inline vec3 reflect(const vec3& v, const vec3& n) {
     // Reflection formula: subtracts twice the projection of v onto n from v resulting in the reflected vector
-    return v - 2 * dot(v,n) * n;
+    // Computed as v - (2*dot)*n with one multiply-add per component
+    double scale = -2 * dot(v,n);
+    return vec3(multiplyAdd(scale, n.e[0], v.e[0]), multiplyAdd(scale, n.e[1], v.e[1]), multiplyAdd(scale, n.e[2], v.e[2]));
 }
 
 // Defines a function to caluclate the refraction of a vector uv as it passes through a surface with a normal n, based on the ration of refractive indices (etaiOverEtat)
@@ -0,0 +1,40 @@
+#ifndef VEC3REFERENCE_H
+#define VEC3REFERENCE_H
+
+#include "utils.h"
+
+// Libraries for the error measure
+#include <algorithm>
+#include <cmath>
+
+// Plain scalar vector math as vec3 computed it before the SIMD backends, the baseline of benchmarkVectorMath and the check of tests/vec3Test.cc
+class referenceVector {
+public:
+    double x, y, z;
+};
+
+inline referenceVector referenceAdd(const referenceVector& u, const referenceVector& v) { return { u.x + v.x, u.y + v.y, u.z + v.z }; }
+inline referenceVector referenceScale(double t, const referenceVector& v) { return { t * v.x, t * v.y, t * v.z }; }
+inline double referenceDot(const referenceVector& u, const referenceVector& v) { return u.x * v.x + u.y * v.y + u.z * v.z; }
+inline referenceVector referenceCross(const referenceVector& u, const referenceVector& v) {
+    return { u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z, u.x * v.y - u.y * v.x };
+}
+inline referenceVector referenceUnit(const referenceVector& v) { return referenceScale(1 / std::sqrt(referenceDot(v, v)), v); }
+inline referenceVector referenceReflect(const referenceVector& v, const referenceVector& n) {
+    auto scaled = referenceScale(2 * referenceDot(v, n), n);
+    return { v.x - scaled.x, v.y - scaled.y, v.z - scaled.z };
+}
+inline referenceVector referenceRefract(const referenceVector& uv, const referenceVector& n, double etaiOverEtat) {
+    auto cosTheta = std::fmin(-referenceDot(uv, n), 1.0);
+    auto perp = referenceScale(etaiOverEtat, referenceAdd(uv, referenceScale(cosTheta, n)));
+    auto parallel = referenceScale(-std::sqrt(std::fabs(1.0 - referenceDot(perp, perp))), n);
+    return referenceAdd(perp, parallel);
+}
+
+// Relative difference of a SIMD result from the reference, measured against the larger of 1 and the reference's magnitude
+inline double vectorError(const vec3& v, const referenceVector& r) {
+    double scale = std::max(1.0, std::sqrt(referenceDot(r, r)));
+    return std::max({ std::fabs(v.x() - r.x), std::fabs(v.y() - r.y), std::fabs(v.z() - r.z) }) / scale;
+}
+
+#endif
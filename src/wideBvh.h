@@ -0,0 +1,443 @@
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include "hittable.h"
+#include "hittableList.h"
+
+// Libraries for sorting, fixed-width integers, dynamic arrays and the traversal stack check
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// SIMD instruction sets used to test the four children of a node at once; other targets use the portable loop
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WIDEBVH_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define WIDEBVH_NEON 1
+#endif
+
+// One node of the 4-wide hierarchy, exactly one 64-byte cache line
+// Child boxes are stored as 8-bit offsets inside the node's own box (the parent frame): childMin = origin + lo * scale, childMax = origin + hi * scale
+// Quantization always rounds outward, so a child box can only grow, never miss a primitive
+class alignas(64) wideBvhNode {
+public:
+    // Lower corner and per-step size of the quantization frame
+    float origin[3];
+    float scale[3];
+    // Quantized child bounds per axis, structure-of-arrays so one load covers all four children
+    std::uint8_t lo[3][4];
+    std::uint8_t hi[3][4];
+    // Child references: top 4 bits = number of primitives of a leaf (0 for an inner node), low 28 bits = node index or first primitive
+    std::uint32_t child[4];
+};
+
+// Compressed 4-wide bounding volume hierarchy for very large scenes
+// Each node tests its four child boxes with one SIMD pass; with 8-bit child bounds a node is a quarter of the size of four double-precision boxes, so a hierarchy over 10^7 spheres needs a few hundred megabytes instead of gigabytes
+// Primitives are the existing hittables; leaves reference a contiguous run of them reordered to match the tree
+class wideBvh : public hittable {
+public:
+    // Marks an unused child slot
+    static constexpr std::uint32_t emptyChild = 0xFFFFFFFFu;
+    // Largest leaf the builder creates (must stay below 15 so leaf counts fit the 4-bit field)
+    static constexpr int maxLeafSize = 4;
+    // Depth below which inner nodes split by the surface area heuristic; deeper nodes split at the centroid median, which at least halves every range, so no tree over the at most 2^28 primitives a reference can address gets deeper than maxDepth
+    // The heuristic alone can peel a few primitives off per level on unbalanced scenes (nested clusters, coincident centroids) and build trees as deep as the scene is large
+    static constexpr int sahDepthLimit = 48;
+    static constexpr int maxDepth = sahDepthLimit + 28;
+    // Entries of the traversal stack: every level pushes at most three more entries than it pops
+    static constexpr int stackSize = 3 * maxDepth + 1;
+
+    // Builds the hierarchy over the objects of list
+    wideBvh(const hittableList& list) {
+        build(list.objects);
+    }
+
+    bool intersect(const ray& r, interval rayT, hitRecord& rec) const override {
+        if (nodes.empty())
+            return false;
+
+        bool hitAnything = false;
+        auto closestSoFar = rayT.max;
+
+        // Ray origin and inverse direction in single precision for the box tests
+        float org[3], inv[3];
+        for (int axis = 0; axis < 3; axis++) {
+            org[axis] = float(r.origin()[axis]);
+            inv[axis] = float(1.0 / r.direction()[axis]);
+        }
+
+        // Traversal stack of child references and their entry distances, deep enough for any tree the builder makes (see maxDepth)
+        struct entry { std::uint32_t ref; float tEnter; };
+        entry stack[stackSize];
+        int top = 0;
+        stack[top++] = { 0, float(rayT.min) };
+
+        while (top > 0) {
+            entry e = stack[--top];
+            // Skips subtrees that start behind the closest hit found since they were pushed
+            if (e.tEnter > closestSoFar)
+                continue;
+
+            const std::uint32_t count = e.ref >> 28;
+            const std::uint32_t index = e.ref & 0x0FFFFFFFu;
+            if (count > 0) {
+                // Leaf: tests its primitives with full double precision
+                for (std::uint32_t p = index; p < index + count; p++) {
+                    if (primitives[p]->intersect(r, interval(rayT.min, closestSoFar), rec)) {
+                        hitAnything = true;
+                        closestSoFar = rec.t;
+                    }
+                }
+                continue;
+            }
+
+            // Inner node: tests all four child boxes at once
+            const wideBvhNode& node = nodes[index];
+            float tEnter[4];
+            int mask = intersectChildren(node, org, inv, float(rayT.min), float(closestSoFar), tEnter);
+
+            // Pushes the hit children far to near so the nearest is popped first
+            int order[4], hits = 0;
+            for (int c = 0; c < 4; c++)
+                if ((mask >> c) & 1)
+                    order[hits++] = c;
+            for (int k = 1; k < hits; k++)
+                for (int m = k; m > 0 && tEnter[order[m - 1]] < tEnter[order[m]]; m--)
+                    std::swap(order[m - 1], order[m]);
+            assert(top + hits <= stackSize);
+            for (int k = 0; k < hits; k++)
+                stack[top++] = { node.child[order[k]], tEnter[order[k]] };
+        }
+
+        return hitAnything;
+    }
+
+    aabb boundingBox() const override { return bbox; }
+
+    // Number of inner nodes
+    std::size_t nodeCount() const { return nodes.size(); }
+
+    // Bytes used by the nodes
+    std::size_t nodeBytes() const { return nodes.size() * sizeof(wideBvhNode); }
+
+    // Bytes used by the nodes plus the reordered primitive references
+    std::size_t memoryBytes() const { return nodeBytes() + primitives.size() * sizeof(shared_ptr<hittable>); }
+
+    // Number of primitives in the hierarchy
+    std::size_t primitiveCount() const { return primitives.size(); }
+
+private:
+    std::vector<wideBvhNode> nodes;
+    std::vector<shared_ptr<hittable>> primitives;
+    aabb bbox;
+
+    // Tests the ray against the four child boxes of node, returns a bit mask of the children hit inside [tMin, tMax] and their entry distances
+    static int intersectChildren(const wideBvhNode& node, const float org[3], const float inv[3], float tMin, float tMax, float tEnter[4]) {
+        // Widens the exit distance by a few ulps so rounding in single precision never culls a grazing hit
+        const float exitScale = 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+#if defined(WIDEBVH_SSE)
+        __m128 nearT = _mm_set1_ps(tMin);
+        __m128 farT = _mm_set1_ps(tMax);
+        const __m128i zero = _mm_setzero_si128();
+        for (int axis = 0; axis < 3; axis++) {
+            // Widens the 4 quantized bytes of each bound to 32-bit integers and converts them to floats
+            int loWord, hiWord;
+            std::memcpy(&loWord, node.lo[axis], sizeof(loWord));
+            std::memcpy(&hiWord, node.hi[axis], sizeof(hiWord));
+            __m128i loBytes = _mm_cvtsi32_si128(loWord);
+            __m128i hiBytes = _mm_cvtsi32_si128(hiWord);
+            __m128 qlo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(loBytes, zero), zero));
+            __m128 qhi = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(hiBytes, zero), zero));
+
+            // Dequantizes the child bounds into world space
+            __m128 o = _mm_set1_ps(node.origin[axis]);
+            __m128 s = _mm_set1_ps(node.scale[axis]);
+            __m128 bmin = _mm_add_ps(o, _mm_mul_ps(qlo, s));
+            __m128 bmax = _mm_add_ps(o, _mm_mul_ps(qhi, s));
+
+            // Slab distances
+            __m128 ro = _mm_set1_ps(org[axis]);
+            __m128 ri = _mm_set1_ps(inv[axis]);
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(bmin, ro), ri);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(bmax, ro), ri);
+            nearT = _mm_max_ps(nearT, _mm_min_ps(t0, t1));
+            farT = _mm_min_ps(farT, _mm_max_ps(t0, t1));
+        }
+        farT = _mm_mul_ps(farT, _mm_set1_ps(exitScale));
+        _mm_storeu_ps(tEnter, nearT);
+        int mask = _mm_movemask_ps(_mm_cmple_ps(nearT, farT));
+#elif defined(WIDEBVH_NEON)
+        float32x4_t nearT = vdupq_n_f32(tMin);
+        float32x4_t farT = vdupq_n_f32(tMax);
+        for (int axis = 0; axis < 3; axis++) {
+            std::uint32_t loWord, hiWord;
+            std::memcpy(&loWord, node.lo[axis], sizeof(loWord));
+            std::memcpy(&hiWord, node.hi[axis], sizeof(hiWord));
+            uint8x8_t loBytes = vreinterpret_u8_u32(vdup_n_u32(loWord));
+            uint8x8_t hiBytes = vreinterpret_u8_u32(vdup_n_u32(hiWord));
+            float32x4_t qlo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(loBytes))));
+            float32x4_t qhi = vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(hiBytes))));
+            float32x4_t bmin = vmlaq_n_f32(vdupq_n_f32(node.origin[axis]), qlo, node.scale[axis]);
+            float32x4_t bmax = vmlaq_n_f32(vdupq_n_f32(node.origin[axis]), qhi, node.scale[axis]);
+            float32x4_t t0 = vmulq_n_f32(vsubq_f32(bmin, vdupq_n_f32(org[axis])), inv[axis]);
+            float32x4_t t1 = vmulq_n_f32(vsubq_f32(bmax, vdupq_n_f32(org[axis])), inv[axis]);
+            nearT = vmaxq_f32(nearT, vminq_f32(t0, t1));
+            farT = vminq_f32(farT, vmaxq_f32(t0, t1));
+        }
+        farT = vmulq_n_f32(farT, exitScale);
+        vst1q_f32(tEnter, nearT);
+        float farOut[4];
+        vst1q_f32(farOut, farT);
+        int mask = 0;
+        for (int c = 0; c < 4; c++)
+            mask |= (tEnter[c] <= farOut[c]) << c;
+#else
+        float farT[4];
+        for (int c = 0; c < 4; c++) {
+            tEnter[c] = tMin;
+            farT[c] = tMax;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            for (int c = 0; c < 4; c++) {
+                float bmin = node.origin[axis] + node.lo[axis][c] * node.scale[axis];
+                float bmax = node.origin[axis] + node.hi[axis][c] * node.scale[axis];
+                float t0 = (bmin - org[axis]) * inv[axis];
+                float t1 = (bmax - org[axis]) * inv[axis];
+                tEnter[c] = std::max(tEnter[c], std::min(t0, t1));
+                farT[c] = std::min(farT[c], std::max(t0, t1));
+            }
+        }
+        int mask = 0;
+        for (int c = 0; c < 4; c++)
+            mask |= (tEnter[c] <= farT[c] * exitScale) << c;
+#endif
+        // Unused child slots never count as hits
+        for (int c = 0; c < 4; c++)
+            if (node.child[c] == emptyChild)
+                mask &= ~(1 << c);
+        return mask;
+    }
+
+    // Per-primitive data needed only while building
+    struct buildPrim {
+        float lo[3];
+        float hi[3];
+        float centroid[3];
+        std::uint32_t index;
+    };
+
+    // Bounds of a range of build primitives in single precision
+    struct buildBox {
+        float lo[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+        float hi[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+        void grow(const float l[3], const float h[3]) {
+            for (int axis = 0; axis < 3; axis++) {
+                lo[axis] = std::min(lo[axis], l[axis]);
+                hi[axis] = std::max(hi[axis], h[axis]);
+            }
+        }
+
+        // Half the surface area, enough for comparing split costs
+        float halfArea() const {
+            float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+            return (dx < 0 || dy < 0 || dz < 0) ? 0 : dx * dy + dy * dz + dz * dx;
+        }
+    };
+
+    // A contiguous run of build primitives and its bounds
+    struct buildRange {
+        std::size_t begin, end;
+        buildBox box;
+    };
+
+    // Rounds a double down / up to the neighbouring float so single precision boxes stay conservative
+    static float roundDown(double v) {
+        float f = float(v);
+        return double(f) > v ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+    static float roundUp(double v) {
+        float f = float(v);
+        return double(f) < v ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static buildBox boundsOf(const std::vector<buildPrim>& prims, std::size_t begin, std::size_t end) {
+        buildBox box;
+        for (auto p = begin; p < end; p++)
+            box.grow(prims[p].lo, prims[p].hi);
+        return box;
+    }
+
+    void build(const std::vector<shared_ptr<hittable>>& source) {
+        if (source.empty())
+            return;
+
+        // Single precision, outward rounded boxes and centroids of every primitive
+        std::vector<buildPrim> prims(source.size());
+        for (std::size_t i = 0; i < source.size(); i++) {
+            auto box = source[i]->boundingBox();
+            bbox = aabb(bbox, box);
+            for (int axis = 0; axis < 3; axis++) {
+                prims[i].lo[axis] = roundDown(box.axisInterval(axis).min);
+                prims[i].hi[axis] = roundUp(box.axisInterval(axis).max);
+                prims[i].centroid[axis] = 0.5f * (prims[i].lo[axis] + prims[i].hi[axis]);
+            }
+            prims[i].index = std::uint32_t(i);
+        }
+
+        // The root is always an inner node, even for tiny scenes
+        nodes.reserve(source.size() / 2 + 1);
+        buildRange root { 0, prims.size(), boundsOf(prims, 0, prims.size()) };
+        buildNode(prims, root, 0);
+
+        // Stores the primitives in leaf order so every leaf is a contiguous run
+        primitives.reserve(prims.size());
+        for (const auto& p : prims)
+            primitives.push_back(source[p.index]);
+    }
+
+    // Splits range in two with a 12-bin surface area heuristic over the centroids; with median set, or when all centroids coincide on every axis, it splits at the median centroid along the widest axis instead
+    static void splitRange(std::vector<buildPrim>& prims, const buildRange& range, buildRange& left, buildRange& right, bool median) {
+        constexpr int binCount = 12;
+        buildBox centroidBox;
+        for (auto p = range.begin; p < range.end; p++)
+            centroidBox.grow(prims[p].centroid, prims[p].centroid);
+
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1, bestBin = 0;
+        for (int axis = 0; axis < 3 && !median; axis++) {
+            float extent = centroidBox.hi[axis] - centroidBox.lo[axis];
+            if (extent <= 0)
+                continue;
+            float binScale = binCount / extent;
+
+            // Counts and bounds per bin
+            buildBox bins[binCount];
+            std::size_t counts[binCount] = {};
+            for (auto p = range.begin; p < range.end; p++) {
+                int b = std::min(binCount - 1, int((prims[p].centroid[axis] - centroidBox.lo[axis]) * binScale));
+                counts[b]++;
+                bins[b].grow(prims[p].lo, prims[p].hi);
+            }
+
+            // Sweeps from the right to get the suffix costs, then from the left to evaluate each split plane
+            float rightArea[binCount];
+            std::size_t rightCount[binCount];
+            buildBox acc;
+            std::size_t n = 0;
+            for (int b = binCount - 1; b > 0; b--) {
+                acc.grow(bins[b].lo, bins[b].hi);
+                n += counts[b];
+                rightArea[b] = acc.halfArea();
+                rightCount[b] = n;
+            }
+            acc = buildBox();
+            n = 0;
+            for (int b = 0; b < binCount - 1; b++) {
+                acc.grow(bins[b].lo, bins[b].hi);
+                n += counts[b];
+                float cost = acc.halfArea() * n + rightArea[b + 1] * rightCount[b + 1];
+                if (n > 0 && rightCount[b + 1] > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        std::size_t mid;
+        if (bestAxis >= 0) {
+            float binScale = binCount / (centroidBox.hi[bestAxis] - centroidBox.lo[bestAxis]);
+            auto it = std::partition(prims.begin() + range.begin, prims.begin() + range.end, [&](const buildPrim& p) {
+                return std::min(binCount - 1, int((p.centroid[bestAxis] - centroidBox.lo[bestAxis]) * binScale)) <= bestBin;
+            });
+            mid = std::size_t(it - prims.begin());
+        } else {
+            int axis = 0;
+            for (int a = 1; a < 3; a++)
+                if (centroidBox.hi[a] - centroidBox.lo[a] > centroidBox.hi[axis] - centroidBox.lo[axis])
+                    axis = a;
+            mid = range.begin + (range.end - range.begin) / 2;
+            std::nth_element(prims.begin() + range.begin, prims.begin() + mid, prims.begin() + range.end,
+                             [axis](const buildPrim& a, const buildPrim& b) { return a.centroid[axis] < b.centroid[axis]; });
+        }
+
+        left = { range.begin, mid, boundsOf(prims, range.begin, mid) };
+        right = { mid, range.end, boundsOf(prims, mid, range.end) };
+    }
+
+    // Builds the inner node for range at depth (the root is 0) and returns its index
+    std::uint32_t buildNode(std::vector<buildPrim>& prims, const buildRange& range, int depth) {
+        // Up to four children: split the range, then keep splitting the largest child that is still too big for a leaf
+        buildRange children[4];
+        int childCount = 1;
+        children[0] = range;
+        while (childCount < 4) {
+            int largest = -1;
+            std::size_t largestSize = maxLeafSize;
+            for (int c = 0; c < childCount; c++) {
+                auto size = children[c].end - children[c].begin;
+                if (size > largestSize) {
+                    largest = c;
+                    largestSize = size;
+                }
+            }
+            if (largest < 0)
+                break;
+            buildRange left, right;
+            splitRange(prims, children[largest], left, right, depth >= sahDepthLimit);
+            children[largest] = left;
+            children[childCount++] = right;
+        }
+
+        const std::uint32_t nodeIndex = std::uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        // The node's own box is the quantization frame of its children
+        wideBvhNode node;
+        float invScale[3];
+        for (int axis = 0; axis < 3; axis++) {
+            node.origin[axis] = range.box.lo[axis];
+            double extent = double(range.box.hi[axis]) - double(range.box.lo[axis]);
+            // Dividing by 254 instead of 255 leaves one step of headroom so origin + 255 * scale always reaches the top of the box
+            node.scale[axis] = roundUp(extent > 0 ? extent / 254.0 : 1e-30);
+            invScale[axis] = 1.0f / node.scale[axis];
+        }
+
+        for (int c = 0; c < 4; c++) {
+            if (c >= childCount) {
+                node.child[c] = emptyChild;
+                for (int axis = 0; axis < 3; axis++) {
+                    node.lo[axis][c] = 255;
+                    node.hi[axis][c] = 0;
+                }
+                continue;
+            }
+            // Quantizes outward, plus one step of slack for the rounding of origin + q * scale in single precision
+            for (int axis = 0; axis < 3; axis++) {
+                float qlo = std::floor((children[c].box.lo[axis] - node.origin[axis]) * invScale[axis]) - 1;
+                float qhi = std::ceil((children[c].box.hi[axis] - node.origin[axis]) * invScale[axis]) + 1;
+                node.lo[axis][c] = std::uint8_t(std::clamp(qlo, 0.0f, 255.0f));
+                node.hi[axis][c] = std::uint8_t(std::clamp(qhi, 0.0f, 255.0f));
+            }
+        }
+
+        // Children: small ranges become leaves, the rest become inner nodes (built depth first, so the vector may grow meanwhile)
+        for (int c = 0; c < childCount; c++) {
+            auto size = children[c].end - children[c].begin;
+            if (size <= std::size_t(maxLeafSize))
+                node.child[c] = (std::uint32_t(size) << 28) | std::uint32_t(children[c].begin);
+            else
+                node.child[c] = buildNode(prims, children[c], depth + 1);
+        }
+
+        nodes[nodeIndex] = node;
+        return nodeIndex;
+    }
+};
+
+#endif
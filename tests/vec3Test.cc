@@ -0,0 +1,55 @@
+// Checks the vec3 kernels of the active SIMD backend against the plain scalar formulas within vec3Tolerance
+// Registered with CTest; exits with 1 if any check fails
+
+#include "utils.h"
+#include "vec3Reference.h"
+
+// Libraries for the report
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+int main() {
+    std::cout << "vec3 backend: " << vec3Backend << ", tolerance " << vec3Tolerance << '\n';
+
+    bool passed = true;
+    auto check = [&](const char* name, double error) {
+        bool ok = error <= vec3Tolerance;
+        passed = passed && ok;
+        std::cout << std::left << std::setw(12) << name << std::right << std::setw(14) << std::scientific << std::setprecision(2)
+                  << error << (ok ? "  ok\n" : "  FAILED\n");
+    };
+
+    // operator*= must scale all three components; it once added the factor to z
+    vec3 scaled(1, 2, 3);
+    scaled *= 2;
+    check("*=", vectorError(scaled, { 2, 4, 6 }));
+    vec3 divided(2, 4, 6);
+    divided /= 2;
+    check("/=", vectorError(divided, { 1, 2, 3 }));
+
+    // Worst error of every kernel over random inputs
+    const int count = 4096;
+    seedRandom(1);
+    double worst[7] = {};
+    for (int i = 0; i < count; i++) {
+        vec3 a = vec3::random(-10, 10);
+        vec3 b = unitVector(vec3::random(-1, 1));
+        double scalar = randomDouble(0.5, 2);
+        referenceVector ra{ a.x(), a.y(), a.z() }, rb{ b.x(), b.y(), b.z() };
+        worst[0] = std::max(worst[0], vectorError(a + b, referenceAdd(ra, rb)));
+        worst[1] = std::max(worst[1], vectorError(scalar * a, referenceScale(scalar, ra)));
+        double d = dot(a, b), rd = referenceDot(ra, rb);
+        worst[2] = std::max(worst[2], std::fabs(d - rd) / std::max(1.0, std::fabs(rd)));
+        worst[3] = std::max(worst[3], vectorError(cross(a, b), referenceCross(ra, rb)));
+        worst[4] = std::max(worst[4], vectorError(unitVector(a), referenceUnit(ra)));
+        worst[5] = std::max(worst[5], vectorError(reflect(a, b), referenceReflect(ra, rb)));
+        worst[6] = std::max(worst[6], vectorError(refract(unitVector(a), b, 1 / 1.5), referenceRefract(referenceUnit(ra), rb, 1 / 1.5)));
+    }
+    const char* kernels[7] = { "add", "scale", "dot", "cross", "unitVector", "reflect", "refract" };
+    for (int k = 0; k < 7; k++)
+        check(kernels[k], worst[k]);
+
+    std::cout << (passed ? "all kernels within tolerance\n" : "KERNELS OUTSIDE TOLERANCE\n");
+    return passed ? 0 : 1;
+}